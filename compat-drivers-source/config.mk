@@ -271,6 +271,11 @@ export CONFIG_ATH9K_HW=m
 export CONFIG_ATH9K_COMMON=m
 # export CONFIG_ATH9K_DEBUGFS=y
 # export CONFIG_ATH9K_AHB=y
+ifdef CONFIG_RELAY
+ifdef CONFIG_DEBUG_FS
+export CONFIG_ATH9K_SPECTRAL=y
+endif #CONFIG_DEBUG_FS
+endif #CONFIG_RELAY
 
 # Disable this to get minstrel as default, we leave the ath9k
 # rate control algorithm as the default for now as that is also
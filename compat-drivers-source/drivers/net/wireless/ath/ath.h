@@ -144,6 +144,8 @@ struct ath_common {
 	DECLARE_BITMAP(keymap, ATH_KEYMAX);
 	DECLARE_BITMAP(tkip_keymap, ATH_KEYMAX);
 	DECLARE_BITMAP(ccmp_keymap, ATH_KEYMAX);
+	DECLARE_BITMAP(keygroup_used, ATH_KEYMAX / 2);
+	DECLARE_BITMAP(keygroup_partial, ATH_KEYMAX / 2);
 	enum ath_crypt_caps crypt_caps;
 
 	unsigned int clockrate;
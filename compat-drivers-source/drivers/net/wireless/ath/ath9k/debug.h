@@ -23,7 +23,6 @@
 
 struct ath_txq;
 struct ath_buf;
-struct fft_sample_tlv;
 
 #ifdef CONFIG_ATH9K_DEBUGFS
 #define TX_STAT_INC(q, c) sc->debug.stats.txstats[q].c++
@@ -290,6 +289,10 @@ struct ath9k_debug {
 	struct dentry *debugfs_phy;
 	u32 regidx;
 	struct ath_stats stats;
+#ifdef CONFIG_ATH9K_DFS_DEBUGFS
+	struct mutex dfs_test_mutex;
+	struct ath_dfs_pattern_test dfs_test;
+#endif
 #ifdef CONFIG_ATH9K_MAC_DEBUG
 	spinlock_t samp_lock;
 	struct ath_dbg_bb_mac_samp bb_mac_samp[ATH_DBG_MAX_SAMPLES];
@@ -323,9 +326,6 @@ void ath9k_sta_remove_debugfs(struct ieee80211_hw *hw,
 			      struct ieee80211_sta *sta,
 			      struct dentry *dir);
 
-void ath_debug_send_fft_sample(struct ath_softc *sc,
-			       struct fft_sample_tlv *fft_sample);
-
 #else
 
 #define RX_STAT_INC(c) /* NOP */
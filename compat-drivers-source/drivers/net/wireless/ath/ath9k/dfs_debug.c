@@ -17,19 +17,22 @@
 
 #include <linux/debugfs.h>
 #include <linux/export.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/sort.h>
 
 #include "ath9k.h"
 #include "dfs_debug.h"
 
 
-struct ath_dfs_pool_stats global_dfs_pool_stats = { 0 };
+struct ath_dfs_pri_stats global_dfs_pri_stats = { 0 };
 
 #define ATH9K_DFS_STAT(s, p) \
 	len += snprintf(buf + len, size - len, "%28s : %10u\n", s, \
 			sc->debug.stats.dfs_stats.p);
-#define ATH9K_DFS_POOL_STAT(s, p) \
+#define ATH9K_DFS_PRI_STAT(s, p) \
 	len += snprintf(buf + len, size - len, "%28s : %10u\n", s, \
-			global_dfs_pool_stats.p);
+			global_dfs_pri_stats.p);
 
 static ssize_t read_file_dfs(struct file *file, char __user *user_buf,
 			     size_t count, loff_t *ppos)
@@ -63,14 +66,10 @@ static ssize_t read_file_dfs(struct file *file, char __user *user_buf,
 			"(current DFS region: %d)\n", sc->dfs_detector->region);
 	ATH9K_DFS_STAT("Pulse events processed  ", pulses_processed);
 	ATH9K_DFS_STAT("Radars detected         ", radar_detected);
-	len += snprintf(buf + len, size - len, "Global Pool statistics:\n");
-	ATH9K_DFS_POOL_STAT("Pool references         ", pool_reference);
-	ATH9K_DFS_POOL_STAT("Pulses allocated        ", pulse_allocated);
-	ATH9K_DFS_POOL_STAT("Pulses alloc error      ", pulse_alloc_error);
-	ATH9K_DFS_POOL_STAT("Pulses in use           ", pulse_used);
-	ATH9K_DFS_POOL_STAT("Seqs. allocated         ", pseq_allocated);
-	ATH9K_DFS_POOL_STAT("Seqs. alloc error       ", pseq_alloc_error);
-	ATH9K_DFS_POOL_STAT("Seqs. in use            ", pseq_used);
+	len += snprintf(buf + len, size - len, "PRI detector statistics:\n");
+	ATH9K_DFS_PRI_STAT("PRI detectors           ", pri_detectors);
+	ATH9K_DFS_PRI_STAT("Seqs. evicted           ", pseq_evicted);
+	ATH9K_DFS_PRI_STAT("Seqs. dropped           ", pseq_dropped);
 
 	if (len > size)
 		len = size;
@@ -113,8 +112,250 @@ static const struct file_operations fops_dfs_stats = {
 	.llseek = default_llseek,
 };
 
+/*
+ * Synthetic pattern test
+ *
+ * Writing "<type_id> <trains> <noise_pulses>" to dfs_pattern_test builds
+ * <trains> pulse trains from the radar_detector_specs of the given type in
+ * the current DFS domain, each mixed with <noise_pulses> random pulses, and
+ * the same number of noise-only trains. They are fed to a private pattern
+ * detector instance, so the live detector is not disturbed. Reading the
+ * file reports detection probability, false alarms and the per-pulse cost.
+ */
+#define DFS_TEST_FREQ		5500
+#define DFS_TEST_TRAIN_GAP	1000000	/* usecs, longer than any window */
+#define DFS_TEST_MAX_NOISE	1000
+
+static u32 dfs_test_rand(u32 min, u32 max)
+{
+	if (max <= min)
+		return min;
+	return min + random32() % (max - min + 1);
+}
+
+static int dfs_test_cmp_pulse(const void *a, const void *b)
+{
+	const struct pulse_event *pa = a, *pb = b;
+
+	if (pa->ts < pb->ts)
+		return -1;
+	return pa->ts > pb->ts;
+}
+
+/* build a time sorted train starting at ts, returns its duration */
+static u32 dfs_test_build_train(const struct radar_detector_specs *rs,
+				struct pulse_event *pe, u32 noise,
+				u64 ts, bool radar)
+{
+	u32 pri_lo = rs->pri_min + rs->max_pri_tolerance;
+	u32 pri_hi = rs->pri_max + rs->max_pri_tolerance;
+	u32 pris[8];
+	u32 dur = 0;
+	u32 i, n = 0;
+
+	for (i = 0; i < rs->num_pri && i < ARRAY_SIZE(pris); i++)
+		pris[i] = dfs_test_rand(pri_lo, max(pri_lo, pri_hi));
+
+	for (i = 0; i < rs->ppb; i++) {
+		pe[n].width = dfs_test_rand(rs->width_min, rs->width_max);
+		pe[n].ts = ts + dur;
+		n++;
+		dur += pris[i % min_t(u32, rs->num_pri, ARRAY_SIZE(pris))];
+	}
+
+	/* noise-only trains spread the same number of pulses randomly */
+	if (!radar) {
+		noise += rs->ppb;
+		n = 0;
+	}
+
+	for (i = 0; i < noise; i++) {
+		pe[n].width = dfs_test_rand(1, 30);
+		pe[n].ts = ts + dfs_test_rand(0, dur);
+		n++;
+	}
+
+	for (i = 0; i < n; i++)
+		pe[i].freq = DFS_TEST_FREQ;
+
+	sort(pe, n, sizeof(*pe), dfs_test_cmp_pulse, NULL);
+	return dur;
+}
+
+/* feed one train, returns true if the detector reported radar */
+static bool dfs_test_feed(struct dfs_pattern_detector *dpd,
+			  struct pulse_event *pe, u32 n,
+			  struct ath_dfs_pattern_test *res)
+{
+	ktime_t start;
+	bool found = false;
+	u32 i;
+
+	start = ktime_get();
+	for (i = 0; i < n; i++) {
+		if (dpd->add_pulse(dpd, &pe[i])) {
+			found = true;
+			i++;
+			break;
+		}
+	}
+	res->nsecs += ktime_to_ns(ktime_sub(ktime_get(), start));
+	res->pulses += i;
+	return found;
+}
+
+static int dfs_test_run(struct ath_softc *sc, u32 type_id, u32 trains,
+			u32 noise)
+{
+	struct ath_dfs_pattern_test *res = &sc->debug.dfs_test;
+	const struct radar_detector_specs *rs = NULL;
+	struct dfs_pattern_detector *dpd;
+	struct pulse_event *pe;
+	u64 ts = DFS_TEST_TRAIN_GAP;
+	u32 i, n;
+
+	if (sc->dfs_detector == NULL ||
+	    sc->dfs_detector->region == NL80211_DFS_UNSET)
+		return -EOPNOTSUPP;
+
+	dpd = dfs_pattern_detector_init(sc->dfs_detector->region);
+	if (dpd == NULL)
+		return -ENOMEM;
+	dpd->quiet = true;
+
+	for (i = 0; i < dpd->num_radar_types; i++) {
+		if (dpd->radar_spec[i].type_id == type_id) {
+			rs = &dpd->radar_spec[i];
+			break;
+		}
+	}
+	if (rs == NULL) {
+		dpd->exit(dpd);
+		return -EINVAL;
+	}
+
+	n = rs->ppb + noise;
+	pe = kcalloc(n, sizeof(*pe), GFP_KERNEL);
+	if (pe == NULL) {
+		dpd->exit(dpd);
+		return -ENOMEM;
+	}
+
+	mutex_lock(&sc->debug.dfs_test_mutex);
+	memset(res, 0, sizeof(*res));
+	res->type_id = type_id;
+	res->trains = trains;
+	res->noise_pulses = noise;
+
+	for (i = 0; i < trains; i++) {
+		ts += dfs_test_build_train(rs, pe, noise, ts, true);
+		if (dfs_test_feed(dpd, pe, n, res))
+			res->detected++;
+		ts += DFS_TEST_TRAIN_GAP;
+
+		ts += dfs_test_build_train(rs, pe, noise, ts, false);
+		if (dfs_test_feed(dpd, pe, n, res))
+			res->false_alarms++;
+		ts += DFS_TEST_TRAIN_GAP;
+
+		cond_resched();
+	}
+	mutex_unlock(&sc->debug.dfs_test_mutex);
+
+	kfree(pe);
+	dpd->exit(dpd);
+	return 0;
+}
+
+static ssize_t read_file_dfs_test(struct file *file, char __user *user_buf,
+				  size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	struct ath_dfs_pattern_test *res = &sc->debug.dfs_test;
+	u32 pd = 0, pfa = 0;
+	u64 ns_per_pulse = 0;
+	char buf[512];
+	unsigned int len = 0, size = sizeof(buf);
+
+	mutex_lock(&sc->debug.dfs_test_mutex);
+	if (res->trains) {
+		pd = res->detected * 1000 / res->trains;
+		pfa = res->false_alarms * 1000 / res->trains;
+	}
+	if (res->pulses) {
+		ns_per_pulse = res->nsecs;
+		do_div(ns_per_pulse, res->pulses);
+	}
+
+	len += snprintf(buf + len, size - len, "%28s : %10u\n",
+			"Radar type              ", res->type_id);
+	len += snprintf(buf + len, size - len, "%28s : %10u\n",
+			"Trains                  ", res->trains);
+	len += snprintf(buf + len, size - len, "%28s : %10u\n",
+			"Noise pulses per train  ", res->noise_pulses);
+	len += snprintf(buf + len, size - len, "%28s : %10u\n",
+			"Radar trains detected   ", res->detected);
+	len += snprintf(buf + len, size - len, "%28s : %10u\n",
+			"Noise trains detected   ", res->false_alarms);
+	len += snprintf(buf + len, size - len, "%28s : %6u.%u %%\n",
+			"Detection probability   ", pd / 10, pd % 10);
+	len += snprintf(buf + len, size - len, "%28s : %6u.%u %%\n",
+			"False alarm rate        ", pfa / 10, pfa % 10);
+	len += snprintf(buf + len, size - len, "%28s : %10llu\n",
+			"Pulses processed        ",
+			(unsigned long long)res->pulses);
+	len += snprintf(buf + len, size - len, "%28s : %10llu\n",
+			"Nsecs per pulse         ",
+			(unsigned long long)ns_per_pulse);
+	mutex_unlock(&sc->debug.dfs_test_mutex);
+
+	if (len > size)
+		len = size;
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t write_file_dfs_test(struct file *file,
+				   const char __user *user_buf,
+				   size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	u32 type_id, trains, noise;
+	char buf[64];
+	ssize_t len;
+	int ret;
+
+	len = min(count, sizeof(buf) - 1);
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+	if (sscanf(buf, "%u %u %u", &type_id, &trains, &noise) != 3)
+		return -EINVAL;
+
+	if (trains == 0 || noise > DFS_TEST_MAX_NOISE)
+		return -EINVAL;
+
+	ret = dfs_test_run(sc, type_id, trains, noise);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static const struct file_operations fops_dfs_test = {
+	.read = read_file_dfs_test,
+	.write = write_file_dfs_test,
+	.open = simple_open,
+	.owner = THIS_MODULE,
+	.llseek = default_llseek,
+};
+
 void ath9k_dfs_init_debug(struct ath_softc *sc)
 {
+	mutex_init(&sc->debug.dfs_test_mutex);
 	debugfs_create_file("dfs_stats", S_IRUSR,
 			    sc->debug.debugfs_phy, sc, &fops_dfs_stats);
+	debugfs_create_file("dfs_pattern_test", S_IRUSR | S_IWUSR,
+			    sc->debug.debugfs_phy, sc, &fops_dfs_test);
 }
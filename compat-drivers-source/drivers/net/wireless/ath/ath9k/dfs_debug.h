@@ -52,33 +52,54 @@ struct ath_dfs_stats {
 };
 
 /**
- * struct ath_dfs_pool_stats - DFS Statistics for global pools
+ * struct ath_dfs_pri_stats - DFS Statistics for all PRI detectors
+ * @pri_detectors: PRI detector instances in use
+ * @pseq_evicted:  sequences evicted from a full candidate set
+ * @pseq_dropped:  new sequences dropped because the candidate set was full
  */
-struct ath_dfs_pool_stats {
-	u32 pool_reference;
-	u32 pulse_allocated;
-	u32 pulse_alloc_error;
-	u32 pulse_used;
-	u32 pseq_allocated;
-	u32 pseq_alloc_error;
-	u32 pseq_used;
+struct ath_dfs_pri_stats {
+	u32 pri_detectors;
+	u32 pseq_evicted;
+	u32 pseq_dropped;
 };
+/**
+ * struct ath_dfs_pattern_test - result of the last synthetic pattern run
+ * @type_id:      radar type the pulse trains were synthesised from
+ * @trains:       number of radar trains (and of noise-only trains) fed
+ * @noise_pulses: random pulses added to each train
+ * @detected:     radar trains reported as radar
+ * @false_alarms: noise-only trains reported as radar
+ * @pulses:       pulses handed to the detector
+ * @nsecs:        time spent inside the detector
+ *
+ * Runs and reads are serialized by ath9k_debug.dfs_test_mutex.
+ */
+struct ath_dfs_pattern_test {
+	u32 type_id;
+	u32 trains;
+	u32 noise_pulses;
+	u32 detected;
+	u32 false_alarms;
+	u64 pulses;
+	u64 nsecs;
+};
+
 #if defined(CONFIG_ATH9K_DFS_DEBUGFS)
 
 #define DFS_STAT_INC(sc, c) (sc->debug.stats.dfs_stats.c++)
 void ath9k_dfs_init_debug(struct ath_softc *sc);
 
-#define DFS_POOL_STAT_INC(c) (global_dfs_pool_stats.c++)
-#define DFS_POOL_STAT_DEC(c) (global_dfs_pool_stats.c--)
-extern struct ath_dfs_pool_stats global_dfs_pool_stats;
+#define DFS_PRI_STAT_INC(c) (global_dfs_pri_stats.c++)
+#define DFS_PRI_STAT_DEC(c) (global_dfs_pri_stats.c--)
+extern struct ath_dfs_pri_stats global_dfs_pri_stats;
 
 #else
 
 #define DFS_STAT_INC(sc, c) do { } while (0)
 static inline void ath9k_dfs_init_debug(struct ath_softc *sc) { }
 
-#define DFS_POOL_STAT_INC(c) do { } while (0)
-#define DFS_POOL_STAT_DEC(c) do { } while (0)
+#define DFS_PRI_STAT_INC(c) do { } while (0)
+#define DFS_PRI_STAT_DEC(c) do { } while (0)
 #endif /* CONFIG_ATH9K_DFS_DEBUGFS */
 
 #endif /* ATH9K_DFS_DEBUG_H */
@@ -159,6 +159,7 @@ channel_detector_create(struct dfs_pattern_detector *dpd, u16 freq)
 		struct pri_detector *de = pri_detector_init(rs);
 		if (de == NULL)
 			goto fail;
+		de->quiet = dpd->quiet;
 		cd->detectors[i] = de;
 	}
 	list_add(&cd->head, &dpd->channel_detectors);
@@ -69,6 +69,7 @@ struct radar_detector_specs {
  * @last_pulse_ts: time stamp of last valid pulse in usecs
  * @radar_detector_specs: array of radar detection specs
  * @channel_detectors: list connecting channel_detector elements
+ * @quiet: don't log detections, for synthetic pattern tests
  */
 struct dfs_pattern_detector {
 	void (*exit)(struct dfs_pattern_detector *dpd);
@@ -83,6 +84,7 @@ struct dfs_pattern_detector {
 
 	const struct radar_detector_specs *radar_spec;
 	struct list_head channel_detectors;
+	bool quiet;
 };
 
 /**
@@ -15,7 +15,6 @@
  */
 
 #include <linux/slab.h>
-#include <linux/spinlock.h>
 
 #include "ath9k.h"
 #include "dfs_pattern_detector.h"
@@ -24,7 +23,6 @@
 
 /**
  * struct pri_sequence - sequence of pulses matching one PRI
- * @head: list_head
  * @pri: pulse repetition interval (PRI) in usecs
  * @dur: duration of sequence in usecs
  * @count: number of pulses in this sequence
@@ -34,7 +32,6 @@
  * @deadline_ts: deadline when this sequence becomes invalid (first_ts + dur)
  */
 struct pri_sequence {
-	struct list_head head;
 	u32 pri;
 	u32 dur;
 	u32 count;
@@ -44,15 +41,6 @@ struct pri_sequence {
 	u64 deadline_ts;
 };
 
-/**
- * struct pulse_elem - elements in pulse queue
- * @ts: time stamp in usecs
- */
-struct pulse_elem {
-	struct list_head head;
-	u64 ts;
-};
-
 /**
  * pde_get_multiple() - get number of multiples considering a given tolerance
  * @return factor if abs(val - factor*fraction) <= tolerance, 0 otherwise
@@ -86,110 +74,32 @@ static u32 pde_get_multiple(u32 val, u32 fraction, u32 tolerance)
 }
 
 /**
- * DOC: Singleton Pulse and Sequence Pools
+ * DOC: Per-Detector Pulse Ring and Sequence Set
  *
- * Instances of pri_sequence and pulse_elem are kept in singleton pools to
- * reduce the number of dynamic allocations. They are shared between all
- * instances and grow up to the peak number of simultaneously used objects.
+ * Every detector owns a ring of pulse time stamps and a bounded array of
+ * candidate sequences, both sized from its radar specs and allocated
+ * together with the detector. No memory is allocated and no lock is taken
+ * on the pulse path; detectors are only ever accessed from the context
+ * feeding the owning pattern detector.
  *
- * Memory is freed after all references to the pools are released.
+ * If the sequence set is full, a new candidate replaces the weakest
+ * existing one if it has more matching pulses, and is dropped otherwise.
  */
-static u32 singleton_pool_references;
-static LIST_HEAD(pulse_pool);
-static LIST_HEAD(pseq_pool);
-static DEFINE_SPINLOCK(pool_lock);
-
-static void pool_register_ref(void)
-{
-	spin_lock_bh(&pool_lock);
-	singleton_pool_references++;
-	DFS_POOL_STAT_INC(pool_reference);
-	spin_unlock_bh(&pool_lock);
-}
-
-static void pool_deregister_ref(void)
-{
-	spin_lock_bh(&pool_lock);
-	singleton_pool_references--;
-	DFS_POOL_STAT_DEC(pool_reference);
-	if (singleton_pool_references == 0) {
-		/* free singleton pools with no references left */
-		struct pri_sequence *ps, *ps0;
-		struct pulse_elem *p, *p0;
-
-		list_for_each_entry_safe(p, p0, &pulse_pool, head) {
-			list_del(&p->head);
-			DFS_POOL_STAT_DEC(pulse_allocated);
-			kfree(p);
-		}
-		list_for_each_entry_safe(ps, ps0, &pseq_pool, head) {
-			list_del(&ps->head);
-			DFS_POOL_STAT_DEC(pseq_allocated);
-			kfree(ps);
-		}
-	}
-	spin_unlock_bh(&pool_lock);
-}
-
-static void pool_put_pulse_elem(struct pulse_elem *pe)
-{
-	spin_lock_bh(&pool_lock);
-	list_add(&pe->head, &pulse_pool);
-	DFS_POOL_STAT_DEC(pulse_used);
-	spin_unlock_bh(&pool_lock);
-}
-
-static void pool_put_pseq_elem(struct pri_sequence *pse)
-{
-	spin_lock_bh(&pool_lock);
-	list_add(&pse->head, &pseq_pool);
-	DFS_POOL_STAT_DEC(pseq_used);
-	spin_unlock_bh(&pool_lock);
-}
 
-static struct pri_sequence *pool_get_pseq_elem(void)
+/* pulse_queue_ts() - time stamp of the n-th newest pulse (0 = newest) */
+static inline u64 pulse_queue_ts(struct pri_detector *pde, u32 n)
 {
-	struct pri_sequence *pse = NULL;
-	spin_lock_bh(&pool_lock);
-	if (!list_empty(&pseq_pool)) {
-		pse = list_first_entry(&pseq_pool, struct pri_sequence, head);
-		list_del(&pse->head);
-		DFS_POOL_STAT_INC(pseq_used);
-	}
-	spin_unlock_bh(&pool_lock);
-	return pse;
-}
+	u32 idx = pde->pulse_head + pde->max_count - n;
 
-static struct pulse_elem *pool_get_pulse_elem(void)
-{
-	struct pulse_elem *pe = NULL;
-	spin_lock_bh(&pool_lock);
-	if (!list_empty(&pulse_pool)) {
-		pe = list_first_entry(&pulse_pool, struct pulse_elem, head);
-		list_del(&pe->head);
-		DFS_POOL_STAT_INC(pulse_used);
-	}
-	spin_unlock_bh(&pool_lock);
-	return pe;
-}
-
-static struct pulse_elem *pulse_queue_get_tail(struct pri_detector *pde)
-{
-	struct list_head *l = &pde->pulses;
-	if (list_empty(l))
-		return NULL;
-	return list_entry(l->prev, struct pulse_elem, head);
+	if (idx >= pde->max_count)
+		idx -= pde->max_count;
+	return pde->pulses[idx];
 }
 
 static bool pulse_queue_dequeue(struct pri_detector *pde)
 {
-	struct pulse_elem *p = pulse_queue_get_tail(pde);
-	if (p != NULL) {
-		list_del_init(&p->head);
+	if (pde->count > 0)
 		pde->count--;
-		/* give it back to pool */
-		pool_put_pulse_elem(p);
-	}
 	return (pde->count > 0);
 }
 
@@ -197,7 +107,6 @@ static bool pulse_queue_dequeue(struct pri_detector *pde)
 static void pulse_queue_check_window(struct pri_detector *pde)
 {
 	u64 min_valid_ts;
-	struct pulse_elem *p;
 
 	/* there is no delta time with less than 2 pulses */
 	if (pde->count < 2)
@@ -207,79 +116,97 @@ static void pulse_queue_check_window(struct pri_detector *pde)
 		return;
 
 	min_valid_ts = pde->last_ts - pde->window_size;
-	while ((p = pulse_queue_get_tail(pde)) != NULL) {
-		if (p->ts >= min_valid_ts)
+	while (pde->count > 0) {
+		if (pulse_queue_ts(pde, pde->count - 1) >= min_valid_ts)
 			return;
 		pulse_queue_dequeue(pde);
 	}
 }
 
-static bool pulse_queue_enqueue(struct pri_detector *pde, u64 ts)
+static void pulse_queue_enqueue(struct pri_detector *pde, u64 ts)
 {
-	struct pulse_elem *p = pool_get_pulse_elem();
-	if (p == NULL) {
-		p = kmalloc(sizeof(*p), GFP_KERNEL);
-		if (p == NULL) {
-			DFS_POOL_STAT_INC(pulse_alloc_error);
-			return false;
-		}
-		DFS_POOL_STAT_INC(pulse_allocated);
-		DFS_POOL_STAT_INC(pulse_used);
-	}
-	INIT_LIST_HEAD(&p->head);
-	p->ts = ts;
-	list_add(&p->head, &pde->pulses);
+	if (++pde->pulse_head == pde->max_count)
+		pde->pulse_head = 0;
+	pde->pulses[pde->pulse_head] = ts;
 	pde->count++;
 	pde->last_ts = ts;
 	pulse_queue_check_window(pde);
 	if (pde->count >= pde->max_count)
 		pulse_queue_dequeue(pde);
-	return true;
 }
 
-static bool pseq_handler_create_sequences(struct pri_detector *pde,
+/* add a sequence to the candidate set, evicting the weakest if full */
+static void pseq_handler_insert(struct pri_detector *pde,
+				struct pri_sequence *ps)
+{
+	struct pri_sequence *weakest;
+	u32 i;
+
+	if (pde->num_sequences < pde->max_sequences) {
+		pde->sequences[pde->num_sequences++] = *ps;
+		return;
+	}
+
+	weakest = &pde->sequences[0];
+	for (i = 1; i < pde->num_sequences; i++) {
+		if (pde->sequences[i].count < weakest->count)
+			weakest = &pde->sequences[i];
+	}
+
+	if (weakest->count >= ps->count) {
+		DFS_PRI_STAT_INC(pseq_dropped);
+		return;
+	}
+
+	DFS_PRI_STAT_INC(pseq_evicted);
+	*weakest = *ps;
+}
+
+static void pseq_handler_create_sequences(struct pri_detector *pde,
 					  u64 ts, u32 min_count)
 {
-	struct pulse_elem *p;
-	list_for_each_entry(p, &pde->pulses, head) {
-		struct pri_sequence ps, *new_ps;
-		struct pulse_elem *p2;
+	u32 i, j;
+
+	for (i = 0; i < pde->count; i++) {
+		struct pri_sequence ps;
 		u32 tmp_false_count;
 		u64 min_valid_ts;
-		u32 delta_ts = ts - p->ts;
+		u64 p_ts = pulse_queue_ts(pde, i);
+		u32 delta_ts = ts - p_ts;
 
 		if (delta_ts < pde->rs->pri_min)
 			/* ignore too small pri */
 			continue;
 
 		if (delta_ts > pde->rs->pri_max)
-			/* stop on too large pri (sorted list) */
+			/* stop on too large pri (sorted ring) */
 			break;
 
 		/* build a new sequence with new potential pri */
 		ps.count = 2;
 		ps.count_falses = 0;
-		ps.first_ts = p->ts;
+		ps.first_ts = p_ts;
 		ps.last_ts = ts;
-		ps.pri = ts - p->ts;
+		ps.pri = ts - p_ts;
 		ps.dur = ps.pri * (pde->rs->ppb - 1)
 				+ 2 * pde->rs->max_pri_tolerance;
 
-		p2 = p;
 		tmp_false_count = 0;
 		min_valid_ts = ts - ps.dur;
 		/* check which past pulses are candidates for new sequence */
-		list_for_each_entry_continue(p2, &pde->pulses, head) {
+		for (j = i + 1; j < pde->count; j++) {
+			u64 p2_ts = pulse_queue_ts(pde, j);
 			u32 factor;
-			if (p2->ts < min_valid_ts)
+
+			if (p2_ts < min_valid_ts)
 				/* stop on crossing window border */
 				break;
 			/* check if pulse match (multi)PRI */
-			factor = pde_get_multiple(ps.last_ts - p2->ts, ps.pri,
+			factor = pde_get_multiple(ps.last_ts - p2_ts, ps.pri,
 						  pde->rs->max_pri_tolerance);
 			if (factor > 0) {
 				ps.count++;
-				ps.first_ts = p2->ts;
+				ps.first_ts = p2_ts;
 				/*
 				 * on match, add the intermediate falses
 				 * and reset counter
@@ -297,21 +224,8 @@ static bool pseq_handler_create_sequences(struct pri_detector *pde,
 
 		/* this is a valid one, add it */
 		ps.deadline_ts = ps.first_ts + ps.dur;
-		new_ps = pool_get_pseq_elem();
-		if (new_ps == NULL) {
-			new_ps = kmalloc(sizeof(*new_ps), GFP_KERNEL);
-			if (new_ps == NULL) {
-				DFS_POOL_STAT_INC(pseq_alloc_error);
-				return false;
-			}
-			DFS_POOL_STAT_INC(pseq_allocated);
-			DFS_POOL_STAT_INC(pseq_used);
-		}
-		memcpy(new_ps, &ps, sizeof(ps));
-		INIT_LIST_HEAD(&new_ps->head);
-		list_add(&new_ps->head, &pde->sequences);
+		pseq_handler_insert(pde, &ps);
 	}
-	return true;
 }
 
 /* check new ts and add to all matching existing sequences */
@@ -319,15 +233,17 @@ static u32
 pseq_handler_add_to_existing_seqs(struct pri_detector *pde, u64 ts)
 {
 	u32 max_count = 0;
-	struct pri_sequence *ps, *ps2;
-	list_for_each_entry_safe(ps, ps2, &pde->sequences, head) {
+	u32 i = 0;
+
+	while (i < pde->num_sequences) {
+		struct pri_sequence *ps = &pde->sequences[i];
 		u32 delta_ts;
 		u32 factor;
 
 		/* first ensure that sequence is within window */
 		if (ts > ps->deadline_ts) {
-			list_del_init(&ps->head);
-			pool_put_pseq_elem(ps);
+			/* fill the hole with the last entry */
+			*ps = pde->sequences[--pde->num_sequences];
 			continue;
 		}
 
@@ -343,6 +259,7 @@ pseq_handler_add_to_existing_seqs(struct pri_detector *pde, u64 ts)
 		} else {
 			ps->count_falses++;
 		}
+		i++;
 	}
 	return max_count;
 }
@@ -350,12 +267,10 @@ pseq_handler_add_to_existing_seqs(struct pri_detector *pde, u64 ts)
 static struct pri_sequence *
 pseq_handler_check_detection(struct pri_detector *pde)
 {
-	struct pri_sequence *ps;
+	u32 i;
 
-	if (list_empty(&pde->sequences))
-		return NULL;
-
-	list_for_each_entry(ps, &pde->sequences, head) {
+	for (i = 0; i < pde->num_sequences; i++) {
+		struct pri_sequence *ps = &pde->sequences[i];
 		/*
 		 * we assume to have enough matching confidence if we
 		 * 1) have enough pulses
@@ -369,27 +284,17 @@ pseq_handler_check_detection(struct pri_detector *pde)
 }
 
 
-/* free pulse queue and sequences list and give objects back to pools */
+/* clear pulse queue and sequence set */
 static void pri_detector_reset(struct pri_detector *pde, u64 ts)
 {
-	struct pri_sequence *ps, *ps0;
-	struct pulse_elem *p, *p0;
-	list_for_each_entry_safe(ps, ps0, &pde->sequences, head) {
-		list_del_init(&ps->head);
-		pool_put_pseq_elem(ps);
-	}
-	list_for_each_entry_safe(p, p0, &pde->pulses, head) {
-		list_del_init(&p->head);
-		pool_put_pulse_elem(p);
-	}
+	pde->num_sequences = 0;
 	pde->count = 0;
 	pde->last_ts = ts;
 }
 
 static void pri_detector_exit(struct pri_detector *de)
 {
-	pri_detector_reset(de, 0);
-	pool_deregister_ref();
+	DFS_PRI_STAT_DEC(pri_detectors);
 	kfree(de);
 }
 
@@ -412,17 +317,15 @@ static bool pri_detector_add_pulse(struct pri_detector *de,
 
 	max_updated_seq = pseq_handler_add_to_existing_seqs(de, ts);
 
-	if (!pseq_handler_create_sequences(de, ts, max_updated_seq)) {
-		pr_err("failed to create pulse sequences\n");
-		pri_detector_reset(de, ts);
-		return false;
-	}
+	pseq_handler_create_sequences(de, ts, max_updated_seq);
 
 	ps = pseq_handler_check_detection(de);
 
-	if (ps != NULL) {
+	if (ps != NULL && !de->quiet)
 		pr_info("DFS: radar found: pri=%d, count=%d, count_false=%d\n",
 			 ps->pri, ps->count, ps->count_falses);
+
+	if (ps != NULL) {
 		pri_detector_reset(de, ts);
 		return true;
 	}
@@ -434,19 +337,26 @@ struct pri_detector *
 pri_detector_init(const struct radar_detector_specs *rs)
 {
 	struct pri_detector *de;
-	de = kzalloc(sizeof(*de), GFP_KERNEL);
+	u32 max_count = rs->ppb * 2;
+	u32 max_sequences = max_count;
+	size_t sz;
+
+	sz = sizeof(*de) + max_count * sizeof(*de->pulses) +
+	     max_sequences * sizeof(struct pri_sequence);
+	de = kzalloc(sz, GFP_KERNEL);
 	if (de == NULL)
 		return NULL;
 	de->exit = pri_detector_exit;
 	de->add_pulse = pri_detector_add_pulse;
 	de->reset = pri_detector_reset;
 
-	INIT_LIST_HEAD(&de->sequences);
-	INIT_LIST_HEAD(&de->pulses);
+	de->pulses = (u64 *)(de + 1);
+	de->sequences = (struct pri_sequence *)(de->pulses + max_count);
+	de->max_sequences = max_sequences;
 	de->window_size = rs->pri_max * rs->ppb * rs->num_pri;
-	de->max_count = rs->ppb * 2;
+	de->max_count = max_count;
 	de->rs = rs;
 
-	pool_register_ref();
+	DFS_PRI_STAT_INC(pri_detectors);
 	return de;
 }
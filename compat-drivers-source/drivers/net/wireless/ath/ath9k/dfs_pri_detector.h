@@ -17,7 +17,7 @@
 #ifndef DFS_PRI_DETECTOR_H
 #define DFS_PRI_DETECTOR_H
 
-#include <linux/list.h>
+struct pri_sequence;
 
 /**
  * struct pri_detector - PRI detector element for a dedicated radar type
@@ -26,11 +26,15 @@
  * @reset(): clear states and reset to given time stamp
  * @rs: detector specs for this detector element
  * @last_ts: last pulse time stamp considered for this element in usecs
- * @sequences: list_head holding potential pulse sequences
- * @pulses: list connecting pulse_elem objects
+ * @sequences: array holding potential pulse sequences
+ * @num_sequences: number of valid entries in @sequences
+ * @max_sequences: capacity of @sequences
+ * @pulses: ring of pulse time stamps, newest at @pulse_head
+ * @pulse_head: index of the newest pulse in @pulses
  * @count: number of pulses in queue
- * @max_count: maximum number of pulses to be queued
+ * @max_count: maximum number of pulses to be queued, size of @pulses
  * @window_size: window size back from newest pulse time stamp in usecs
+ * @quiet: don't log detections
  */
 struct pri_detector {
 	void (*exit)     (struct pri_detector *de);
@@ -40,11 +44,15 @@ struct pri_detector {
 /* private: internal use only */
 	const struct radar_detector_specs *rs;
 	u64 last_ts;
-	struct list_head sequences;
-	struct list_head pulses;
+	struct pri_sequence *sequences;
+	u32 num_sequences;
+	u32 max_sequences;
+	u64 *pulses;
+	u32 pulse_head;
 	u32 count;
 	u32 max_count;
 	u32 window_size;
+	bool quiet;
 };
 
 struct pri_detector *pri_detector_init(const struct radar_detector_specs *rs);
@@ -382,21 +382,18 @@ static const struct ath_rate_table ar5416_11g_ratetable = {
 static int ath_rc_get_rateindex(struct ath_rate_priv *ath_rc_priv,
 				struct ieee80211_tx_rate *rate)
 {
-	const struct ath_rate_table *rate_table = ath_rc_priv->rate_table;
-	int rix, i, idx = 0;
+	int rix;
 
 	if (!(rate->flags & IEEE80211_TX_RC_MCS))
 		return rate->idx;
 
-	for (i = 0; i < ath_rc_priv->max_valid_rate; i++) {
-		idx = ath_rc_priv->valid_rate_index[i];
-
-		if (WLAN_RC_PHY_HT(rate_table->info[idx].phy) &&
-		    rate_table->info[idx].ratecode == rate->idx)
-			break;
-	}
-
-	rix = idx;
+	if (rate->idx < ATH_RC_MCS_MAX &&
+	    ath_rc_priv->mcs_rix[rate->idx] != ATH_RC_INVALID)
+		rix = ath_rc_priv->mcs_rix[rate->idx];
+	else if (ath_rc_priv->max_valid_rate)
+		rix = ath_rc_priv->valid_rate_index[ath_rc_priv->max_valid_rate - 1];
+	else
+		rix = 0;
 
 	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
 		rix++;
@@ -404,22 +401,59 @@ static int ath_rc_get_rateindex(struct ath_rate_priv *ath_rc_priv,
 	return rix;
 }
 
+/*
+ * Stable insertion sort by ratekbps. The valid rates are collected
+ * per phy and are therefore nearly sorted already, which makes this
+ * close to linear in practice.
+ */
 static void ath_rc_sort_validrates(struct ath_rate_priv *ath_rc_priv)
 {
 	const struct ath_rate_table *rate_table = ath_rc_priv->rate_table;
-	u8 i, j, idx, idx_next;
+	u8 i, j, idx;
 
-	for (i = ath_rc_priv->max_valid_rate - 1; i > 0; i--) {
-		for (j = 0; j <= i-1; j++) {
-			idx = ath_rc_priv->valid_rate_index[j];
-			idx_next = ath_rc_priv->valid_rate_index[j+1];
+	for (i = 1; i < ath_rc_priv->max_valid_rate; i++) {
+		idx = ath_rc_priv->valid_rate_index[i];
 
-			if (rate_table->info[idx].ratekbps >
-				rate_table->info[idx_next].ratekbps) {
-				ath_rc_priv->valid_rate_index[j] = idx_next;
-				ath_rc_priv->valid_rate_index[j+1] = idx;
-			}
+		for (j = i; j > 0; j--) {
+			u8 prev = ath_rc_priv->valid_rate_index[j-1];
+
+			if (rate_table->info[prev].ratekbps <=
+			    rate_table->info[idx].ratekbps)
+				break;
+
+			ath_rc_priv->valid_rate_index[j] = prev;
 		}
+
+		ath_rc_priv->valid_rate_index[j] = idx;
+	}
+}
+
+/*
+ * Build the reverse lookups used on the TX path, so that stepping to
+ * the next or lower valid rate and mapping an MCS back to a rate index
+ * don't need to walk the valid rate list for every frame.
+ */
+static void ath_rc_build_lookup(struct ath_rate_priv *ath_rc_priv)
+{
+	const struct ath_rate_table *rate_table = ath_rc_priv->rate_table;
+	u8 i, rix, mcs;
+
+	memset(ath_rc_priv->valid_rate_pos, ATH_RC_INVALID,
+	       sizeof(ath_rc_priv->valid_rate_pos));
+	memset(ath_rc_priv->mcs_rix, ATH_RC_INVALID,
+	       sizeof(ath_rc_priv->mcs_rix));
+
+	for (i = 0; i < ath_rc_priv->max_valid_rate; i++) {
+		rix = ath_rc_priv->valid_rate_index[i];
+		ath_rc_priv->valid_rate_pos[rix] = i;
+
+		if (!WLAN_RC_PHY_HT(rate_table->info[rix].phy))
+			continue;
+
+		mcs = rate_table->info[rix].ratecode;
+		if (mcs < ATH_RC_MCS_MAX &&
+		    ath_rc_priv->mcs_rix[mcs] == ATH_RC_INVALID)
+			ath_rc_priv->mcs_rix[mcs] = rix;
 	}
 }
 
@@ -429,13 +463,11 @@ int ath_rc_get_nextvalid_txrate(const struct ath_rate_table *rate_table,
 				u8 cur_valid_txrate,
 				u8 *next_idx)
 {
-	u8 i;
+	u8 pos = ath_rc_priv->valid_rate_pos[cur_valid_txrate];
 
-	for (i = 0; i < ath_rc_priv->max_valid_rate - 1; i++) {
-		if (ath_rc_priv->valid_rate_index[i] == cur_valid_txrate) {
-			*next_idx = ath_rc_priv->valid_rate_index[i+1];
-			return 1;
-		}
+	if (pos != ATH_RC_INVALID && pos + 1 < ath_rc_priv->max_valid_rate) {
+		*next_idx = ath_rc_priv->valid_rate_index[pos + 1];
+		return 1;
 	}
 
 	/* No more valid rates */
@@ -466,16 +498,13 @@ static inline int
 ath_rc_get_lower_rix(struct ath_rate_priv *ath_rc_priv,
 		     u8 cur_valid_txrate, u8 *next_idx)
 {
-	int8_t i;
+	u8 pos = ath_rc_priv->valid_rate_pos[cur_valid_txrate];
 
-	for (i = 1; i < ath_rc_priv->max_valid_rate ; i++) {
-		if (ath_rc_priv->valid_rate_index[i] == cur_valid_txrate) {
-			*next_idx = ath_rc_priv->valid_rate_index[i-1];
-			return 1;
-		}
-	}
+	if (pos == ATH_RC_INVALID || pos == 0)
+		return 0;
 
-	return 0;
+	*next_idx = ath_rc_priv->valid_rate_index[pos - 1];
+	return 1;
 }
 
 static u8 ath_rc_init_validrates(struct ath_rate_priv *ath_rc_priv)
@@ -1186,6 +1215,7 @@ static void ath_rc_init(struct ath_softc *sc,
 
 	ath_rc_priv->max_valid_rate = k;
 	ath_rc_sort_validrates(ath_rc_priv);
+	ath_rc_build_lookup(ath_rc_priv);
 	ath_rc_priv->rate_max_phy = (k > 4) ?
 		ath_rc_priv->valid_rate_index[k-4] :
 		ath_rc_priv->valid_rate_index[k-1];
@@ -1321,9 +1351,18 @@ static void ath_rate_update(void *priv, struct ieee80211_supported_band *sband,
 {
 	struct ath_softc *sc = priv;
 	struct ath_rate_priv *ath_rc_priv = priv_sta;
+	u8 ht_cap;
 
 	if (changed & IEEE80211_RC_BW_CHANGED) {
-		ath_rc_priv->ht_cap = ath_rc_build_ht_caps(sc, sta);
+		/*
+		 * The candidate rate set only depends on the capabilities,
+		 * so keep the PER history if they didn't change.
+		 */
+		ht_cap = ath_rc_build_ht_caps(sc, sta);
+		if (ht_cap == ath_rc_priv->ht_cap)
+			return;
+
+		ath_rc_priv->ht_cap = ht_cap;
 		ath_rc_init(sc, priv_sta);
 
 		ath_dbg(ath9k_hw_common(sc->sc_ah), CONFIG,
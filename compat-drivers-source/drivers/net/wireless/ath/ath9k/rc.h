@@ -25,6 +25,8 @@ struct ath_softc;
 
 #define ATH_RATE_MAX     30
 #define RATE_TABLE_SIZE  72
+#define ATH_RC_MCS_MAX   24
+#define ATH_RC_INVALID   0xff
 
 #define RC_INVALID	0x0000
 #define RC_LEGACY	0x0001
@@ -184,6 +186,11 @@ struct ath_rc_stats {
  * @probe_time: msec timestamp for last probe
  * @hw_maxretry_pktcnt: num of packets since we got HW max retry error
  * @max_valid_rate: maximum number of valid rate
+ * @valid_rate_index: valid rate indices, sorted by ascending rate
+ * @valid_rate_pos: position of each rate index in @valid_rate_index,
+ *	or ATH_RC_INVALID if the rate is not valid for this station
+ * @mcs_rix: lowest valid rate index for each MCS, used to map TX status
+ *	back to a rate index
  * @per_down_time: msec timestamp for last PER down step
  * @valid_phy_ratecnt: valid rate count
  * @rate_max_phy: phy index for the max rate
@@ -198,7 +205,6 @@ struct ath_rate_priv {
 	u8 probe_rate;
 	u8 hw_maxretry_pktcnt;
 	u8 max_valid_rate;
-	u8 valid_rate_index[RATE_TABLE_SIZE];
 	u8 ht_cap;
 	u8 valid_phy_ratecnt[WLAN_RC_PHY_MAX];
 	u8 valid_phy_rateidx[WLAN_RC_PHY_MAX][RATE_TABLE_SIZE];
@@ -211,6 +217,11 @@ struct ath_rate_priv {
 	struct ath_rateset neg_ht_rates;
 	const struct ath_rate_table *rate_table;
 
+	/* per-frame lookups, rebuilt by ath_rc_init() */
+	u8 valid_rate_index[RATE_TABLE_SIZE] ____cacheline_aligned;
+	u8 valid_rate_pos[RATE_TABLE_SIZE];
+	u8 mcs_rix[ATH_RC_MCS_MAX];
+
 #if defined(CONFIG_MAC80211_DEBUGFS) && defined(CONFIG_ATH9K_DEBUGFS)
 	struct dentry *debugfs_rcstats;
 	struct ath_rc_stats rcstats[RATE_TABLE_SIZE];
@@ -0,0 +1,581 @@
+/*
+ * Copyright (c) 2013 Qualcomm Atheros, Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <linux/relay.h>
+#include "ath9k.h"
+
+/*
+ * Every CPU gets its own relay buffer (spectral_scan0, spectral_scan1, ...)
+ * which userspace can mmap() and consume without further copies. Samples
+ * are built in place inside the relay sub-buffer.
+ */
+#define ATH9K_SPECTRAL_SUBBUF_SIZE	65536
+#define ATH9K_SPECTRAL_NUM_SUBBUFS	8
+
+static s8 fix_rssi_inv_only(u8 rssi_val)
+{
+	if (rssi_val == 128)
+		rssi_val = 0;
+	return (s8) rssi_val;
+}
+
+/* Copies @n bins when the MAC dropped the first one, duplicating it. */
+static void ath_fft_dup_first_bin(u8 *bins, u8 *vdata, int n)
+{
+	bins[0] = vdata[0];
+	memcpy(&bins[1], vdata, n - 1);
+}
+
+/* Fix up the variation in the amount of HT20 data the MAC hands us. */
+static bool ath_fft_fix_ht20_bins(u8 *bins, u8 *vdata, int len)
+{
+	switch (len - SPECTRAL_HT20_TOTAL_DATA_LEN) {
+	case 0:
+		/* length correct, nothing to do. */
+		memcpy(bins, vdata, SPECTRAL_HT20_NUM_BINS);
+		break;
+	case -1:
+		/* first byte missing, duplicate it. */
+		ath_fft_dup_first_bin(bins, vdata, SPECTRAL_HT20_NUM_BINS);
+		break;
+	case 2:
+		/* MAC added 2 extra bytes at bin 30 and 32, remove them. */
+		memcpy(bins, vdata, 30);
+		bins[30] = vdata[31];
+		memcpy(&bins[31], &vdata[33], SPECTRAL_HT20_NUM_BINS - 31);
+		break;
+	case 1:
+		/* MAC added 2 extra bytes AND first byte is missing. */
+		ath_fft_dup_first_bin(bins, vdata, 31);
+		bins[31] = vdata[31];
+		memcpy(&bins[32], &vdata[33], SPECTRAL_HT20_NUM_BINS - 32);
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/* Only the missing first byte has been observed on HT20/40 samples. */
+static bool ath_fft_fix_ht20_40_bins(u8 *bins, u8 *vdata, int len)
+{
+	switch (len - SPECTRAL_HT20_40_TOTAL_DATA_LEN) {
+	case 0:
+		memcpy(bins, vdata, SPECTRAL_HT20_40_NUM_BINS);
+		break;
+	case -1:
+		ath_fft_dup_first_bin(bins, vdata, SPECTRAL_HT20_40_NUM_BINS);
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+static int ath_fft_send_ht20(struct ath_softc *sc, struct ath_rx_status *rs,
+			     u8 *vdata, int len, u64 tsf)
+{
+	struct ath_hw *ah = sc->sc_ah;
+	struct fft_sample_ht20 *fft_sample;
+	struct ath_radar_info *radar_info;
+	struct ath_ht20_mag_info *mag_info;
+	u8 bins[SPECTRAL_HT20_NUM_BINS];
+	int i, dc_pos;
+
+	if (!ath_fft_fix_ht20_bins(bins, vdata, len)) {
+		sc->spec_stats.len_discards++;
+		return -EINVAL;
+	}
+
+	fft_sample = relay_reserve(sc->rfs_chan_spec_scan, sizeof(*fft_sample));
+	if (!fft_sample) {
+		sc->spec_stats.dropped++;
+		return -ENOBUFS;
+	}
+
+	fft_sample->tlv.type = ATH_FFT_SAMPLE_HT20;
+	fft_sample->tlv.length = sizeof(*fft_sample) - sizeof(fft_sample->tlv);
+	fft_sample->__alignment = 0;
+
+	fft_sample->freq = ah->curchan->chan->center_freq;
+	fft_sample->rssi = fix_rssi_inv_only(rs->rs_rssi_ctl0);
+	fft_sample->noise = ah->noise;
+
+	/* DC value (value in the middle) is the blind spot of the spectral
+	 * sample and invalid, interpolate it.
+	 */
+	dc_pos = SPECTRAL_HT20_NUM_BINS / 2;
+	bins[dc_pos] = (bins[dc_pos + 1] + bins[dc_pos - 1]) / 2;
+
+	/* mag data is at the end of the frame, in front of radar_info */
+	radar_info = ((struct ath_radar_info *)&vdata[len]) - 1;
+	mag_info = ((struct ath_ht20_mag_info *)radar_info) - 1;
+
+	/* Apply exponent and grab further auxiliary information. */
+	for (i = 0; i < SPECTRAL_HT20_NUM_BINS; i++)
+		fft_sample->data[i] = bins[i] << mag_info->max_exp;
+
+	fft_sample->max_magnitude = spectral_max_magnitude(mag_info->all_bins);
+	fft_sample->max_index = spectral_max_index(mag_info->all_bins);
+	fft_sample->bitmap_weight = spectral_bitmap_weight(mag_info->all_bins);
+	fft_sample->tsf = tsf;
+
+	sc->spec_stats.samples++;
+	return 0;
+}
+
+static int ath_fft_send_ht20_40(struct ath_softc *sc, struct ath_rx_status *rs,
+				u8 *vdata, int len, u64 tsf)
+{
+	struct ath_hw *ah = sc->sc_ah;
+	struct ieee80211_conf *conf = &sc->hw->conf;
+	struct fft_sample_ht20_40 *fft_sample;
+	struct ath_radar_info *radar_info;
+	struct ath_ht20_40_mag_info *mag_info;
+	u8 bins[SPECTRAL_HT20_40_NUM_BINS];
+	int i, dc_pos;
+
+	if (!ath_fft_fix_ht20_40_bins(bins, vdata, len)) {
+		sc->spec_stats.len_discards++;
+		return -EINVAL;
+	}
+
+	fft_sample = relay_reserve(sc->rfs_chan_spec_scan, sizeof(*fft_sample));
+	if (!fft_sample) {
+		sc->spec_stats.dropped++;
+		return -ENOBUFS;
+	}
+
+	fft_sample->tlv.type = ATH_FFT_SAMPLE_HT20_40;
+	fft_sample->tlv.length = sizeof(*fft_sample) - sizeof(fft_sample->tlv);
+
+	fft_sample->channel_type = conf->channel_type;
+	fft_sample->freq = ah->curchan->chan->center_freq;
+
+	/* The control channel RSSI belongs to the lower half for HT40+ and
+	 * to the upper half for HT40-.
+	 */
+	if (conf_is_ht40_plus(conf)) {
+		fft_sample->lower_rssi = fix_rssi_inv_only(rs->rs_rssi_ctl0);
+		fft_sample->upper_rssi = fix_rssi_inv_only(rs->rs_rssi_ext0);
+	} else {
+		fft_sample->lower_rssi = fix_rssi_inv_only(rs->rs_rssi_ext0);
+		fft_sample->upper_rssi = fix_rssi_inv_only(rs->rs_rssi_ctl0);
+	}
+	fft_sample->lower_noise = ah->noise;
+	fft_sample->upper_noise = ah->noise;
+
+	/* The DC bin sits between the two halves. */
+	dc_pos = SPECTRAL_HT20_40_NUM_BINS / 2;
+	bins[dc_pos] = (bins[dc_pos + 1] + bins[dc_pos - 1]) / 2;
+
+	radar_info = ((struct ath_radar_info *)&vdata[len]) - 1;
+	mag_info = ((struct ath_ht20_40_mag_info *)radar_info) - 1;
+
+	for (i = 0; i < SPECTRAL_HT20_40_NUM_BINS; i++)
+		fft_sample->data[i] = bins[i] << mag_info->max_exp;
+
+	fft_sample->lower_max_magnitude =
+		spectral_max_magnitude(mag_info->lower_bins);
+	fft_sample->upper_max_magnitude =
+		spectral_max_magnitude(mag_info->upper_bins);
+	fft_sample->lower_max_index = spectral_max_index(mag_info->lower_bins);
+	fft_sample->upper_max_index = spectral_max_index(mag_info->upper_bins);
+	fft_sample->lower_bitmap_weight =
+		spectral_bitmap_weight(mag_info->lower_bins);
+	fft_sample->upper_bitmap_weight =
+		spectral_bitmap_weight(mag_info->upper_bins);
+	fft_sample->tsf = tsf;
+
+	sc->spec_stats.samples++;
+	return 0;
+}
+
+/*
+ * ath_process_fft - forward a spectral scan PHY error to userspace
+ *
+ * Returns 1 if the frame was a spectral sample (whether or not it could
+ * be delivered), 0 if it should be handed on to the other PHY error
+ * consumers.
+ */
+int ath_process_fft(struct ath_softc *sc, struct ieee80211_hdr *hdr,
+		    struct ath_rx_status *rs, u64 tsf)
+{
+	struct ath_radar_info *radar_info;
+	u8 *vdata = (u8 *)hdr;
+	int len = rs->rs_datalen;
+
+	/* AR9280 and before report via ATH9K_PHYERR_RADAR, AR93xx and newer
+	 * via ATH9K_PHYERR_SPECTRAL. Haven't seen ATH9K_PHYERR_FALSE_RADAR_EXT
+	 * yet, but this is supposed to be possible as well.
+	 */
+	if (rs->rs_phyerr != ATH9K_PHYERR_RADAR &&
+	    rs->rs_phyerr != ATH9K_PHYERR_FALSE_RADAR_EXT &&
+	    rs->rs_phyerr != ATH9K_PHYERR_SPECTRAL)
+		return 0;
+
+	if (!sc->rfs_chan_spec_scan || len < sizeof(*radar_info))
+		return 0;
+
+	/* check if spectral scan bit is set. This does not have to be checked
+	 * if received through a SPECTRAL phy error, but shouldn't hurt.
+	 */
+	radar_info = ((struct ath_radar_info *)&vdata[len]) - 1;
+	if (!(radar_info->pulse_bw_info & SPECTRAL_SCAN_BITMASK))
+		return 0;
+
+	if (conf_is_ht40(&sc->hw->conf))
+		ath_fft_send_ht20_40(sc, rs, vdata, len, tsf);
+	else
+		ath_fft_send_ht20(sc, rs, vdata, len, tsf);
+
+	return 1;
+}
+
+void ath9k_spectral_scan_trigger(struct ieee80211_hw *hw)
+{
+	struct ath_softc *sc = hw->priv;
+	struct ath_hw *ah = sc->sc_ah;
+	struct ath_common *common = ath9k_hw_common(ah);
+	u32 rxfilter;
+
+	if (!ath9k_hw_ops(ah)->spectral_scan_trigger) {
+		ath_err(common,
+			"spectrum analyzer not implemented on this hardware\n");
+		return;
+	}
+
+	ath9k_ps_wakeup(sc);
+	rxfilter = ath9k_hw_getrxfilter(ah);
+	ath9k_hw_setrxfilter(ah, rxfilter |
+				 ATH9K_RX_FILTER_PHYRADAR |
+				 ATH9K_RX_FILTER_PHYERR);
+
+	/* TODO: usually this should not be neccesary, but for some reason
+	 * (or in some mode?) the trigger must be called after the
+	 * configuration, otherwise the register will have its values reset
+	 * (on my ar9220 to value 0x01002310)
+	 */
+	ath9k_spectral_scan_config(hw, sc->spectral_mode);
+	ath9k_hw_ops(ah)->spectral_scan_trigger(ah);
+	ath9k_ps_restore(sc);
+}
+
+int ath9k_spectral_scan_config(struct ieee80211_hw *hw,
+			       enum spectral_mode spectral_mode)
+{
+	struct ath_softc *sc = hw->priv;
+	struct ath_hw *ah = sc->sc_ah;
+	struct ath_common *common = ath9k_hw_common(ah);
+	struct ath_spec_scan param;
+
+	if (!ath9k_hw_ops(ah)->spectral_scan_trigger) {
+		ath_err(common,
+			"spectrum analyzer not implemented on this hardware\n");
+		return -1;
+	}
+
+	/* NOTE: this will generate a few samples ... */
+	param = sc->spec_config;
+	param.enabled = 1;
+	param.endless = false;
+	param.fft_period &= 0xF;
+
+	switch (spectral_mode) {
+	case SPECTRAL_DISABLED:
+		param.enabled = 0;
+		break;
+	case SPECTRAL_BACKGROUND:
+		/* send endless samples.
+		 * TODO: is this really useful for "background"?
+		 */
+		param.endless = 1;
+		break;
+	case SPECTRAL_CHANSCAN:
+		break;
+	case SPECTRAL_MANUAL:
+		break;
+	default:
+		return -1;
+	}
+
+	ath9k_ps_wakeup(sc);
+	ath9k_hw_ops(ah)->spectral_scan_config(ah, &param);
+	ath9k_ps_restore(sc);
+
+	sc->spectral_mode = spectral_mode;
+
+	return 0;
+}
+
+/*********************/
+/* spectral_scan_ctl */
+/*********************/
+
+static ssize_t read_file_spec_scan_ctl(struct file *file, char __user *user_buf,
+				       size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	char *mode = "";
+	unsigned int len;
+
+	switch (sc->spectral_mode) {
+	case SPECTRAL_DISABLED:
+		mode = "disable";
+		break;
+	case SPECTRAL_BACKGROUND:
+		mode = "background";
+		break;
+	case SPECTRAL_CHANSCAN:
+		mode = "chanscan";
+		break;
+	case SPECTRAL_MANUAL:
+		mode = "manual";
+		break;
+	}
+	len = strlen(mode);
+	return simple_read_from_buffer(user_buf, count, ppos, mode, len);
+}
+
+static ssize_t write_file_spec_scan_ctl(struct file *file,
+					const char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	struct ath_common *common = ath9k_hw_common(sc->sc_ah);
+	char buf[32];
+	ssize_t len;
+
+	len = min(count, sizeof(buf) - 1);
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+
+	if (strncmp("trigger", buf, 7) == 0) {
+		ath9k_spectral_scan_trigger(sc->hw);
+	} else if (strncmp("background", buf, 9) == 0) {
+		ath9k_spectral_scan_config(sc->hw, SPECTRAL_BACKGROUND);
+		ath_dbg(common, CONFIG,
+			"spectral scan: background mode enabled\n");
+	} else if (strncmp("chanscan", buf, 8) == 0) {
+		ath9k_spectral_scan_config(sc->hw, SPECTRAL_CHANSCAN);
+		ath_dbg(common, CONFIG,
+			"spectral scan: channel scan mode enabled\n");
+	} else if (strncmp("manual", buf, 6) == 0) {
+		ath9k_spectral_scan_config(sc->hw, SPECTRAL_MANUAL);
+		ath_dbg(common, CONFIG, "spectral scan: manual mode enabled\n");
+	} else if (strncmp("disable", buf, 7) == 0) {
+		ath9k_spectral_scan_config(sc->hw, SPECTRAL_DISABLED);
+		ath_dbg(common, CONFIG, "spectral scan: disabled\n");
+	} else {
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static const struct file_operations fops_spec_scan_ctl = {
+	.read = read_file_spec_scan_ctl,
+	.write = write_file_spec_scan_ctl,
+	.open = simple_open,
+	.owner = THIS_MODULE,
+	.llseek = default_llseek,
+};
+
+/*************************/
+/* spectral_short_repeat */
+/*************************/
+
+static ssize_t read_file_spectral_short_repeat(struct file *file,
+					       char __user *user_buf,
+					       size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	char buf[32];
+	unsigned int len;
+
+	len = sprintf(buf, "%d\n", sc->spec_config.short_repeat);
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t write_file_spectral_short_repeat(struct file *file,
+						const char __user *user_buf,
+						size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	unsigned long val;
+	char buf[32];
+	ssize_t len;
+
+	len = min(count, sizeof(buf) - 1);
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+	if (kstrtoul(buf, 0, &val))
+		return -EINVAL;
+
+	if (val > 1)
+		return -EINVAL;
+
+	sc->spec_config.short_repeat = val;
+	return count;
+}
+
+static const struct file_operations fops_spectral_short_repeat = {
+	.read = read_file_spectral_short_repeat,
+	.write = write_file_spectral_short_repeat,
+	.open = simple_open,
+	.owner = THIS_MODULE,
+	.llseek = default_llseek,
+};
+
+/******************/
+/* spectral_stats */
+/******************/
+
+static ssize_t read_file_spectral_stats(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+	struct ath_spec_scan_stats *stats = &sc->spec_stats;
+	char buf[128];
+	unsigned int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"%15s: %10u\n%15s: %10u\n%15s: %10u\n",
+			"samples", stats->samples,
+			"dropped", stats->dropped,
+			"len_discards", stats->len_discards);
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t write_file_spectral_stats(struct file *file,
+					 const char __user *user_buf,
+					 size_t count, loff_t *ppos)
+{
+	struct ath_softc *sc = file->private_data;
+
+	memset(&sc->spec_stats, 0, sizeof(sc->spec_stats));
+	return count;
+}
+
+static const struct file_operations fops_spectral_stats = {
+	.read = read_file_spectral_stats,
+	.write = write_file_spectral_stats,
+	.open = simple_open,
+	.owner = THIS_MODULE,
+	.llseek = default_llseek,
+};
+
+/*******************/
+/* Relay interface */
+/*******************/
+
+static struct dentry *create_buf_file_handler(const char *filename,
+					      struct dentry *parent,
+					      umode_t mode,
+					      struct rchan_buf *buf,
+					      int *is_global)
+{
+	struct dentry *buf_file;
+
+	buf_file = debugfs_create_file(filename, mode, parent, buf,
+				       &relay_file_operations);
+	*is_global = 0;
+	return buf_file;
+}
+
+static int remove_buf_file_handler(struct dentry *dentry)
+{
+	debugfs_remove(dentry);
+
+	return 0;
+}
+
+static struct rchan_callbacks rfs_spec_scan_cb = {
+	.create_buf_file = create_buf_file_handler,
+	.remove_buf_file = remove_buf_file_handler,
+};
+
+/*********************/
+/* Debug Init/Deinit */
+/*********************/
+
+void ath9k_spectral_deinit_debug(struct ath_softc *sc)
+{
+	if (sc->rfs_chan_spec_scan) {
+		relay_close(sc->rfs_chan_spec_scan);
+		sc->rfs_chan_spec_scan = NULL;
+	}
+
+#ifndef CONFIG_ATH9K_DEBUGFS
+	debugfs_remove_recursive(sc->spec_debugfs_dir);
+	sc->spec_debugfs_dir = NULL;
+#endif
+}
+
+void ath9k_spectral_init_debug(struct ath_softc *sc)
+{
+	struct ath_common *common = ath9k_hw_common(sc->sc_ah);
+	struct dentry *dir;
+
+	sc->spec_config.enabled = 0;
+	sc->spec_config.short_repeat = true;
+	sc->spec_config.count = 8;
+	sc->spec_config.endless = false;
+	sc->spec_config.period = 0xFF;
+	sc->spec_config.fft_period = 0xF;
+
+	/* Share the "ath9k" directory with the debug statistics if they
+	 * are built in, so userspace finds the files at the same place.
+	 */
+#ifdef CONFIG_ATH9K_DEBUGFS
+	dir = sc->debug.debugfs_phy;
+#else
+	dir = debugfs_create_dir("ath9k", sc->hw->wiphy->debugfsdir);
+	sc->spec_debugfs_dir = dir;
+#endif
+	if (!dir) {
+		ath_err(common,
+			"Unable to create spectral scan debugfs files\n");
+		return;
+	}
+
+	sc->rfs_chan_spec_scan = relay_open("spectral_scan", dir,
+					    ATH9K_SPECTRAL_SUBBUF_SIZE,
+					    ATH9K_SPECTRAL_NUM_SUBBUFS,
+					    &rfs_spec_scan_cb, NULL);
+	if (!sc->rfs_chan_spec_scan)
+		ath_err(common, "Unable to open spectral scan relay channel\n");
+
+	debugfs_create_file("spectral_scan_ctl", S_IRUSR | S_IWUSR, dir, sc,
+			    &fops_spec_scan_ctl);
+	debugfs_create_file("spectral_short_repeat", S_IRUSR | S_IWUSR, dir,
+			    sc, &fops_spectral_short_repeat);
+	debugfs_create_u8("spectral_count", S_IRUSR | S_IWUSR, dir,
+			  &sc->spec_config.count);
+	debugfs_create_u8("spectral_period", S_IRUSR | S_IWUSR, dir,
+			  &sc->spec_config.period);
+	debugfs_create_u8("spectral_fft_period", S_IRUSR | S_IWUSR, dir,
+			  &sc->spec_config.fft_period);
+	debugfs_create_file("spectral_stats", S_IRUSR | S_IWUSR, dir, sc,
+			    &fops_spectral_stats);
+}
@@ -114,16 +114,19 @@ static bool ath_hw_keysetmac(struct ath_common *common,
 	} else {
 		macLo = macHi = 0;
 	}
-	ENABLE_REGWRITE_BUFFER(ah);
 
 	REG_WRITE(ah, AR_KEYTABLE_MAC0(entry), macLo);
 	REG_WRITE(ah, AR_KEYTABLE_MAC1(entry), macHi | unicast_flag);
 
-	REGWRITE_BUFFER_FLUSH(ah);
-
 	return true;
 }
 
+/*
+ * Register writes are not flushed here, callers wrap one or more key
+ * installs in ENABLE_REGWRITE_BUFFER()/REGWRITE_BUFFER_FLUSH() so that
+ * bus types with write buffering send them in a single burst. Ordering
+ * within the buffer is preserved.
+ */
 static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 				      const struct ath_keyval *k,
 				      const u8 *mac)
@@ -237,8 +240,6 @@ static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 			mic3 = get_unaligned_le16(k->kv_txmic + 0) & 0xffff;
 			mic4 = get_unaligned_le32(k->kv_txmic + 4);
 
-			ENABLE_REGWRITE_BUFFER(ah);
-
 			/* Write RX[31:0] and TX[31:16] */
 			REG_WRITE(ah, AR_KEYTABLE_KEY0(micentry), mic0);
 			REG_WRITE(ah, AR_KEYTABLE_KEY1(micentry), mic1);
@@ -251,9 +252,6 @@ static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 			REG_WRITE(ah, AR_KEYTABLE_KEY4(micentry), mic4);
 			REG_WRITE(ah, AR_KEYTABLE_TYPE(micentry),
 				  AR_KEYTABLE_TYPE_CLR);
-
-			REGWRITE_BUFFER_FLUSH(ah);
-
 		} else {
 			/*
 			 * TKIP uses four key cache entries (two for group
@@ -276,8 +274,6 @@ static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 			mic0 = get_unaligned_le32(k->kv_mic + 0);
 			mic2 = get_unaligned_le32(k->kv_mic + 4);
 
-			ENABLE_REGWRITE_BUFFER(ah);
-
 			/* Write MIC key[31:0] */
 			REG_WRITE(ah, AR_KEYTABLE_KEY0(micentry), mic0);
 			REG_WRITE(ah, AR_KEYTABLE_KEY1(micentry), 0);
@@ -290,12 +286,8 @@ static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 			REG_WRITE(ah, AR_KEYTABLE_KEY4(micentry), 0);
 			REG_WRITE(ah, AR_KEYTABLE_TYPE(micentry),
 				  AR_KEYTABLE_TYPE_CLR);
-
-			REGWRITE_BUFFER_FLUSH(ah);
 		}
 
-		ENABLE_REGWRITE_BUFFER(ah);
-
 		/* MAC address registers are reserved for the MIC entry */
 		REG_WRITE(ah, AR_KEYTABLE_MAC0(micentry), 0);
 		REG_WRITE(ah, AR_KEYTABLE_MAC1(micentry), 0);
@@ -307,11 +299,7 @@ static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 		 */
 		REG_WRITE(ah, AR_KEYTABLE_KEY0(entry), key0);
 		REG_WRITE(ah, AR_KEYTABLE_KEY1(entry), key1);
-
-		REGWRITE_BUFFER_FLUSH(ah);
 	} else {
-		ENABLE_REGWRITE_BUFFER(ah);
-
 		/* Write key[47:0] */
 		REG_WRITE(ah, AR_KEYTABLE_KEY0(entry), key0);
 		REG_WRITE(ah, AR_KEYTABLE_KEY1(entry), key1);
@@ -324,8 +312,6 @@ static bool ath_hw_set_keycache_entry(struct ath_common *common, u16 entry,
 		REG_WRITE(ah, AR_KEYTABLE_KEY4(entry), key4);
 		REG_WRITE(ah, AR_KEYTABLE_TYPE(entry), keyType);
 
-		REGWRITE_BUFFER_FLUSH(ah);
-
 		/* Write MAC address for the entry */
 		(void) ath_hw_keysetmac(common, entry, mac);
 	}
@@ -380,84 +366,104 @@ static int ath_setkey_tkip(struct ath_common *common, u16 keyix, const u8 *key,
 	return ath_hw_set_keycache_entry(common, keyix + 32, hk, addr);
 }
 
+/*
+ * Key cache slots that one TKIP key occupies form a group: entry i and its
+ * MIC entry i + 64, plus i + 32 and i + 64 + 32 without combined MIC
+ * support. keygroup_used marks groups with at least one slot in use,
+ * keygroup_partial the ones that also still have a free slot. Both are
+ * kept in sync with keymap so slot reservation is a bitmap search.
+ */
+static u32 ath_keygroup_span(struct ath_common *common)
+{
+	if (common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED)
+		return 64;
+	return 32;
+}
+
+static u32 ath_keygroup_count(struct ath_common *common)
+{
+	if (common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED)
+		return common->keymax / 2;
+	return common->keymax / 4;
+}
+
+static void ath_keygroup_update(struct ath_common *common, u16 entry)
+{
+	u32 span = ath_keygroup_span(common);
+	u32 members = common->keymax / span;
+	u32 group = entry % span;
+	u32 i, used = 0;
+
+	for (i = 0; i < members; i++)
+		if (test_bit(group + i * span, common->keymap))
+			used++;
+
+	if (used)
+		set_bit(group, common->keygroup_used);
+	else
+		clear_bit(group, common->keygroup_used);
+
+	if (used && used < members)
+		set_bit(group, common->keygroup_partial);
+	else
+		clear_bit(group, common->keygroup_partial);
+}
+
+static void ath_keymap_set(struct ath_common *common, u16 entry)
+{
+	set_bit(entry, common->keymap);
+	ath_keygroup_update(common, entry);
+}
+
+static void ath_keymap_clear(struct ath_common *common, u16 entry)
+{
+	clear_bit(entry, common->keymap);
+	ath_keygroup_update(common, entry);
+}
+
 static int ath_reserve_key_cache_slot_tkip(struct ath_common *common)
 {
-	int i;
-
-	for (i = IEEE80211_WEP_NKID; i < common->keymax / 2; i++) {
-		if (test_bit(i, common->keymap) ||
-		    test_bit(i + 64, common->keymap))
-			continue; /* At least one part of TKIP key allocated */
-		if (!(common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED) &&
-		    (test_bit(i + 32, common->keymap) ||
-		     test_bit(i + 64 + 32, common->keymap)))
-			continue; /* At least one part of TKIP key allocated */
-
-		/* Found a free slot for a TKIP key */
-		return i;
-	}
-	return -1;
+	u32 n = ath_keygroup_count(common);
+	u32 i;
+
+	/* Groups with no slot allocated at all can take a TKIP key */
+	i = find_next_zero_bit(common->keygroup_used, n, IEEE80211_WEP_NKID);
+	if (i >= n)
+		return -1;
+
+	return i;
 }
 
 static int ath_reserve_key_cache_slot(struct ath_common *common,
 				      u32 cipher)
 {
-	int i;
+	u32 span = ath_keygroup_span(common);
+	u32 n = ath_keygroup_count(common);
+	u32 i, entry;
 
 	if (cipher == WLAN_CIPHER_SUITE_TKIP)
 		return ath_reserve_key_cache_slot_tkip(common);
 
 	/* First, try to find slots that would not be available for TKIP. */
-	if (!(common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED)) {
-		for (i = IEEE80211_WEP_NKID; i < common->keymax / 4; i++) {
-			if (!test_bit(i, common->keymap) &&
-			    (test_bit(i + 32, common->keymap) ||
-			     test_bit(i + 64, common->keymap) ||
-			     test_bit(i + 64 + 32, common->keymap)))
-				return i;
-			if (!test_bit(i + 32, common->keymap) &&
-			    (test_bit(i, common->keymap) ||
-			     test_bit(i + 64, common->keymap) ||
-			     test_bit(i + 64 + 32, common->keymap)))
-				return i + 32;
-			if (!test_bit(i + 64, common->keymap) &&
-			    (test_bit(i , common->keymap) ||
-			     test_bit(i + 32, common->keymap) ||
-			     test_bit(i + 64 + 32, common->keymap)))
-				return i + 64;
-			if (!test_bit(i + 64 + 32, common->keymap) &&
-			    (test_bit(i, common->keymap) ||
-			     test_bit(i + 32, common->keymap) ||
-			     test_bit(i + 64, common->keymap)))
-				return i + 64 + 32;
-		}
-	} else {
-		for (i = IEEE80211_WEP_NKID; i < common->keymax / 2; i++) {
-			if (!test_bit(i, common->keymap) &&
-			    test_bit(i + 64, common->keymap))
-				return i;
-			if (test_bit(i, common->keymap) &&
-			    !test_bit(i + 64, common->keymap))
-				return i + 64;
-		}
+	i = find_next_bit(common->keygroup_partial, n, IEEE80211_WEP_NKID);
+	if (i < n) {
+		for (entry = i; entry < common->keymax; entry += span)
+			if (!test_bit(entry, common->keymap))
+				return entry;
 	}
 
 	/* No partially used TKIP slots, pick any available slot */
-	for (i = IEEE80211_WEP_NKID; i < common->keymax; i++) {
+	for (i = find_next_zero_bit(common->keymap, common->keymax,
+				    IEEE80211_WEP_NKID);
+	     i < common->keymax;
+	     i = find_next_zero_bit(common->keymap, common->keymax, i + 1)) {
 		/* Do not allow slots that could be needed for TKIP group keys
 		 * to be used. This limitation could be removed if we know that
 		 * TKIP will not be used. */
-		if (i >= 64 && i < 64 + IEEE80211_WEP_NKID)
+		if (i % span < IEEE80211_WEP_NKID)
 			continue;
-		if (!(common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED)) {
-			if (i >= 32 && i < 32 + IEEE80211_WEP_NKID)
-				continue;
-			if (i >= 64 + 32 && i < 64 + 32 + IEEE80211_WEP_NKID)
-				continue;
-		}
 
-		if (!test_bit(i, common->keymap))
-			return i; /* Found a free slot for a key */
+		return i; /* Found a free slot for a key */
 	}
 
 	/* No free slot found */
@@ -465,12 +471,13 @@ static int ath_reserve_key_cache_slot(struct ath_common *common,
 }
 
 /*
- * Configure encryption in the HW.
+ * Configure encryption in the HW. Register writes end up in the write
+ * buffer enabled by the caller.
  */
-int ath_key_config(struct ath_common *common,
-			  struct ieee80211_vif *vif,
-			  struct ieee80211_sta *sta,
-			  struct ieee80211_key_conf *key)
+static int __ath_key_config(struct ath_common *common,
+			    struct ieee80211_vif *vif,
+			    struct ieee80211_sta *sta,
+			    struct ieee80211_key_conf *key)
 {
 	struct ath_keyval hk;
 	const u8 *mac = NULL;
@@ -555,17 +562,17 @@ int ath_key_config(struct ath_common *common,
 	if (!ret)
 		return -EIO;
 
-	set_bit(idx, common->keymap);
+	ath_keymap_set(common, idx);
 	if (key->cipher == WLAN_CIPHER_SUITE_CCMP)
 		set_bit(idx, common->ccmp_keymap);
 
 	if (key->cipher == WLAN_CIPHER_SUITE_TKIP) {
-		set_bit(idx + 64, common->keymap);
+		ath_keymap_set(common, idx + 64);
 		set_bit(idx, common->tkip_keymap);
 		set_bit(idx + 64, common->tkip_keymap);
 		if (!(common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED)) {
-			set_bit(idx + 32, common->keymap);
-			set_bit(idx + 64 + 32, common->keymap);
+			ath_keymap_set(common, idx + 32);
+			ath_keymap_set(common, idx + 64 + 32);
 			set_bit(idx + 32, common->tkip_keymap);
 			set_bit(idx + 64 + 32, common->tkip_keymap);
 		}
@@ -573,6 +580,21 @@ int ath_key_config(struct ath_common *common,
 
 	return idx;
 }
+
+int ath_key_config(struct ath_common *common,
+			  struct ieee80211_vif *vif,
+			  struct ieee80211_sta *sta,
+			  struct ieee80211_key_conf *key)
+{
+	void *ah = common->ah;
+	int ret;
+
+	ENABLE_REGWRITE_BUFFER(ah);
+	ret = __ath_key_config(common, vif, sta, key);
+	REGWRITE_BUFFER_FLUSH(ah);
+
+	return ret;
+}
 EXPORT_SYMBOL(ath_key_config);
 
 /*
@@ -584,20 +606,20 @@ void ath_key_delete(struct ath_common *common, struct ieee80211_key_conf *key)
 	if (key->hw_key_idx < IEEE80211_WEP_NKID)
 		return;
 
-	clear_bit(key->hw_key_idx, common->keymap);
+	ath_keymap_clear(common, key->hw_key_idx);
 	clear_bit(key->hw_key_idx, common->ccmp_keymap);
 	if (key->cipher != WLAN_CIPHER_SUITE_TKIP)
 		return;
 
-	clear_bit(key->hw_key_idx + 64, common->keymap);
+	ath_keymap_clear(common, key->hw_key_idx + 64);
 
 	clear_bit(key->hw_key_idx, common->tkip_keymap);
 	clear_bit(key->hw_key_idx + 64, common->tkip_keymap);
 
 	if (!(common->crypt_caps & ATH_CRYPT_CAP_MIC_COMBINED)) {
 		ath_hw_keyreset(common, key->hw_key_idx + 32);
-		clear_bit(key->hw_key_idx + 32, common->keymap);
-		clear_bit(key->hw_key_idx + 64 + 32, common->keymap);
+		ath_keymap_clear(common, key->hw_key_idx + 32);
+		ath_keymap_clear(common, key->hw_key_idx + 64 + 32);
 
 		clear_bit(key->hw_key_idx + 32, common->tkip_keymap);
 		clear_bit(key->hw_key_idx + 64 + 32, common->tkip_keymap);
@@ -28,6 +28,7 @@
 #include <linux/debugfs.h>
 #include <linux/module.h>
 #include <linux/ktime.h>
+#include <linux/random.h>
 #include <net/genetlink.h>
 #include "mac80211_hwsim.h"
 
@@ -52,6 +53,10 @@ static bool paged_rx = false;
 module_param(paged_rx, bool, 0644);
 MODULE_PARM_DESC(paged_rx, "Use paged SKBs for RX instead of linear ones");
 
+static bool use_txqs = false;
+module_param(use_txqs, bool, 0444);
+MODULE_PARM_DESC(use_txqs, "Pull data frames from mac80211's TX queues");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -318,6 +323,44 @@ static const struct ieee80211_rate hwsim_rates[] = {
 static spinlock_t hwsim_radio_lock;
 static struct list_head hwsim_radios;
 
+/* MCS rates supported by the simulated radios, two spatial streams */
+#define HWSIM_MODEL_MCS		16
+#define HWSIM_MODEL_MCS_STREAM	8
+/* preamble, SIFS and ACK time added to each modelled attempt, in usecs */
+#define HWSIM_MODEL_OVERHEAD	100
+/* frames in a row at the best rate after which rate control converged */
+#define HWSIM_MODEL_CONVERGED	100
+
+/*
+ * Channel model for the perfect medium: the probability, in percent, that
+ * a transmission attempt succeeds at each rate. It lets rate control
+ * algorithms be compared without radios: the attempts are reported in the
+ * TX status of every unicast data frame and the resulting goodput over the
+ * simulated airtime and the time rate control took to settle on the best
+ * rate of the model are reported in debugfs. A recorded channel trace is
+ * replayed by writing the tables at the recorded times.
+ */
+struct hwsim_tx_model {
+	spinlock_t lock;
+	bool enabled;
+	u8 legacy[ARRAY_SIZE(hwsim_rates)];
+	u8 mcs[HWSIM_MODEL_MCS];
+
+	/* rate with the best expected throughput */
+	int best_idx;
+	bool best_mcs;
+
+	/* when the model was set, and how long rate control took for it */
+	unsigned long start;
+	unsigned int streak;
+	bool converged;
+	unsigned int converged_ms;
+
+	u32 frames, acked, attempts;
+	u64 acked_bytes;
+	u64 airtime;
+};
+
 struct mac80211_hwsim_data {
 	struct list_head list;
 	struct ieee80211_hw *hw;
@@ -350,6 +393,13 @@ struct mac80211_hwsim_data {
 	struct dentry *debugfs_ps;
 
 	struct sk_buff_head pending;	/* packets pending */
+
+	/* serializes pulling frames from mac80211's TX queues */
+	spinlock_t txq_lock;
+
+	/* frames received from other radios, handed to mac80211 in batches */
+	struct sk_buff_head rx_queue;
+	struct tasklet_struct rx_tasklet;
 	/*
 	 * Only radios in the same group can communicate together (the
 	 * channel has to match too). Each bit represents a group. A
@@ -358,6 +408,9 @@ struct mac80211_hwsim_data {
 	u64 group;
 	struct dentry *debugfs_group;
 
+	struct hwsim_tx_model tx_model;
+	struct dentry *debugfs_tx_model;
+
 	int power_level;
 
 	/* difference between this hw's clock and the real clock, in usecs */
@@ -612,7 +665,7 @@ static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
 	if (skb_queue_len(&data->pending) >= MAX_QUEUE) {
 		/* Droping until WARN_QUEUE level */
 		while (skb_queue_len(&data->pending) >= WARN_QUEUE)
-			skb_dequeue(&data->pending);
+			ieee80211_free_txskb(hw, skb_dequeue(&data->pending));
 	}
 
 	skb = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_ATOMIC);
@@ -670,6 +723,8 @@ static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
 	return;
 
 nla_put_failure:
+	nlmsg_free(skb);
+	ieee80211_free_txskb(hw, my_skb);
 	printk(KERN_DEBUG "mac80211_hwsim: error occurred in %s\n", __func__);
 }
 
@@ -702,6 +757,27 @@ static void mac80211_hwsim_tx_iter(void *_data, u8 *addr,
 	data->receive = true;
 }
 
+static void mac80211_hwsim_rx_tasklet(unsigned long arg)
+{
+	struct mac80211_hwsim_data *data = (struct mac80211_hwsim_data *)arg;
+	struct sk_buff_head frames;
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_irq(&data->rx_queue.lock);
+	skb_queue_splice_tail_init(&data->rx_queue, &frames);
+	spin_unlock_irq(&data->rx_queue.lock);
+
+	ieee80211_rx_list(data->hw, &frames);
+}
+
+static void mac80211_hwsim_rx(struct mac80211_hwsim_data *data,
+			      struct sk_buff *skb)
+{
+	skb_queue_tail(&data->rx_queue, skb);
+	tasklet_schedule(&data->rx_tasklet);
+}
+
 static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 					  struct sk_buff *skb,
 					  struct ieee80211_channel *chan)
@@ -834,13 +910,117 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 #endif
 
 		memcpy(IEEE80211_SKB_RXCB(nskb), &rx_status, sizeof(rx_status));
-		ieee80211_rx_irqsafe(data2->hw, nskb);
+		mac80211_hwsim_rx(data2, nskb);
 	}
 	spin_unlock(&hwsim_radio_lock);
 
 	return ack;
 }
 
+/* 20 MHz and 40 MHz single stream MCS bitrates, in 100 kbps */
+static const unsigned int hwsim_mcs_bitrates[2][HWSIM_MODEL_MCS_STREAM] = {
+	{ 65, 130, 195, 260, 390, 520, 585, 650 },
+	{ 135, 270, 405, 540, 810, 1080, 1215, 1350 },
+};
+
+static unsigned int hwsim_mcs_bitrate(int idx, bool ht40)
+{
+	return hwsim_mcs_bitrates[ht40][idx % HWSIM_MODEL_MCS_STREAM] *
+	       (idx / HWSIM_MODEL_MCS_STREAM + 1);
+}
+
+static unsigned int hwsim_model_bitrate(struct ieee80211_supported_band *sband,
+					struct ieee80211_tx_rate *rate)
+{
+	unsigned int bitrate;
+
+	if (!(rate->flags & IEEE80211_TX_RC_MCS))
+		return sband->bitrates[rate->idx].bitrate;
+
+	bitrate = hwsim_mcs_bitrate(rate->idx,
+				    rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH);
+	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
+		bitrate = bitrate * 10 / 9;
+	return bitrate;
+}
+
+/*
+ * Run the attempts of a frame through the channel model. Returns the number
+ * of rates used, copied to used[] with the attempts made at each, and
+ * whether one of them succeeded in *success. Rates the model doesn't know
+ * are skipped, as if the hardware didn't support them.
+ */
+static int hwsim_tx_model_run(struct mac80211_hwsim_data *data,
+			      struct sk_buff *skb,
+			      struct ieee80211_channel *channel,
+			      struct ieee80211_tx_rate *used, bool *success)
+{
+	struct hwsim_tx_model *model = &data->tx_model;
+	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	struct ieee80211_supported_band *sband;
+	struct ieee80211_tx_rate *rate;
+	unsigned int bitrate, prob;
+	int i, n = 0;
+
+	sband = data->hw->wiphy->bands[channel->band];
+	*success = false;
+
+	spin_lock_bh(&model->lock);
+	for (i = 0; i < IEEE80211_TX_MAX_RATES && !*success; i++) {
+		rate = &txi->control.rates[i];
+		if (rate->idx < 0 || !rate->count)
+			break;
+
+		if (rate->flags & IEEE80211_TX_RC_MCS) {
+			if (rate->idx >= HWSIM_MODEL_MCS)
+				continue;
+			prob = model->mcs[rate->idx];
+		} else {
+			if (rate->idx >= sband->n_bitrates)
+				continue;
+			prob = model->legacy[rate->idx];
+		}
+		bitrate = hwsim_model_bitrate(sband, rate);
+
+		used[n] = *rate;
+		for (used[n].count = 0;
+		     used[n].count < rate->count && !*success;
+		     used[n].count++) {
+			model->attempts++;
+			model->airtime += HWSIM_MODEL_OVERHEAD +
+					  skb->len * 80 / bitrate;
+			*success = random32() % 100 < prob;
+		}
+		n++;
+	}
+
+	model->frames++;
+	if (*success) {
+		model->acked++;
+		model->acked_bytes += skb->len;
+	}
+
+	/* probing frames don't tell where rate control settled */
+	rate = &txi->control.rates[0];
+	if (!model->converged &&
+	    !(txi->flags & IEEE80211_TX_CTL_RATE_CTRL_PROBE)) {
+		if (rate->idx == model->best_idx &&
+		    !!(rate->flags & IEEE80211_TX_RC_MCS) == model->best_mcs)
+			model->streak++;
+		else
+			model->streak = 0;
+
+		if (model->streak == HWSIM_MODEL_CONVERGED) {
+			model->converged = true;
+			model->converged_ms =
+				jiffies_to_msecs(jiffies - model->start);
+		}
+	}
+	spin_unlock_bh(&model->lock);
+
+	return n;
+}
+
 static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 			      struct ieee80211_tx_control *control,
 			      struct sk_buff *skb)
@@ -849,12 +1029,14 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
 	struct ieee80211_chanctx_conf *chanctx_conf;
 	struct ieee80211_channel *channel;
-	bool ack;
+	struct ieee80211_tx_rate used[IEEE80211_TX_MAX_RATES];
+	int i, n_rates = 0;
+	bool ack, model;
 	u32 _portid;
 
 	if (WARN_ON(skb->len < 10)) {
 		/* Should not happen; just a sanity check for addr1 use */
-		dev_kfree_skb(skb);
+		ieee80211_free_txskb(hw, skb);
 		return;
 	}
 
@@ -871,13 +1053,13 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 	}
 
 	if (WARN(!channel, "TX w/o channel - queue = %d\n", txi->hw_queue)) {
-		dev_kfree_skb(skb);
+		ieee80211_free_txskb(hw, skb);
 		return;
 	}
 
 	if (data->idle && !data->tmp_chan) {
 		wiphy_debug(hw->wiphy, "Trying to TX when idle - reject\n");
-		dev_kfree_skb(skb);
+		ieee80211_free_txskb(hw, skb);
 		return;
 	}
 
@@ -897,7 +1079,15 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 		return mac80211_hwsim_tx_frame_nl(hw, skb, _portid);
 
 	/* NO wmediumd detected, perfect medium simulation */
-	ack = mac80211_hwsim_tx_frame_no_nl(hw, skb, channel);
+	model = ACCESS_ONCE(data->tx_model.enabled) &&
+		ieee80211_is_data(((struct ieee80211_hdr *)
+				   skb->data)->frame_control) &&
+		!(txi->flags & IEEE80211_TX_CTL_NO_ACK);
+	if (model)
+		n_rates = hwsim_tx_model_run(data, skb, channel, used, &ack);
+
+	if (!model || ack)
+		ack = mac80211_hwsim_tx_frame_no_nl(hw, skb, channel);
 
 	if (ack && skb->len >= 16) {
 		struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
@@ -906,15 +1096,55 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 
 	ieee80211_tx_info_clear_status(txi);
 
-	/* frame was transmitted at most favorable rate at first attempt */
-	txi->control.rates[0].count = 1;
-	txi->control.rates[1].idx = -1;
+	if (model) {
+		for (i = 0; i < n_rates; i++)
+			txi->control.rates[i] = used[i];
+		if (n_rates < IEEE80211_TX_MAX_RATES)
+			txi->control.rates[n_rates].idx = -1;
+
+		/* report each frame as an A-MPDU of its own */
+		if (txi->flags & IEEE80211_TX_CTL_AMPDU) {
+			txi->flags |= IEEE80211_TX_STAT_AMPDU;
+			txi->status.ampdu_len = 1;
+			txi->status.ampdu_ack_len = ack;
+		}
+	} else {
+		/* frame was transmitted at most favorable rate at first attempt */
+		txi->control.rates[0].count = 1;
+		txi->control.rates[1].idx = -1;
+	}
 
 	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
 		txi->flags |= IEEE80211_TX_STAT_ACK;
 	ieee80211_tx_status_irqsafe(hw, skb);
 }
 
+static void mac80211_hwsim_wake_tx_queue(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct ieee80211_tx_control control;
+	struct sk_buff *skb;
+	u8 ac = txq->ac;
+
+	/*
+	 * Frames are transmitted right away, so the whole AC is drained
+	 * here; the lock keeps concurrent callers from reordering frames.
+	 */
+	spin_lock_bh(&data->txq_lock);
+	rcu_read_lock();
+	while ((txq = ieee80211_next_txq(hw, ac))) {
+		skb = ieee80211_tx_dequeue(hw, txq);
+		if (!skb)
+			continue;
+
+		control.sta = txq->sta;
+		mac80211_hwsim_tx(hw, &control, skb);
+	}
+	rcu_read_unlock();
+	spin_unlock_bh(&data->txq_lock);
+}
+
 
 static int mac80211_hwsim_start(struct ieee80211_hw *hw)
 {
@@ -1663,7 +1893,17 @@ static void mac80211_hwsim_free(void)
 		list_move(i, &tmplist);
 	spin_unlock_bh(&hwsim_radio_lock);
 
+	/*
+	 * No radio is on hwsim_radios anymore, so frames can no longer be
+	 * queued to them; drain the RX tasklets before mac80211 goes away.
+	 */
+	list_for_each_entry(data, &tmplist, list) {
+		tasklet_kill(&data->rx_tasklet);
+		skb_queue_purge(&data->rx_queue);
+	}
+
 	list_for_each_entry_safe(data, tmpdata, &tmplist, list) {
+		debugfs_remove(data->debugfs_tx_model);
 		debugfs_remove(data->debugfs_group);
 		debugfs_remove(data->debugfs_ps);
 		debugfs_remove(data->debugfs);
@@ -1839,6 +2079,162 @@ DEFINE_SIMPLE_ATTRIBUTE(hwsim_fops_group,
 			hwsim_fops_group_read, hwsim_fops_group_write,
 			"%llx\n");
 
+static void hwsim_tx_model_print(char **p, const char *name, u8 *prob, int n)
+{
+	int i;
+
+	*p += sprintf(*p, "%s:", name);
+	for (i = 0; i < n; i++)
+		*p += sprintf(*p, " %u", prob[i]);
+	*p += sprintf(*p, "\n");
+}
+
+static ssize_t hwsim_fops_tx_model_read(struct file *file,
+					char __user *user_buf,
+					size_t count, loff_t *ppos)
+{
+	struct mac80211_hwsim_data *data = file->private_data;
+	struct hwsim_tx_model *model = &data->tx_model;
+	char buf[512], *p = buf;
+	u64 goodput = 0;
+
+	spin_lock_bh(&model->lock);
+	p += sprintf(p, "model: %s\n", model->enabled ? "on" : "off");
+	hwsim_tx_model_print(&p, "legacy", model->legacy,
+			     ARRAY_SIZE(model->legacy));
+	hwsim_tx_model_print(&p, "mcs", model->mcs, ARRAY_SIZE(model->mcs));
+	if (model->airtime)
+		goodput = div64_u64(model->acked_bytes * 8000,
+				    model->airtime);
+	p += sprintf(p, "frames: %u acked: %u attempts: %u\n",
+		     model->frames, model->acked, model->attempts);
+	p += sprintf(p, "goodput: %llu kbit/s\n",
+		     (unsigned long long) goodput);
+	p += sprintf(p, "best rate: %s %d\n",
+		     model->best_mcs ? "mcs" : "legacy", model->best_idx);
+	if (model->converged)
+		p += sprintf(p, "converged: %u ms\n", model->converged_ms);
+	else
+		p += sprintf(p, "converged: no\n");
+	spin_unlock_bh(&model->lock);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, p - buf);
+}
+
+/*
+ * Find the rate with the best expected throughput, preferring HT. Legacy
+ * rates are ranked by the 2.4 GHz rate table.
+ */
+static void hwsim_tx_model_best(struct mac80211_hwsim_data *data)
+{
+	struct hwsim_tx_model *model = &data->tx_model;
+	unsigned int tp, best_tp = 0;
+	int i;
+
+	model->best_idx = 0;
+	model->best_mcs = false;
+	for (i = 0; i < ARRAY_SIZE(model->mcs); i++) {
+		tp = model->mcs[i] * hwsim_mcs_bitrate(i, false);
+		if (tp > best_tp) {
+			best_tp = tp;
+			model->best_idx = i;
+			model->best_mcs = true;
+		}
+	}
+	if (model->best_mcs)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(model->legacy); i++) {
+		tp = model->legacy[i] * data->rates[i].bitrate;
+		if (tp > best_tp) {
+			best_tp = tp;
+			model->best_idx = i;
+		}
+	}
+}
+
+/*
+ * Commands, one per write:
+ *   legacy <percent> ...	success probability of the legacy rates
+ *   mcs <percent> ...		success probability of MCS 0, 1, ...
+ *   reset			clear the results
+ *   off			back to the perfect medium
+ * Rates left out of a table never succeed. Setting a table enables the
+ * model and restarts the results and the convergence time.
+ */
+static ssize_t hwsim_fops_tx_model_write(struct file *file,
+					 const char __user *user_buf,
+					 size_t count, loff_t *ppos)
+{
+	struct mac80211_hwsim_data *data = file->private_data;
+	struct hwsim_tx_model *model = &data->tx_model;
+	u8 prob[HWSIM_MODEL_MCS];
+	char buf[256], *p, *cmd, *tok;
+	size_t len = min(count, sizeof(buf) - 1);
+	int n = 0, ret;
+	u8 *table = NULL;
+
+	BUILD_BUG_ON(ARRAY_SIZE(model->legacy) > ARRAY_SIZE(prob));
+
+	if (copy_from_user(buf, user_buf, len))
+		return -EFAULT;
+	buf[len] = '\0';
+	p = strim(buf);
+
+	cmd = strsep(&p, " ");
+	if (!strcmp(cmd, "legacy")) {
+		table = model->legacy;
+		n = ARRAY_SIZE(model->legacy);
+	} else if (!strcmp(cmd, "mcs")) {
+		table = model->mcs;
+		n = ARRAY_SIZE(model->mcs);
+	} else if (strcmp(cmd, "reset") && strcmp(cmd, "off")) {
+		return -EINVAL;
+	}
+
+	memset(prob, 0, sizeof(prob));
+	if (table) {
+		int i = 0;
+
+		while ((tok = strsep(&p, " ")) != NULL) {
+			if (!*tok)
+				continue;
+			if (i == n)
+				return -EINVAL;
+			ret = kstrtou8(tok, 0, &prob[i]);
+			if (ret)
+				return ret;
+			if (prob[i] > 100)
+				return -EINVAL;
+			i++;
+		}
+	}
+
+	spin_lock_bh(&model->lock);
+	if (table) {
+		memcpy(table, prob, n);
+		model->enabled = true;
+		hwsim_tx_model_best(data);
+	} else if (!strcmp(cmd, "off")) {
+		model->enabled = false;
+	}
+	model->frames = model->acked = model->attempts = 0;
+	model->acked_bytes = model->airtime = 0;
+	model->start = jiffies;
+	model->streak = 0;
+	model->converged = false;
+	spin_unlock_bh(&model->lock);
+
+	return count;
+}
+
+static const struct file_operations hwsim_fops_tx_model = {
+	.open = simple_open,
+	.read = hwsim_fops_tx_model_read,
+	.write = hwsim_fops_tx_model_write,
+	.llseek = default_llseek,
+};
+
 static struct mac80211_hwsim_data *get_hwsim_data_ref_from_addr(
 			     struct mac_address *addr)
 {
@@ -1995,7 +2391,7 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 	rx_status.signal = nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]);
 
 	memcpy(IEEE80211_SKB_RXCB(skb), &rx_status, sizeof(rx_status));
-	ieee80211_rx_irqsafe(data2->hw, skb);
+	mac80211_hwsim_rx(data2, skb);
 
 	return 0;
 err:
@@ -2142,6 +2538,9 @@ static int __init init_mac80211_hwsim(void)
 	if (channels < 1)
 		return -EINVAL;
 
+	if (use_txqs)
+		mac80211_hwsim_ops.wake_tx_queue = mac80211_hwsim_wake_tx_queue;
+
 	if (channels > 1) {
 		hwsim_if_comb.num_different_channels = channels;
 		mac80211_hwsim_ops.hw_scan = mac80211_hwsim_hw_scan;
@@ -2199,6 +2598,11 @@ static int __init init_mac80211_hwsim(void)
 		}
 		data->dev->driver = &mac80211_hwsim_driver;
 		skb_queue_head_init(&data->pending);
+		spin_lock_init(&data->txq_lock);
+		spin_lock_init(&data->tx_model.lock);
+		skb_queue_head_init(&data->rx_queue);
+		tasklet_init(&data->rx_tasklet, mac80211_hwsim_rx_tasklet,
+			     (unsigned long)data);
 
 		SET_IEEE80211_DEV(hw, data->dev);
 		addr[3] = i >> 8;
@@ -2239,7 +2643,9 @@ static int __init init_mac80211_hwsim(void)
 			    IEEE80211_HW_SUPPORTS_DYNAMIC_SMPS |
 			    IEEE80211_HW_AMPDU_AGGREGATION |
 			    IEEE80211_HW_WANT_MONITOR_VIF |
-			    IEEE80211_HW_QUEUE_CONTROL;
+			    IEEE80211_HW_QUEUE_CONTROL |
+			    IEEE80211_HW_REPORTS_ALL_TX_STATUS |
+			    IEEE80211_HW_SUPPORTS_CLONED_SKBS;
 
 		hw->wiphy->flags |= WIPHY_FLAG_SUPPORTS_TDLS |
 				    WIPHY_FLAG_HAS_REMAIN_ON_CHANNEL;
@@ -2451,6 +2857,9 @@ static int __init init_mac80211_hwsim(void)
 		data->debugfs_group = debugfs_create_file("group", 0666,
 							data->debugfs, data,
 							&hwsim_fops_group);
+		data->debugfs_tx_model = debugfs_create_file("tx_model", 0666,
+							data->debugfs, data,
+							&hwsim_fops_tx_model);
 
 		tasklet_hrtimer_init(&data->beacon_timer,
 				     mac80211_hwsim_beacon,
@@ -392,6 +392,9 @@ struct ieee80211_bss_conf {
  * @IEEE80211_TX_CTL_RATE_CTRL_PROBE: internal to mac80211, can be
  *	set by rate control algorithms to indicate probe rate, will
  *	be cleared for fragmented frames (except on the last fragment)
+ * @IEEE80211_TX_INTFL_FAST_XMIT: completely internal to mac80211, the
+ *	frame was built by the TX fast path and only needs its sequence
+ *	number assigned when it leaves its intermediate TX queue
  * @IEEE80211_TX_INTFL_NEED_TXPROCESSING: completely internal to mac80211,
  *	used to indicate that a pending frame requires TX processing before
  *	it can be sent out.
@@ -409,6 +412,9 @@ struct ieee80211_bss_conf {
  * @IEEE80211_TX_INTFL_RETRANSMISSION: This frame is being retransmitted
  *	after TX status because the destination was asleep, it must not
  *	be modified again (no seqno assignment, crypto, etc.)
+ * @IEEE80211_TX_INTFL_LIMIT_QUEUED: completely internal to mac80211,
+ *	the frame's length was accounted against the byte limit of its
+ *	hardware queue and must be released when it is completed
  * @IEEE80211_TX_INTFL_NL80211_FRAME_TX: Frame was requested through nl80211
  *	MLME command (internal to mac80211 to figure out whether to send TX
  *	status to user space)
@@ -454,13 +460,14 @@ enum mac80211_tx_control_flags {
 	IEEE80211_TX_STAT_AMPDU			= BIT(10),
 	IEEE80211_TX_STAT_AMPDU_NO_BACK		= BIT(11),
 	IEEE80211_TX_CTL_RATE_CTRL_PROBE	= BIT(12),
+	IEEE80211_TX_INTFL_FAST_XMIT		= BIT(13),
 	IEEE80211_TX_INTFL_NEED_TXPROCESSING	= BIT(14),
 	IEEE80211_TX_INTFL_RETRIED		= BIT(15),
 	IEEE80211_TX_INTFL_DONT_ENCRYPT		= BIT(16),
 	IEEE80211_TX_CTL_NO_PS_BUFFER		= BIT(17),
 	IEEE80211_TX_CTL_MORE_FRAMES		= BIT(18),
 	IEEE80211_TX_INTFL_RETRANSMISSION	= BIT(19),
-	/* hole at 20, use later */
+	IEEE80211_TX_INTFL_LIMIT_QUEUED		= BIT(20),
 	IEEE80211_TX_INTFL_NL80211_FRAME_TX	= BIT(21),
 	IEEE80211_TX_CTL_LDPC			= BIT(22),
 	IEEE80211_TX_CTL_STBC			= BIT(23) | BIT(24),
@@ -640,7 +647,9 @@ struct ieee80211_tx_info {
 			/* NB: vif can be NULL for injected frames */
 			struct ieee80211_vif *vif;
 			struct ieee80211_key_conf *hw_key;
-			/* 8 bytes free */
+			/* only used while on an intermediate TX queue */
+			u32 enqueue_time;
+			/* 4 bytes free */
 		} control;
 		struct {
 			struct ieee80211_tx_rate rates[IEEE80211_TX_MAX_RATES];
@@ -1042,6 +1051,8 @@ enum ieee80211_vif_flags {
  *	path needing to access it; even though the netdev carrier will always
  *	be off when it is %NULL there can still be races and packets could be
  *	processed after it switches back to %NULL.
+ * @txq: the multicast data TX queue (if the driver uses the TXQ abstraction,
+ *	see &struct ieee80211_txq)
  * @drv_priv: data area for driver use, will always be aligned to
  *	sizeof(void *).
  */
@@ -1058,6 +1069,8 @@ struct ieee80211_vif {
 
 	u32 driver_flags;
 
+	struct ieee80211_txq *txq;
+
 	/* must be last */
 	u8 drv_priv[0] __aligned(sizeof(void *));
 };
@@ -1197,6 +1210,8 @@ enum ieee80211_sta_state {
  * @uapsd_queues: bitmap of queues configured for uapsd. Only valid
  *	if wme is supported.
  * @max_sp: max Service Period. Only valid if wme is supported.
+ * @txq: per-TID data TX queues (if the driver uses the TXQ abstraction,
+ *	see &struct ieee80211_txq)
  */
 struct ieee80211_sta {
 	u32 supp_rates[IEEE80211_NUM_BANDS];
@@ -1208,6 +1223,38 @@ struct ieee80211_sta {
 	u8 uapsd_queues;
 	u8 max_sp;
 
+	struct ieee80211_txq *txq[IEEE80211_NUM_TIDS];
+
+	/* must be last */
+	u8 drv_priv[0] __aligned(sizeof(void *));
+};
+
+/**
+ * struct ieee80211_txq - software intermediate TX queue
+ *
+ * Drivers that implement the wake_tx_queue() callback don't get data
+ * frames through tx(); mac80211 queues them per station and TID (and
+ * per interface for frames without a station) and lets the driver pull
+ * them with ieee80211_tx_dequeue() when it has room for them. Queueing
+ * delay on these queues is controlled by CoDel, and ieee80211_next_txq()
+ * shares the airtime of an AC between the queues with deficit round
+ * robin.
+ *
+ * @vif: &struct ieee80211_vif pointer from the add_interface callback.
+ * @sta: station table entry, %NULL for the per-vif queue
+ * @tid: the TID for this queue (unused for per-vif queue)
+ * @ac: the AC for this queue
+ * @drv_priv: driver private area, sized by hw->txq_data_size
+ *
+ * The queues of a station go away with the station, so drivers may only
+ * use a queue pointer under the same rules as the &struct ieee80211_sta.
+ */
+struct ieee80211_txq {
+	struct ieee80211_vif *vif;
+	struct ieee80211_sta *sta;
+	u8 tid;
+	u8 ac;
+
 	/* must be last */
 	u8 drv_priv[0] __aligned(sizeof(void *));
 };
@@ -1373,6 +1420,19 @@ struct ieee80211_tx_control {
  * @IEEE80211_HW_TEARDOWN_AGGR_ON_BAR_FAIL: On this hardware TX BA session
  *	should be tear down once BAR frame will not be acked.
  *
+ * @IEEE80211_HW_REPORTS_ALL_TX_STATUS: The driver hands every frame it got
+ *	from the tx() callback back to mac80211, via ieee80211_tx_status()
+ *	(or one of its variants) or ieee80211_free_txskb(), with its length
+ *	unchanged, and doesn't hold frames back indefinitely (e.g. for
+ *	stations in powersave). mac80211 then limits the amount of data
+ *	queued in each hardware queue, see "Byte queue limits" in util.c.
+ *
+ * @IEEE80211_HW_SUPPORTS_CLONED_SKBS: The driver only modifies the 802.11
+ *	header (and headroom) of frames passed to the tx() callback, never
+ *	their payload. Frames cloned by the network stack, e.g. TCP
+ *	segments, can then be transmitted without copying them, unless
+ *	they need to be encrypted in software.
+ *
  */
 enum ieee80211_hw_flags {
 	IEEE80211_HW_HAS_RATE_CONTROL			= 1<<0,
@@ -1402,6 +1462,8 @@ enum ieee80211_hw_flags {
 	IEEE80211_HW_SCAN_WHILE_IDLE			= 1<<24,
 	IEEE80211_HW_P2P_DEV_ADDR_FOR_INTF		= 1<<25,
 	IEEE80211_HW_TEARDOWN_AGGR_ON_BAR_FAIL		= 1<<26,
+	IEEE80211_HW_REPORTS_ALL_TX_STATUS		= 1<<27,
+	IEEE80211_HW_SUPPORTS_CLONED_SKBS		= 1<<28,
 };
 
 /**
@@ -1448,6 +1510,8 @@ enum ieee80211_hw_flags {
  *	within &struct ieee80211_sta.
  * @chanctx_data_size: size (in bytes) of the drv_priv data area
  *	within &struct ieee80211_chanctx_conf.
+ * @txq_data_size: size (in bytes) of the drv_priv data area
+ *	within &struct ieee80211_txq.
  *
  * @max_rates: maximum number of alternate rate retry stages the hw
  *	can handle.
@@ -1497,6 +1561,7 @@ struct ieee80211_hw {
 	int vif_data_size;
 	int sta_data_size;
 	int chanctx_data_size;
+	int txq_data_size;
 	int napi_weight;
 	u16 queues;
 	u16 max_listen_interval;
@@ -2492,6 +2557,10 @@ enum ieee80211_rate_control_changed {
  *	driver's resume function returned 1, as this is just like an "inline"
  *	hardware restart. This callback may sleep.
  *
+ * @wake_tx_queue: Called when new frames were added to a TX queue, see
+ *	&struct ieee80211_txq. Implementing this makes mac80211 hand data
+ *	frames to the driver through the queues rather than through @tx.
+ *	Must be atomic.
  */
 struct ieee80211_ops {
 	void (*tx)(struct ieee80211_hw *hw,
@@ -2669,6 +2738,9 @@ struct ieee80211_ops {
 				     struct ieee80211_chanctx_conf *ctx);
 
 	void (*restart_complete)(struct ieee80211_hw *hw);
+
+	void (*wake_tx_queue)(struct ieee80211_hw *hw,
+			      struct ieee80211_txq *txq);
 };
 
 /**
@@ -2916,6 +2988,24 @@ void ieee80211_napi_complete(struct ieee80211_hw *hw);
  */
 void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb);
 
+/**
+ * ieee80211_rx_list - receive a list of frames
+ *
+ * Like ieee80211_rx() but hands a batch of frames to mac80211 at once,
+ * e.g. all subframes of an A-MPDU. The checks that don't depend on the
+ * frame, the RCU read-side section and the station lookup for runs of
+ * data frames from the same transmitter are shared across the batch.
+ *
+ * The same context and synchronization requirements as for ieee80211_rx()
+ * apply. Calls to this function and ieee80211_rx() may be mixed, but not
+ * with ieee80211_rx_ni() or ieee80211_rx_irqsafe().
+ *
+ * @hw: the hardware the frames came in on
+ * @list: the frames to receive, in order; all of them are owned by
+ *	mac80211 after this call and the list is left empty
+ */
+void ieee80211_rx_list(struct ieee80211_hw *hw, struct sk_buff_head *list);
+
 /**
  * ieee80211_rx_irqsafe - receive frame
  *
@@ -3324,6 +3414,37 @@ __le16 ieee80211_generic_frame_duration(struct ieee80211_hw *hw,
 struct sk_buff *
 ieee80211_get_buffered_bc(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
 
+/**
+ * ieee80211_tx_dequeue - dequeue a frame from a software TX queue
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @txq: pointer obtained from station or virtual interface, or from
+ *	ieee80211_next_txq()
+ *
+ * Frames that waited on the queue for too long are dropped here as
+ * CoDel decides, so the driver should pull frames only once it is
+ * about to hand them to the hardware. Sequence number, key and PN of
+ * a frame are only assigned here, so calls for the same queue must be
+ * serialized by the driver.
+ *
+ * Return: The next frame to transmit, or %NULL if the queue is empty.
+ */
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+				     struct ieee80211_txq *txq);
+
+/**
+ * ieee80211_next_txq - get the next software TX queue to serve
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @ac: the AC to schedule
+ *
+ * Picks the queue that should transmit next among the non-empty queues
+ * of the given AC, using deficit round robin over the bytes dequeued
+ * with ieee80211_tx_dequeue(). Drivers should call this again before
+ * every frame they dequeue to keep the schedule fair.
+ *
+ * Return: A non-empty queue, or %NULL if all queues of @ac are empty.
+ */
+struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac);
+
 /**
  * ieee80211_get_tkip_p1k_iv - get a TKIP phase 1 key for IV32
  *
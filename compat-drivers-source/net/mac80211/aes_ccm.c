@@ -11,33 +11,31 @@
 #include <linux/types.h>
 #include <linux/crypto.h>
 #include <linux/err.h>
+#include <asm/unaligned.h>
 #include <crypto/aes.h>
+#include <crypto/aead.h>
+#include <crypto/algapi.h>
 
 #include <net/mac80211.h>
 #include "key.h"
 #include "aes_ccm.h"
 
-static void aes_ccm_prepare(struct crypto_cipher *tfm, u8 *scratch, u8 *a)
+/*
+ * Fallback CCM on top of the AES block cipher, for kernels without a
+ * synchronous ccm(aes) transform. It works on linear data only.
+ */
+static void aes_ccm_prepare(struct crypto_cipher *tfm, u8 *b_0, u8 *aad,
+			    u8 *s_0, u8 *a)
 {
-	int i;
-	u8 *b_0, *aad, *b, *s_0;
-
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
-	aad = scratch + 4 * AES_BLOCK_SIZE;
-	b = scratch;
-	s_0 = scratch + AES_BLOCK_SIZE;
-
-	crypto_cipher_encrypt_one(tfm, b, b_0);
+	crypto_cipher_encrypt_one(tfm, a, b_0);
 
 	/* Extra Authenticate-only data (always two AES blocks) */
-	for (i = 0; i < AES_BLOCK_SIZE; i++)
-		aad[i] ^= b[i];
-	crypto_cipher_encrypt_one(tfm, b, aad);
+	crypto_xor(aad, a, AES_BLOCK_SIZE);
+	crypto_cipher_encrypt_one(tfm, a, aad);
 
 	aad += AES_BLOCK_SIZE;
 
-	for (i = 0; i < AES_BLOCK_SIZE; i++)
-		aad[i] ^= b[i];
+	crypto_xor(aad, a, AES_BLOCK_SIZE);
 	crypto_cipher_encrypt_one(tfm, a, aad);
 
 	/* Mask out bits from auth-only-b_0 */
@@ -50,64 +48,50 @@ static void aes_ccm_prepare(struct crypto_cipher *tfm, u8 *scratch, u8 *a)
 }
 
 
-void ieee80211_aes_ccm_encrypt(struct crypto_cipher *tfm, u8 *scratch,
-			       u8 *data, size_t data_len,
-			       u8 *cdata, u8 *mic)
+static void aes_ccm_cipher_encrypt(struct crypto_cipher *tfm, u8 *b_0,
+				   u8 *aad, u8 *data, size_t data_len,
+				   u8 *mic)
 {
-	int i, j, last_len, num_blocks;
-	u8 *pos, *cpos, *b, *s_0, *e, *b_0;
-
-	b = scratch;
-	s_0 = scratch + AES_BLOCK_SIZE;
-	e = scratch + 2 * AES_BLOCK_SIZE;
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
+	u8 b[AES_BLOCK_SIZE], s_0[AES_BLOCK_SIZE], e[AES_BLOCK_SIZE];
+	int j, last_len, num_blocks;
 
 	num_blocks = DIV_ROUND_UP(data_len, AES_BLOCK_SIZE);
 	last_len = data_len % AES_BLOCK_SIZE;
-	aes_ccm_prepare(tfm, scratch, b);
+	aes_ccm_prepare(tfm, b_0, aad, s_0, b);
 
 	/* Process payload blocks */
-	pos = data;
-	cpos = cdata;
 	for (j = 1; j <= num_blocks; j++) {
 		int blen = (j == num_blocks && last_len) ?
 			last_len : AES_BLOCK_SIZE;
 
 		/* Authentication followed by encryption */
-		for (i = 0; i < blen; i++)
-			b[i] ^= pos[i];
+		crypto_xor(b, data, blen);
 		crypto_cipher_encrypt_one(tfm, b, b);
 
 		b_0[14] = (j >> 8) & 0xff;
 		b_0[15] = j & 0xff;
 		crypto_cipher_encrypt_one(tfm, e, b_0);
-		for (i = 0; i < blen; i++)
-			*cpos++ = *pos++ ^ e[i];
+		crypto_xor(data, e, blen);
+		data += blen;
 	}
 
-	for (i = 0; i < CCMP_MIC_LEN; i++)
-		mic[i] = b[i] ^ s_0[i];
+	memcpy(mic, b, CCMP_MIC_LEN);
+	crypto_xor(mic, s_0, CCMP_MIC_LEN);
 }
 
 
-int ieee80211_aes_ccm_decrypt(struct crypto_cipher *tfm, u8 *scratch,
-			      u8 *cdata, size_t data_len, u8 *mic, u8 *data)
+static int aes_ccm_cipher_decrypt(struct crypto_cipher *tfm, u8 *b_0,
+				  u8 *aad, u8 *data, size_t data_len,
+				  u8 *mic)
 {
-	int i, j, last_len, num_blocks;
-	u8 *pos, *cpos, *b, *s_0, *a, *b_0;
-
-	b = scratch;
-	s_0 = scratch + AES_BLOCK_SIZE;
-	a = scratch + 2 * AES_BLOCK_SIZE;
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
+	u8 a[AES_BLOCK_SIZE], b[AES_BLOCK_SIZE], s_0[AES_BLOCK_SIZE];
+	int j, last_len, num_blocks;
 
 	num_blocks = DIV_ROUND_UP(data_len, AES_BLOCK_SIZE);
 	last_len = data_len % AES_BLOCK_SIZE;
-	aes_ccm_prepare(tfm, scratch, a);
+	aes_ccm_prepare(tfm, b_0, aad, s_0, a);
 
 	/* Process payload blocks */
-	cpos = cdata;
-	pos = data;
 	for (j = 1; j <= num_blocks; j++) {
 		int blen = (j == num_blocks && last_len) ?
 			last_len : AES_BLOCK_SIZE;
@@ -116,35 +100,141 @@ int ieee80211_aes_ccm_decrypt(struct crypto_cipher *tfm, u8 *scratch,
 		b_0[14] = (j >> 8) & 0xff;
 		b_0[15] = j & 0xff;
 		crypto_cipher_encrypt_one(tfm, b, b_0);
-		for (i = 0; i < blen; i++) {
-			*pos = *cpos++ ^ b[i];
-			a[i] ^= *pos++;
-		}
+		crypto_xor(data, b, blen);
+		crypto_xor(a, data, blen);
 		crypto_cipher_encrypt_one(tfm, a, a);
+		data += blen;
 	}
 
-	for (i = 0; i < CCMP_MIC_LEN; i++) {
-		if ((mic[i] ^ s_0[i]) != a[i])
-			return -1;
-	}
+	crypto_xor(s_0, mic, CCMP_MIC_LEN);
+	if (memcmp(s_0, a, CCMP_MIC_LEN))
+		return -EBADMSG;
 
 	return 0;
 }
 
 
-struct crypto_cipher *ieee80211_aes_key_setup_encrypt(const u8 key[])
+/*
+ * The AEAD transform formats the CCM blocks itself. Out of b_0 it only
+ * takes the nonce, with the flags byte set to L' = L - 1 = 1, and the AAD
+ * length prefix is passed as the associated data length.
+ */
+static int aes_ccm_aead_crypt(struct crypto_aead *tfm, u8 *b_0, u8 *aad,
+			      struct scatterlist *src,
+			      struct scatterlist *dst,
+			      unsigned int len, bool encrypt)
+{
+	char aead_req_data[sizeof(struct aead_request) +
+			   crypto_aead_reqsize(tfm)]
+		__aligned(__alignof__(struct aead_request));
+	struct aead_request *aead_req = (void *) aead_req_data;
+	struct scatterlist assoc;
+	u8 iv[AES_BLOCK_SIZE];
+
+	memcpy(iv, b_0, AES_BLOCK_SIZE);
+	iv[0] = 1;
+
+	memset(aead_req, 0, sizeof(aead_req_data));
+	sg_init_one(&assoc, &aad[2], get_unaligned_be16(aad));
+
+	aead_request_set_tfm(aead_req, tfm);
+	aead_request_set_assoc(aead_req, &assoc, assoc.length);
+	aead_request_set_crypt(aead_req, src, dst, len, iv);
+
+	if (encrypt)
+		return crypto_aead_encrypt(aead_req);
+	return crypto_aead_decrypt(aead_req);
+}
+
+
+void ieee80211_aes_ccm_encrypt(struct ieee80211_ccm_tfm *tfm, u8 *b_0,
+			       u8 *aad, u8 *data, size_t data_len, u8 *mic)
 {
-	struct crypto_cipher *tfm;
+	struct scatterlist pt, ct[2];
+
+	if (!tfm->aead) {
+		aes_ccm_cipher_encrypt(tfm->cipher, b_0, aad,
+				       data, data_len, mic);
+		return;
+	}
+
+	sg_init_one(&pt, data, data_len);
+	sg_init_table(ct, 2);
+	sg_set_buf(&ct[0], data, data_len);
+	sg_set_buf(&ct[1], mic, CCMP_MIC_LEN);
 
-	tfm = crypto_alloc_cipher("aes", 0, CRYPTO_ALG_ASYNC);
-	if (!IS_ERR(tfm))
-		crypto_cipher_setkey(tfm, key, ALG_CCMP_KEY_LEN);
+	aes_ccm_aead_crypt(tfm->aead, b_0, aad, &pt, ct, data_len, true);
+}
 
-	return tfm;
+
+int ieee80211_aes_ccm_decrypt(struct ieee80211_ccm_tfm *tfm, u8 *b_0,
+			      u8 *aad, u8 *data, size_t data_len, u8 *mic)
+{
+	struct scatterlist pt, ct[2];
+
+	if (!tfm->aead)
+		return aes_ccm_cipher_decrypt(tfm->cipher, b_0, aad,
+					      data, data_len, mic);
+
+	sg_init_one(&pt, data, data_len);
+	sg_init_table(ct, 2);
+	sg_set_buf(&ct[0], data, data_len);
+	sg_set_buf(&ct[1], mic, CCMP_MIC_LEN);
+
+	return aes_ccm_aead_crypt(tfm->aead, b_0, aad, ct, &pt,
+				  data_len + CCMP_MIC_LEN, false);
+}
+
+
+/*
+ * Decrypt in place data that may be spread over several buffers, the
+ * MIC follows the data in @sg. Only possible with the AEAD transform.
+ */
+int ieee80211_aes_ccm_decrypt_sg(struct ieee80211_ccm_tfm *tfm, u8 *b_0,
+				 u8 *aad, struct scatterlist *sg,
+				 size_t data_len)
+{
+	if (WARN_ON(!tfm->aead))
+		return -EINVAL;
+
+	return aes_ccm_aead_crypt(tfm->aead, b_0, aad, sg, sg,
+				  data_len + CCMP_MIC_LEN, false);
+}
+
+
+int ieee80211_aes_key_setup_encrypt(struct ieee80211_ccm_tfm *tfm,
+				    const u8 key[])
+{
+	int err;
+
+	tfm->cipher = NULL;
+	tfm->aead = crypto_alloc_aead("ccm(aes)", 0, CRYPTO_ALG_ASYNC);
+	if (!IS_ERR(tfm->aead)) {
+		err = crypto_aead_setkey(tfm->aead, key, ALG_CCMP_KEY_LEN);
+		if (!err)
+			err = crypto_aead_setauthsize(tfm->aead, CCMP_MIC_LEN);
+		if (!err)
+			return 0;
+		crypto_free_aead(tfm->aead);
+	}
+	tfm->aead = NULL;
+
+	tfm->cipher = crypto_alloc_cipher("aes", 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(tfm->cipher)) {
+		err = PTR_ERR(tfm->cipher);
+		tfm->cipher = NULL;
+		return err;
+	}
+
+	crypto_cipher_setkey(tfm->cipher, key, ALG_CCMP_KEY_LEN);
+	return 0;
 }
 
 
-void ieee80211_aes_key_free(struct crypto_cipher *tfm)
+void ieee80211_aes_key_free(struct ieee80211_ccm_tfm *tfm)
 {
-	crypto_free_cipher(tfm);
+	if (tfm->aead)
+		crypto_free_aead(tfm->aead);
+	if (tfm->cipher)
+		crypto_free_cipher(tfm->cipher);
 }
@@ -11,14 +11,28 @@
 #define AES_CCM_H
 
 #include <linux/crypto.h>
+#include <linux/scatterlist.h>
 
-struct crypto_cipher *ieee80211_aes_key_setup_encrypt(const u8 key[]);
-void ieee80211_aes_ccm_encrypt(struct crypto_cipher *tfm, u8 *scratch,
-			       u8 *data, size_t data_len,
-			       u8 *cdata, u8 *mic);
-int ieee80211_aes_ccm_decrypt(struct crypto_cipher *tfm, u8 *scratch,
-			      u8 *cdata, size_t data_len,
-			      u8 *mic, u8 *data);
-void ieee80211_aes_key_free(struct crypto_cipher *tfm);
+/*
+ * CCMP uses the ccm(aes) AEAD transform if the kernel provides one, so
+ * optimized AES implementations and non-linear frames can be used. If it
+ * doesn't, CCM is done on top of the plain AES cipher; only one of the
+ * two transforms is allocated.
+ */
+struct ieee80211_ccm_tfm {
+	struct crypto_aead *aead;
+	struct crypto_cipher *cipher;
+};
+
+int ieee80211_aes_key_setup_encrypt(struct ieee80211_ccm_tfm *tfm,
+				    const u8 key[]);
+void ieee80211_aes_ccm_encrypt(struct ieee80211_ccm_tfm *tfm, u8 *b_0,
+			       u8 *aad, u8 *data, size_t data_len, u8 *mic);
+int ieee80211_aes_ccm_decrypt(struct ieee80211_ccm_tfm *tfm, u8 *b_0,
+			      u8 *aad, u8 *data, size_t data_len, u8 *mic);
+int ieee80211_aes_ccm_decrypt_sg(struct ieee80211_ccm_tfm *tfm, u8 *b_0,
+				 u8 *aad, struct scatterlist *sg,
+				 size_t data_len);
+void ieee80211_aes_key_free(struct ieee80211_ccm_tfm *tfm);
 
 #endif /* AES_CCM_H */
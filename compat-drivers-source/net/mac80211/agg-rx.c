@@ -51,7 +51,7 @@ static void ieee80211_free_tid_rx(struct rcu_head *h)
 
 	del_timer_sync(&tid_rx->reorder_timer);
 
-	for (i = 0; i < tid_rx->buf_size; i++)
+	for_each_set_bit(i, tid_rx->reorder_bitmap, tid_rx->buf_size)
 		dev_kfree_skb(tid_rx->reorder_buf[i]);
 	kfree(tid_rx->reorder_buf);
 	kfree(tid_rx->reorder_time);
@@ -287,7 +287,7 @@ void ieee80211_process_addba_request(struct ieee80211_local *local,
 	}
 
 	/* prepare A-MPDU MLME for Rx aggregation */
-	tid_agg_rx = kmalloc(sizeof(struct tid_ampdu_rx), GFP_KERNEL);
+	tid_agg_rx = kzalloc(sizeof(struct tid_ampdu_rx), GFP_KERNEL);
 	if (!tid_agg_rx)
 		goto end;
 
@@ -1038,7 +1038,8 @@ static int ieee80211_stop_ap(struct wiphy *wiphy, struct net_device *dev)
 	drv_stop_ap(sdata->local, sdata);
 
 	/* free all potentially still buffered bcast frames */
-	local->total_ps_buffered -= skb_queue_len(&sdata->u.ap.ps.bc_buf);
+	atomic_sub(skb_queue_len(&sdata->u.ap.ps.bc_buf),
+		   &local->total_ps_buffered);
 	skb_queue_purge(&sdata->u.ap.ps.bc_buf);
 
 	ieee80211_vif_release_channel(sdata);
@@ -1189,6 +1190,7 @@ static int sta_apply_parameters(struct ieee80211_local *local,
 			clear_sta_flag(sta, WLAN_STA_WME);
 			sta->sta.wme = false;
 		}
+		ieee80211_check_fast_xmit(sta);
 	}
 
 	if (mask & BIT(NL80211_STA_FLAG_MFP)) {
@@ -1440,6 +1442,7 @@ static int ieee80211_change_station(struct wiphy *wiphy,
 		}
 
 		ieee80211_send_layer2_update(sta);
+		ieee80211_check_fast_xmit(sta);
 	}
 
 	err = sta_apply_parameters(local, sta, params);
@@ -1550,7 +1553,7 @@ static void mpath_set_pinfo(struct mesh_path *mpath, u8 *next_hop,
 
 	memset(pinfo, 0, sizeof(*pinfo));
 
-	pinfo->generation = mesh_paths_generation;
+	pinfo->generation = mpath->sdata->u.mesh.mesh_paths_generation;
 
 	pinfo->filled = MPATH_INFO_FRAME_QLEN |
 			MPATH_INFO_SN |
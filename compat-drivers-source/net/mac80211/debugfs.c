@@ -64,9 +64,13 @@ DEBUGFS_READONLY_FILE(user_power, "%d",
 DEBUGFS_READONLY_FILE(power, "%d",
 		      local->hw.conf.power_level);
 DEBUGFS_READONLY_FILE(total_ps_buffered, "%d",
-		      local->total_ps_buffered);
+		      atomic_read(&local->total_ps_buffered));
 DEBUGFS_READONLY_FILE(wep_iv, "%#08x",
 		      local->wep_iv & 0xffffff);
+#ifdef CONFIG_MAC80211_DEBUG_COUNTERS
+DEBUGFS_READONLY_FILE(tx_realloc, "%u of %u",
+		      local->tx_realloc_count, local->tx_data_count);
+#endif
 DEBUGFS_READONLY_FILE(rate_ctrl_alg, "%s",
 	local->rate_ctrl ? local->rate_ctrl->ops->name : "hw/driver");
 
@@ -153,6 +157,8 @@ static ssize_t hwflags_read(struct file *file, char __user *user_buf,
 		sf += snprintf(buf + sf, mxln - sf, "TX_AMPDU_SETUP_IN_HW\n");
 	if (local->hw.flags & IEEE80211_HW_SCAN_WHILE_IDLE)
 		sf += snprintf(buf + sf, mxln - sf, "SCAN_WHILE_IDLE\n");
+	if (local->hw.flags & IEEE80211_HW_SUPPORTS_CLONED_SKBS)
+		sf += snprintf(buf + sf, mxln - sf, "SUPPORTS_CLONED_SKBS\n");
 
 	rv = simple_read_from_buffer(user_buf, count, ppos, buf, strlen(buf));
 	kfree(buf);
@@ -177,8 +183,63 @@ static ssize_t queues_read(struct file *file, char __user *user_buf,
 	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
 }
 
+static ssize_t queue_limits_read(struct file *file, char __user *user_buf,
+				 size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	unsigned long flags;
+	char buf[IEEE80211_MAX_QUEUES * 24];
+	int q, res = 0;
+
+	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+	for (q = 0; q < local->hw.queues; q++)
+		res += sprintf(buf + res, "%02d: %u/%u\n", q,
+				local->queue_state[q].inflight,
+				local->queue_state[q].limit);
+	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+
+static ssize_t sta_hash_read(struct file *file, char __user *user_buf,
+			     size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	struct sta_hash_table *tbl;
+	struct sta_info *sta;
+	unsigned int i, len, used = 0, max_len = 0;
+	char buf[120];
+	int res;
+
+	mutex_lock(&local->sta_mtx);
+	tbl = rcu_dereference_protected(local->sta_hash,
+					lockdep_is_held(&local->sta_mtx));
+	for (i = 0; i <= tbl->hash_mask; i++) {
+		len = 0;
+		sta = rcu_dereference_protected(tbl->buckets[i],
+					lockdep_is_held(&local->sta_mtx));
+		while (sta) {
+			len++;
+			sta = rcu_dereference_protected(sta->hnext[tbl->link],
+					lockdep_is_held(&local->sta_mtx));
+		}
+		if (len)
+			used++;
+		max_len = max(max_len, len);
+	}
+	res = scnprintf(buf, sizeof(buf),
+			"stations: %lu\nbuckets: %u\nused buckets: %u\n"
+			"longest chain: %u\n",
+			local->num_sta, tbl->hash_mask + 1, used, max_len);
+	mutex_unlock(&local->sta_mtx);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
+}
+
 DEBUGFS_READONLY_FILE_OPS(hwflags);
 DEBUGFS_READONLY_FILE_OPS(queues);
+DEBUGFS_READONLY_FILE_OPS(queue_limits);
+DEBUGFS_READONLY_FILE_OPS(sta_hash);
 
 /* statistics stuff */
 
@@ -247,6 +308,11 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	DEBUGFS_ADD(total_ps_buffered);
 	DEBUGFS_ADD(wep_iv);
 	DEBUGFS_ADD(queues);
+	DEBUGFS_ADD(queue_limits);
+#ifdef CONFIG_MAC80211_DEBUG_COUNTERS
+	DEBUGFS_ADD(tx_realloc);
+#endif
+	DEBUGFS_ADD(sta_hash);
 #ifdef CONFIG_PM
 	DEBUGFS_ADD_MODE(reset, 0200);
 #endif
@@ -301,14 +367,24 @@ void debugfs_hw_add(struct ieee80211_local *local)
 		local->tx_expand_skb_head);
 	DEBUGFS_STATS_ADD(tx_expand_skb_head_cloned,
 		local->tx_expand_skb_head_cloned);
+	DEBUGFS_STATS_ADD(tx_fast_xmit,
+		local->tx_fast_xmit);
 	DEBUGFS_STATS_ADD(rx_expand_skb_head,
 		local->rx_expand_skb_head);
 	DEBUGFS_STATS_ADD(rx_expand_skb_head2,
 		local->rx_expand_skb_head2);
 	DEBUGFS_STATS_ADD(rx_handlers_fragments,
 		local->rx_handlers_fragments);
+	DEBUGFS_STATS_ADD(rx_copy_linear_only,
+		local->rx_copy_linear_only);
+	DEBUGFS_STATS_ADD(rx_fwd_copy_avoided,
+		local->rx_fwd_copy_avoided);
 	DEBUGFS_STATS_ADD(tx_status_drop,
 		local->tx_status_drop);
+	DEBUGFS_STATS_ADD(tx_txq_codel_drop,
+		local->tx_txq_codel_drop);
+	DEBUGFS_STATS_ADD(tx_txq_overlimit_drop,
+		local->tx_txq_overlimit_drop);
 #endif
 	DEBUGFS_DEVSTATS_ADD(dot11ACKFailureCount);
 	DEBUGFS_DEVSTATS_ADD(dot11RTSFailureCount);
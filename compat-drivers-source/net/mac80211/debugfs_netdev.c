@@ -197,6 +197,8 @@ IEEE80211_IF_FILE(bssid, u.mgd.bssid, MAC);
 IEEE80211_IF_FILE(aid, u.mgd.aid, DEC);
 IEEE80211_IF_FILE(last_beacon, u.mgd.last_beacon_signal, DEC);
 IEEE80211_IF_FILE(ave_beacon, u.mgd.ave_beacon_signal, DEC_DIV_16);
+IEEE80211_IF_FILE(beacon_parses, u.mgd.beacon_parses, DEC);
+IEEE80211_IF_FILE(beacon_parses_avoided, u.mgd.beacon_parses_avoided, DEC);
 
 static int ieee80211_set_smps(struct ieee80211_sub_if_data *sdata,
 			      enum ieee80211_smps_mode smps_mode)
@@ -470,6 +472,16 @@ IEEE80211_IF_FILE(dropped_frames_congestion,
 		  u.mesh.mshstats.dropped_frames_congestion, DEC);
 IEEE80211_IF_FILE(dropped_frames_no_route,
 		  u.mesh.mshstats.dropped_frames_no_route, DEC);
+IEEE80211_IF_FILE(rmc_hits, u.mesh.mshstats.rmc_hits, DEC);
+IEEE80211_IF_FILE(rmc_misses, u.mesh.mshstats.rmc_misses, DEC);
+IEEE80211_IF_FILE(rmc_evictions, u.mesh.mshstats.rmc_evictions, DEC);
+IEEE80211_IF_FILE(preq_sent, u.mesh.mshstats.preq_sent, DEC);
+IEEE80211_IF_FILE(preq_targets, u.mesh.mshstats.preq_targets, DEC);
+IEEE80211_IF_FILE(disc_started, u.mesh.mshstats.disc_started, DEC);
+IEEE80211_IF_FILE(disc_resolved, u.mesh.mshstats.disc_resolved, DEC);
+IEEE80211_IF_FILE(disc_failed, u.mesh.mshstats.disc_failed, DEC);
+IEEE80211_IF_FILE(disc_latency_total, u.mesh.mshstats.disc_latency_total, DEC);
+IEEE80211_IF_FILE(disc_latency_max, u.mesh.mshstats.disc_latency_max, DEC);
 IEEE80211_IF_FILE(estab_plinks, u.mesh.estab_plinks, ATOMIC);
 
 /* Mesh parameters */
@@ -539,6 +551,8 @@ static void add_sta_files(struct ieee80211_sub_if_data *sdata)
 	DEBUGFS_ADD(aid);
 	DEBUGFS_ADD(last_beacon);
 	DEBUGFS_ADD(ave_beacon);
+	DEBUGFS_ADD(beacon_parses);
+	DEBUGFS_ADD(beacon_parses_avoided);
 	DEBUGFS_ADD_MODE(smps, 0600);
 	DEBUGFS_ADD_MODE(tkip_mic_test, 0200);
 	DEBUGFS_ADD_MODE(uapsd_queues, 0600);
@@ -584,6 +598,16 @@ static void add_mesh_stats(struct ieee80211_sub_if_data *sdata)
 	MESHSTATS_ADD(dropped_frames_ttl);
 	MESHSTATS_ADD(dropped_frames_no_route);
 	MESHSTATS_ADD(dropped_frames_congestion);
+	MESHSTATS_ADD(rmc_hits);
+	MESHSTATS_ADD(rmc_misses);
+	MESHSTATS_ADD(rmc_evictions);
+	MESHSTATS_ADD(preq_sent);
+	MESHSTATS_ADD(preq_targets);
+	MESHSTATS_ADD(disc_started);
+	MESHSTATS_ADD(disc_resolved);
+	MESHSTATS_ADD(disc_failed);
+	MESHSTATS_ADD(disc_latency_total);
+	MESHSTATS_ADD(disc_latency_max);
 	MESHSTATS_ADD(estab_plinks);
 #undef MESHSTATS_ADD
 }
@@ -48,9 +48,11 @@ struct ieee80211_local;
 #define IEEE80211_ENCRYPT_TAILROOM 18
 
 /* IEEE 802.11 (Ch. 9.5 Defragmentation) requires support for concurrent
- * reception of at least three fragmented frames. This limit can be increased
- * by changing this define, at the cost of slower frame reassembly and
- * increased memory use (about 2 kB of RAM per entry). */
+ * reception of at least three fragmented frames. Frames from known stations
+ * are reassembled in per-station contexts (one per TID), this limit only
+ * applies to the per-interface cache used for frames from unknown senders.
+ * It can be increased by changing this define, at the cost of slower frame
+ * reassembly and increased memory use (about 2 kB of RAM per entry). */
 #define IEEE80211_FRAGMENT_MAX 4
 
 #define TU_TO_JIFFIES(x)	(usecs_to_jiffies((x) * 1024))
@@ -212,6 +214,8 @@ typedef unsigned __bitwise__ ieee80211_rx_result;
  * @IEEE80211_RX_AMSDU: a-MSDU packet
  * @IEEE80211_RX_MALFORMED_ACTION_FRM: action frame is malformed
  * @IEEE80211_RX_DEFERRED_RELEASE: frame was subjected to receive reordering
+ * @IEEE80211_RX_SHARED_FRAGS: the paged data of the frame is shared with
+ *	copies handed to other interfaces and must not be written to
  *
  * These are per-frame flags that are attached to a frame in the
  * @rx_flags field of &struct ieee80211_rx_status.
@@ -222,6 +226,7 @@ enum ieee80211_packet_rx_flags {
 	IEEE80211_RX_AMSDU			= BIT(3),
 	IEEE80211_RX_MALFORMED_ACTION_FRM	= BIT(4),
 	IEEE80211_RX_DEFERRED_RELEASE		= BIT(5),
+	IEEE80211_RX_SHARED_FRAGS		= BIT(6),
 };
 
 /**
@@ -284,6 +289,12 @@ struct ps_data {
 	 * bitmap_empty :)
 	 * NB: don't touch this bitmap, use sta_info_{set,clear}_tim_bit */
 	u8 tim[sizeof(unsigned long) * BITS_TO_LONGS(IEEE80211_MAX_AID + 1)];
+	/*
+	 * number of bits set in the bitmap, and the first and last byte
+	 * with bits set, kept up to date along with it for the beacon
+	 */
+	u16 tim_bits;
+	u8 tim_first, tim_last;
 	struct sk_buff_head bc_buf;
 	atomic_t num_sta_ps; /* number of stations in PS mode */
 	int dtim_count;
@@ -319,10 +330,22 @@ struct mesh_stats {
 	__u32 dropped_frames_ttl;	/* Not transmitted since mesh_ttl == 0*/
 	__u32 dropped_frames_no_route;	/* Not transmitted, no route found */
 	__u32 dropped_frames_congestion;/* Not forwarded due to congestion */
+	__u32 rmc_hits;			/* Duplicates found in the RMC */
+	__u32 rmc_misses;		/* Multicast frames added to the RMC */
+	__u32 rmc_evictions;		/* Live RMC entries replaced */
+	__u32 preq_sent;		/* PREQs originated */
+	__u32 preq_targets;		/* Targets requested in those PREQs */
+	__u32 disc_started;		/* Path discoveries started */
+	__u32 disc_resolved;		/* Path discoveries that succeeded */
+	__u32 disc_failed;		/* Path discoveries out of retries */
+	__u32 disc_latency_total;	/* Sum of resolved discovery times, ms */
+	__u32 disc_latency_max;		/* Longest resolved discovery, ms */
 };
 
 #define PREQ_Q_F_START		0x1
 #define PREQ_Q_F_REFRESH	0x2
+struct mesh_table;
+
 struct mesh_preq_queue {
 	struct list_head list;
 	u8 dst[ETH_ALEN];
@@ -449,6 +472,15 @@ struct ieee80211_if_managed {
 	bool beacon_crc_valid;
 	u32 beacon_crc;
 
+	/*
+	 * Hash of the IEs of the last beacon except for the TIM, beacons
+	 * with the same hash are known not to have changed and aren't
+	 * parsed; also only valid with beacon_crc_valid.
+	 */
+	bool beacon_ie_hash_valid;
+	u32 beacon_ie_hash;
+	unsigned int beacon_parses, beacon_parses_avoided;
+
 	enum {
 		IEEE80211_MFP_DISABLED,
 		IEEE80211_MFP_OPTIONAL,
@@ -602,8 +634,17 @@ struct ieee80211_if_mesh {
 	/* Timestamp of last PREQ sent */
 	unsigned long last_preq;
 	struct mesh_rmc *rmc;
+	/* mesh paths and proxied (MPP) paths of this interface */
+	struct mesh_table __rcu *mesh_paths;
+	struct mesh_table __rcu *mpp_paths;
+	int mesh_paths_generation;
+	/* known mesh gates, whose paths may or may not be active */
+	struct hlist_head known_gates;
+	spinlock_t gates_lock;
 	spinlock_t mesh_preq_queue_lock;
+	/* PREQs for new discoveries and retries, sent before refreshes */
 	struct mesh_preq_queue preq_queue;
+	struct list_head preq_refresh_queue;
 	int preq_queue_len;
 	struct mesh_stats mshstats;
 	struct mesh_config mshcfg;
@@ -842,8 +883,99 @@ enum queue_stop_reason {
 	IEEE80211_QUEUE_STOP_REASON_AGGREGATION,
 	IEEE80211_QUEUE_STOP_REASON_SUSPEND,
 	IEEE80211_QUEUE_STOP_REASON_SKB_ADD,
+	IEEE80211_QUEUE_STOP_REASON_TX_LIMIT,
+};
+
+/*
+ * Byte limits for hardware queues, see ieee80211_tx_limit_completed().
+ * The limit adapts between these bounds; it grows when the device ran
+ * out of frames because of it while traffic continued and shrinks by
+ * the amount of data that was never needed during an interval.
+ */
+#define IEEE80211_TX_LIMIT_MIN		(2 * IEEE80211_MAX_FRAME_LEN)
+#define IEEE80211_TX_LIMIT_MAX		(1024 * 1024)
+#define IEEE80211_TX_LIMIT_INTERVAL	HZ
+
+/**
+ * struct ieee80211_queue_state - per hardware queue TX state
+ *
+ * @local: back pointer to the device
+ * @pending_tasklet: transmits the frames on the queue's pending list
+ * @queue: hardware queue index
+ * @inflight: bytes handed to the driver and not yet completed
+ * @limit: current limit for @inflight
+ * @slack: lowest @inflight seen since @slack_start
+ * @slack_start: start of the current limit adjustment interval
+ * @ovlimit: the queue was stopped by the limit since @inflight last
+ *	dropped to zero
+ * @ovlimit_queued: frames were queued after @ovlimit was set, so the
+ *	traffic didn't simply stop when the queue ran empty
+ *
+ * Everything but the tasklet is protected by queue_stop_reason_lock.
+ */
+struct ieee80211_queue_state {
+	struct ieee80211_local *local;
+	struct tasklet_struct pending_tasklet;
+	int queue;
+
+	unsigned int inflight;
+	unsigned int limit;
+	unsigned int slack;
+	unsigned long slack_start;
+	bool ovlimit;
+	bool ovlimit_queued;
+};
+
+/* intermediate TX queues, see txq.c */
+#define IEEE80211_TXQ_MAX_LEN		1000
+#define IEEE80211_TXQ_QUANTUM		ETH_FRAME_LEN
+
+/**
+ * struct ieee80211_codel_vars - CoDel state of an intermediate TX queue
+ *
+ * @count: drops since entering the dropping state
+ * @lastcount: @count when the dropping state was last entered
+ * @dropping: in dropping state
+ * @rec_inv_sqrt: reciprocal value of sqrt(@count) >> 1
+ * @first_above_time: when the sojourn time went (or will go) above
+ *	target for a full interval
+ * @drop_next: time of the next drop, or of the last one
+ */
+struct ieee80211_codel_vars {
+	u32 count;
+	u32 lastcount;
+	bool dropping;
+	u16 rec_inv_sqrt;
+	u32 first_above_time;
+	u32 drop_next;
 };
 
+/**
+ * struct txq_info - per station/TID or per interface TX queue
+ *
+ * @schedule_order: entry in the active list of the queue's AC
+ * @queue: the frames, protected by the AC's active_txq_lock
+ * @backlog: bytes on @queue
+ * @deficit: DRR deficit in bytes
+ * @cvars: CoDel state
+ * @txq: the part visible to the driver
+ */
+struct txq_info {
+	struct list_head schedule_order;
+	struct sk_buff_head queue;
+	unsigned int backlog;
+	int deficit;
+	struct ieee80211_codel_vars cvars;
+
+	/* keep last! */
+	struct ieee80211_txq txq;
+};
+
+static inline struct txq_info *to_txq_info(struct ieee80211_txq *txq)
+{
+	return container_of(txq, struct txq_info, txq);
+}
+
 #ifdef CONFIG_MAC80211_LEDS
 struct tpt_led_trigger {
 	struct led_trigger trig;
@@ -994,13 +1126,19 @@ struct ieee80211_local {
 	struct sk_buff_head skb_queue_unreliable;
 
 	/*
-	 * Internal FIFO queue which is shared between multiple rx path
-	 * stages. Its main task is to provide a serialization mechanism,
-	 * so all rx handlers can enjoy having exclusive access to their
-	 * private data structures.
+	 * RX handlers are serialized per station by sta_info.rx_path_lock,
+	 * this lock additionally serializes frames that touch per-interface
+	 * RX state: frames without a station, group addressed frames and
+	 * fragments. It nests inside the station lock.
+	 */
+	spinlock_t rx_path_lock;
+
+	/*
+	 * Protects the interface and mesh RX counters, which the handlers
+	 * for frames from different stations update concurrently. It nests
+	 * inside both RX path locks.
 	 */
-	struct sk_buff_head rx_skb_queue;
-	bool running_rx_handler;	/* protected by rx_skb_queue.lock */
+	spinlock_t rx_stats_lock;
 
 	/* Station data */
 	/*
@@ -1011,12 +1149,25 @@ struct ieee80211_local {
 	spinlock_t tim_lock;
 	unsigned long num_sta;
 	struct list_head sta_list;
-	struct sta_info __rcu *sta_hash[STA_HASH_SIZE];
+	struct sta_hash_table __rcu *sta_hash;
+	struct work_struct sta_hash_work;
 	struct timer_list sta_cleanup;
 	int sta_generation;
 
+	/*
+	 * Stations with PS-buffered frames, in the order they started
+	 * buffering, so the global buffer limit can be enforced without
+	 * walking all stations.
+	 */
+	spinlock_t ps_buf_lock;
+	struct list_head ps_buf_stas;
+
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
-	struct tasklet_struct tx_pending_tasklet;
+	struct ieee80211_queue_state queue_state[IEEE80211_MAX_QUEUES];
+
+	/* non-empty intermediate TX queues, per AC */
+	spinlock_t active_txq_lock[IEEE80211_NUM_ACS];
+	struct list_head active_txqs[IEEE80211_NUM_ACS];
 
 	atomic_t agg_queue_stop[IEEE80211_MAX_QUEUES];
 
@@ -1108,19 +1259,34 @@ struct ieee80211_local {
 	unsigned int rx_handlers_drop_short;
 	unsigned int tx_expand_skb_head;
 	unsigned int tx_expand_skb_head_cloned;
+	unsigned int tx_fast_xmit;
+	/*
+	 * TX buffer reallocations for lack of headroom/tailroom or because
+	 * a clone couldn't be modified, and data frames from the network
+	 * stack for comparison
+	 */
+	unsigned int tx_realloc_count;
+	unsigned int tx_data_count;
 	unsigned int rx_expand_skb_head;
 	unsigned int rx_expand_skb_head2;
 	unsigned int rx_handlers_fragments;
+	unsigned int rx_copy_linear_only;
+	unsigned int rx_fwd_copy_avoided;
 	unsigned int tx_status_drop;
+	unsigned int tx_txq_codel_drop;
+	unsigned int tx_txq_overlimit_drop;
 #define I802_DEBUG_INC(c) (c)++
 #else /* CONFIG_MAC80211_DEBUG_COUNTERS */
 #define I802_DEBUG_INC(c) do { } while (0)
 #endif /* CONFIG_MAC80211_DEBUG_COUNTERS */
 
 
-	int total_ps_buffered; /* total number of all buffered unicast and
-				* multicast packets for power saving stations
-				*/
+	/*
+	 * total number of all buffered unicast and multicast packets for
+	 * power saving stations, changed from all the contexts that queue
+	 * and release them
+	 */
+	atomic_t total_ps_buffered;
 
 	bool pspolling;
 	bool offchannel_ps_enabled;
@@ -1408,6 +1574,16 @@ static inline bool ieee80211_sdata_running(struct ieee80211_sub_if_data *sdata)
 
 /* tx handling */
 void ieee80211_clear_tx_pending(struct ieee80211_local *local);
+void ieee80211_init_tx_queue(struct ieee80211_sub_if_data *sdata,
+			     struct sta_info *sta,
+			     struct txq_info *txqi, int tid);
+void ieee80211_txq_enqueue(struct ieee80211_local *local,
+			   struct txq_info *txqi, struct sk_buff *skb);
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi);
+struct sk_buff *ieee80211_tx_finish_queued(struct ieee80211_local *local,
+					   struct ieee80211_txq *txq,
+					   struct sk_buff *skb);
 void ieee80211_tx_pending(unsigned long data);
 netdev_tx_t ieee80211_monitor_start_xmit(struct sk_buff *skb,
 					 struct net_device *dev);
@@ -1415,6 +1591,9 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 				       struct net_device *dev);
 void ieee80211_purge_tx_queue(struct ieee80211_hw *hw,
 			      struct sk_buff_head *skbs);
+void ieee80211_check_fast_xmit(struct sta_info *sta);
+void ieee80211_check_fast_xmit_iface(struct ieee80211_sub_if_data *sdata);
+void ieee80211_clear_fast_xmit(struct sta_info *sta);
 
 /* HT */
 void ieee80211_apply_htcap_overrides(struct ieee80211_sub_if_data *sdata,
@@ -1570,6 +1749,11 @@ void ieee80211_wake_queue_by_reason(struct ieee80211_hw *hw, int queue,
 void ieee80211_stop_queue_by_reason(struct ieee80211_hw *hw, int queue,
 				    enum queue_stop_reason reason);
 void ieee80211_propagate_queue_wake(struct ieee80211_local *local, int queue);
+void __ieee80211_tx_limit_queued(struct ieee80211_local *local,
+				 struct sk_buff *skb);
+void ieee80211_tx_limit_completed(struct ieee80211_local *local,
+				  struct sk_buff *skb);
+void ieee80211_tx_limit_reset(struct ieee80211_local *local);
 void ieee80211_add_pending_skb(struct ieee80211_local *local,
 			       struct sk_buff *skb);
 void ieee80211_add_pending_skbs_fn(struct ieee80211_local *local,
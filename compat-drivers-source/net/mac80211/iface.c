@@ -531,6 +531,10 @@ int ieee80211_do_open(struct wireless_dev *wdev, bool coming_up)
 		sdata->bss = &sdata->u.ap;
 		break;
 	case NL80211_IFTYPE_MESH_POINT:
+		res = ieee80211_mesh_init_tables(sdata);
+		if (res)
+			return res;
+		break;
 	case NL80211_IFTYPE_STATION:
 	case NL80211_IFTYPE_MONITOR:
 	case NL80211_IFTYPE_ADHOC:
@@ -925,6 +929,9 @@ static void ieee80211_do_stop(struct ieee80211_sub_if_data *sdata,
 	}
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
+	if (sdata->vif.txq)
+		ieee80211_txq_purge(local, to_txq_info(sdata->vif.txq));
+
 	if (local->monitors == local->open_count && local->monitors > 0)
 		ieee80211_add_virtual_monitor(local);
 }
@@ -993,8 +1000,10 @@ static void ieee80211_teardown_sdata(struct ieee80211_sub_if_data *sdata)
 		__skb_queue_purge(&sdata->fragments[i].skb_list);
 	sdata->fragment_next = 0;
 
-	if (ieee80211_vif_is_mesh(&sdata->vif))
+	if (ieee80211_vif_is_mesh(&sdata->vif)) {
 		mesh_rmc_free(sdata);
+		mesh_pathtbl_unregister(sdata);
+	}
 
 	flushed = sta_info_flush(sdata);
 	WARN_ON(flushed);
@@ -1531,14 +1540,20 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 	struct ieee80211_sub_if_data *sdata = NULL;
 	int ret, i;
 	int txqs = 1;
+	int size = ALIGN(sizeof(*sdata) + local->hw.vif_data_size,
+			 sizeof(void *));
+	int txq_size = 0;
 
 	ASSERT_RTNL();
 
+	/* the interface's intermediate TX queue lives behind drv_priv */
+	if (local->ops->wake_tx_queue)
+		txq_size = sizeof(struct txq_info) + local->hw.txq_data_size;
+
 	if (type == NL80211_IFTYPE_P2P_DEVICE) {
 		struct wireless_dev *wdev;
 
-		sdata = kzalloc(sizeof(*sdata) + local->hw.vif_data_size,
-				GFP_KERNEL);
+		sdata = kzalloc(size + txq_size, GFP_KERNEL);
 		if (!sdata)
 			return -ENOMEM;
 		wdev = &sdata->wdev;
@@ -1551,8 +1566,7 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 		if (local->hw.queues >= IEEE80211_NUM_ACS)
 			txqs = IEEE80211_NUM_ACS;
 
-		ndev = alloc_netdev_mqs(sizeof(*sdata) +
-					local->hw.vif_data_size,
+		ndev = alloc_netdev_mqs(size + txq_size,
 					name, ieee80211_if_setup, txqs, 1);
 		if (!ndev)
 			return -ENOMEM;
@@ -1562,7 +1576,7 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 		ndev->needed_headroom = local->tx_headroom +
 					4*6 /* four MAC addresses */
 					+ 2 + 2 + 2 + 2 /* ctl, dur, seq, qos */
-					+ 6 /* mesh */
+					+ sizeof(struct ieee80211s_hdr) /* mesh */
 					+ 8 /* rfc1042/bridge tunnel */
 					- ETH_HLEN /* ethernet hard_header_len */
 					+ IEEE80211_ENCRYPT_HEADROOM;
@@ -1591,6 +1605,9 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 	/* initialise type-independent data */
 	sdata->wdev.wiphy = local->hw.wiphy;
 	sdata->local = local;
+
+	if (txq_size)
+		ieee80211_init_tx_queue(sdata, NULL, (void *)sdata + size, 0);
 #ifdef CONFIG_INET
 	sdata->arp_filter_state = true;
 #endif
@@ -88,6 +88,15 @@ static void increment_tailroom_need_count(struct ieee80211_sub_if_data *sdata)
 	}
 }
 
+/* the TX fast path can only use keys the hardware handles */
+static void ieee80211_key_check_fast_xmit(struct ieee80211_key *key)
+{
+	if (key->sta)
+		ieee80211_check_fast_xmit(key->sta);
+	else
+		ieee80211_check_fast_xmit_iface(key->sdata);
+}
+
 static int ieee80211_key_enable_hw_accel(struct ieee80211_key *key)
 {
 	struct ieee80211_sub_if_data *sdata;
@@ -138,6 +147,8 @@ static int ieee80211_key_enable_hw_accel(struct ieee80211_key *key)
 		WARN_ON((key->conf.flags & IEEE80211_KEY_FLAG_PUT_IV_SPACE) &&
 			(key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_IV));
 
+		ieee80211_key_check_fast_xmit(key);
+
 		return 0;
 	}
 
@@ -195,6 +206,8 @@ static void ieee80211_key_disable_hw_accel(struct ieee80211_key *key)
 			  sta ? sta->sta.addr : bcast_addr, ret);
 
 	key->flags &= ~KEY_FLAG_UPLOADED_TO_HARDWARE;
+
+	ieee80211_key_check_fast_xmit(key);
 }
 
 static void __ieee80211_set_default_key(struct ieee80211_sub_if_data *sdata,
@@ -207,8 +220,10 @@ static void __ieee80211_set_default_key(struct ieee80211_sub_if_data *sdata,
 	if (idx >= 0 && idx < NUM_DEFAULT_KEYS)
 		key = key_mtx_dereference(sdata->local, sdata->keys[idx]);
 
-	if (uni)
+	if (uni) {
 		rcu_assign_pointer(sdata->default_unicast_key, key);
+		ieee80211_check_fast_xmit_iface(sdata);
+	}
 	if (multi)
 		rcu_assign_pointer(sdata->default_multicast_key, key);
 
@@ -262,6 +277,7 @@ static void __ieee80211_key_replace(struct ieee80211_sub_if_data *sdata,
 
 	if (sta && pairwise) {
 		rcu_assign_pointer(sta->ptk, new);
+		ieee80211_check_fast_xmit(sta);
 	} else if (sta) {
 		if (old)
 			idx = old->conf.keyidx;
@@ -364,9 +380,9 @@ struct ieee80211_key *ieee80211_key_alloc(u32 cipher, int idx, size_t key_len,
 		 * Initialize AES key state here as an optimization so that
 		 * it does not need to be initialized for every packet.
 		 */
-		key->u.ccmp.tfm = ieee80211_aes_key_setup_encrypt(key_data);
-		if (IS_ERR(key->u.ccmp.tfm)) {
-			err = PTR_ERR(key->u.ccmp.tfm);
+		err = ieee80211_aes_key_setup_encrypt(&key->u.ccmp.tfm,
+						      key_data);
+		if (err) {
 			kfree(key);
 			return ERR_PTR(err);
 		}
@@ -412,7 +428,7 @@ static void __ieee80211_key_destroy(struct ieee80211_key *key)
 		ieee80211_key_disable_hw_accel(key);
 
 	if (key->conf.cipher == WLAN_CIPHER_SUITE_CCMP)
-		ieee80211_aes_key_free(key->u.ccmp.tfm);
+		ieee80211_aes_key_free(&key->u.ccmp.tfm);
 	if (key->conf.cipher == WLAN_CIPHER_SUITE_AES_CMAC)
 		ieee80211_aes_cmac_key_free(key->u.aes_cmac.tfm);
 	if (key->local) {
@@ -15,6 +15,7 @@
 #include <linux/crypto.h>
 #include <linux/rcupdate.h>
 #include <net/mac80211.h>
+#include "aes_ccm.h"
 
 #define NUM_DEFAULT_KEYS 4
 #define NUM_DEFAULT_MGMT_KEYS 2
@@ -57,6 +58,7 @@ struct tkip_ctx {
 	u16 iv16;	/* current iv16 */
 	u16 p1k[5];	/* p1k cache */
 	u32 p1k_iv32;	/* iv32 for which p1k computed */
+	bool p1k_valid;	/* p1k was computed, not just the IV tracked */
 	enum ieee80211_internal_tkip_state state;
 };
 
@@ -94,7 +96,7 @@ struct ieee80211_key {
 			 * Management frames.
 			 */
 			u8 rx_pn[IEEE80211_NUM_TIDS + 1][CCMP_PN_LEN];
-			struct crypto_cipher *tfm;
+			struct ieee80211_ccm_tfm tfm;
 			u32 replays; /* dot11RSNAStatsCCMPReplays */
 		} ccmp;
 		struct {
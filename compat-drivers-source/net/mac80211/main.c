@@ -33,8 +33,6 @@
 #include "cfg.h"
 #include "debugfs.h"
 
-static struct lock_class_key ieee80211_rx_skb_queue_class;
-
 void ieee80211_configure_filter(struct ieee80211_local *local)
 {
 	u64 mc;
@@ -231,6 +229,7 @@ u32 ieee80211_reset_erp_info(struct ieee80211_sub_if_data *sdata)
 static void ieee80211_tasklet_handler(unsigned long data)
 {
 	struct ieee80211_local *local = (struct ieee80211_local *) data;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta, *tmp;
 	struct skb_eosp_msg_data *eosp_data;
 	struct sk_buff *skb;
@@ -250,7 +249,8 @@ static void ieee80211_tasklet_handler(unsigned long data)
 			break;
 		case IEEE80211_EOSP_MSG:
 			eosp_data = (void *)skb->cb;
-			for_each_sta_info(local, eosp_data->sta, sta, tmp) {
+			rcu_read_lock();
+			for_each_sta_info(local, tbl, eosp_data->sta, sta, tmp) {
 				/* skip wrong virtual interface */
 				if (memcmp(eosp_data->iface,
 					   sta->sdata->vif.addr, ETH_ALEN))
@@ -258,6 +258,7 @@ static void ieee80211_tasklet_handler(unsigned long data)
 				clear_sta_flag(sta, WLAN_STA_SP);
 				break;
 			}
+			rcu_read_unlock();
 			dev_kfree_skb(skb);
 			break;
 		default:
@@ -600,15 +601,8 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 	INIT_LIST_HEAD(&local->chanctx_list);
 	mutex_init(&local->chanctx_mtx);
 
-	/*
-	 * The rx_skb_queue is only accessed from tasklets,
-	 * but other SKB queues are used from within IRQ
-	 * context. Therefore, this one needs a different
-	 * locking class so our direct, non-irq-safe use of
-	 * the queue's lock doesn't throw lockdep warnings.
-	 */
-	skb_queue_head_init_class(&local->rx_skb_queue,
-				  &ieee80211_rx_skb_queue_class);
+	spin_lock_init(&local->rx_path_lock);
+	spin_lock_init(&local->rx_stats_lock);
 
 	INIT_DELAYED_WORK(&local->scan_work, ieee80211_scan_work);
 
@@ -632,14 +626,31 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 	/* preallocate at least one entry */
 	idr_pre_get(&local->ack_status_frames, GFP_KERNEL);
 
-	sta_info_init(local);
+	if (sta_info_init(local)) {
+		idr_destroy(&local->ack_status_frames);
+		wiphy_free(wiphy);
+		return NULL;
+	}
 
 	for (i = 0; i < IEEE80211_MAX_QUEUES; i++) {
+		struct ieee80211_queue_state *qs = &local->queue_state[i];
+
 		skb_queue_head_init(&local->pending[i]);
 		atomic_set(&local->agg_queue_stop[i], 0);
+
+		qs->local = local;
+		qs->queue = i;
+		qs->limit = IEEE80211_TX_LIMIT_MIN;
+		qs->slack = UINT_MAX;
+		qs->slack_start = jiffies;
+		tasklet_init(&qs->pending_tasklet, ieee80211_tx_pending,
+			     (unsigned long)qs);
+	}
+
+	for (i = 0; i < IEEE80211_NUM_ACS; i++) {
+		spin_lock_init(&local->active_txq_lock[i]);
+		INIT_LIST_HEAD(&local->active_txqs[i]);
 	}
-	tasklet_init(&local->tx_pending_tasklet, ieee80211_tx_pending,
-		     (unsigned long)local);
 
 	tasklet_init(&local->tasklet,
 		     ieee80211_tasklet_handler,
@@ -1023,8 +1034,10 @@ EXPORT_SYMBOL(ieee80211_register_hw);
 void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
+	int i;
 
-	tasklet_kill(&local->tx_pending_tasklet);
+	for (i = 0; i < IEEE80211_MAX_QUEUES; i++)
+		tasklet_kill(&local->queue_state[i].pending_tasklet);
 	tasklet_kill(&local->tasklet);
 
 	pm_qos_remove_notifier(PM_QOS_NETWORK_LATENCY,
@@ -1055,7 +1068,6 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 		wiphy_warn(local->hw.wiphy, "skb_queue not empty\n");
 	skb_queue_purge(&local->skb_queue);
 	skb_queue_purge(&local->skb_queue_unreliable);
-	skb_queue_purge(&local->rx_skb_queue);
 
 	destroy_workqueue(local->workqueue);
 	wiphy_unregister(local->hw.wiphy);
@@ -1087,6 +1099,8 @@ void ieee80211_free_hw(struct ieee80211_hw *hw)
 		     ieee80211_free_ack_frame, NULL);
 	idr_destroy(&local->ack_status_frames);
 
+	sta_info_deinit(local);
+
 	wiphy_free(local->hw.wiphy);
 }
 EXPORT_SYMBOL(ieee80211_free_hw);
@@ -1137,9 +1151,6 @@ static void __exit ieee80211_exit(void)
 	flush_scheduled_work();
 #endif
 
-	if (mesh_allocated)
-		ieee80211s_stop();
-
 	ieee80211_iface_exit();
 
 	rcu_barrier();
@@ -9,6 +9,8 @@
  */
 
 #include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <asm/unaligned.h>
 #include "ieee80211_i.h"
 #include "mesh.h"
@@ -17,8 +19,10 @@
 #define TMR_RUNNING_MP	1
 #define TMR_RUNNING_MPR	2
 
-int mesh_allocated;
-static struct kmem_cache *rm_cache;
+static int mesh_rmc_entries = RMC_DEFAULT_ENTRIES;
+module_param(mesh_rmc_entries, int, 0644);
+MODULE_PARM_DESC(mesh_rmc_entries,
+		 "Size of the mesh recent multicast cache of new interfaces");
 
 bool mesh_action_is_path_sel(struct ieee80211_mgmt *mgmt)
 {
@@ -26,20 +30,6 @@ bool mesh_action_is_path_sel(struct ieee80211_mgmt *mgmt)
 			WLAN_MESH_ACTION_HWMP_PATH_SELECTION);
 }
 
-void ieee80211s_init(void)
-{
-	mesh_pathtbl_init();
-	mesh_allocated = 1;
-	rm_cache = kmem_cache_create("mesh_rmc", sizeof(struct rmc_entry),
-				     0, 0, NULL);
-}
-
-void ieee80211s_stop(void)
-{
-	mesh_pathtbl_unregister();
-	kmem_cache_destroy(rm_cache);
-}
-
 static void ieee80211_mesh_housekeeping_timer(unsigned long data)
 {
 	struct ieee80211_sub_if_data *sdata = (void *) data;
@@ -151,36 +141,45 @@ u32 mesh_accept_plinks_update(struct ieee80211_sub_if_data *sdata)
 
 int mesh_rmc_init(struct ieee80211_sub_if_data *sdata)
 {
-	int i;
+	struct mesh_rmc *rmc;
+	unsigned int entries, i;
 
-	sdata->u.mesh.rmc = kmalloc(sizeof(struct mesh_rmc), GFP_KERNEL);
-	if (!sdata->u.mesh.rmc)
+	entries = roundup_pow_of_two(clamp(mesh_rmc_entries,
+					   RMC_PROBE_MAX, 65536));
+	rmc = kmalloc(sizeof(*rmc) + entries * sizeof(rmc->slot[0]),
+		      GFP_KERNEL);
+	if (!rmc)
 		return -ENOMEM;
-	sdata->u.mesh.rmc->idx_mask = RMC_BUCKETS - 1;
-	for (i = 0; i < RMC_BUCKETS; i++)
-		INIT_LIST_HEAD(&sdata->u.mesh.rmc->bucket[i]);
+
+	rmc->idx_mask = entries - 1;
+	/* an expired slot is a free one */
+	for (i = 0; i < entries; i++) {
+		rmc->slot[i].seqnum = 0;
+		rmc->slot[i].exp_time = jiffies;
+		memset(rmc->slot[i].sa, 0, ETH_ALEN);
+	}
+
+	sdata->u.mesh.rmc = rmc;
 	return 0;
 }
 
 void mesh_rmc_free(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_rmc *rmc = sdata->u.mesh.rmc;
-	struct rmc_entry *p, *n;
-	int i;
-
-	if (!sdata->u.mesh.rmc)
-		return;
-
-	for (i = 0; i < RMC_BUCKETS; i++)
-		list_for_each_entry_safe(p, n, &rmc->bucket[i], list) {
-			list_del(&p->list);
-			kmem_cache_free(rm_cache, p);
-		}
-
-	kfree(rmc);
+	kfree(sdata->u.mesh.rmc);
 	sdata->u.mesh.rmc = NULL;
 }
 
+/*
+ * A slot is live only during the RMC_TIMEOUT before it expires. Checking
+ * both ends keeps a slot that was left untouched for longer than half the
+ * jiffies range from looking live again once time_before() wraps.
+ */
+static bool mesh_rmc_slot_live(struct rmc_entry *p, unsigned long now)
+{
+	return time_before(now, p->exp_time) &&
+	       !time_before(now, p->exp_time - RMC_TIMEOUT);
+}
+
 /**
  * mesh_rmc_check - Check frame in recent multicast cache and add if absent.
  *
@@ -191,40 +190,62 @@ void mesh_rmc_free(struct ieee80211_sub_if_data *sdata)
  *
  * Checks using the source address and the mesh sequence number if we have
  * received this frame lately. If the frame is not in the cache, it is added to
- * it.
+ * it, in the first free slot of its probe sequence or, if there is none, in
+ * place of the entry that expires first.
+ *
+ * Multicast frames are received under the RX lock, so the cache needs no
+ * locking of its own.
  */
 int mesh_rmc_check(u8 *sa, struct ieee80211s_hdr *mesh_hdr,
 		   struct ieee80211_sub_if_data *sdata)
 {
 	struct mesh_rmc *rmc = sdata->u.mesh.rmc;
-	u32 seqnum = 0;
-	int entries = 0;
-	u8 idx;
-	struct rmc_entry *p, *n;
+	struct mesh_stats *stats = &sdata->u.mesh.mshstats;
+	struct rmc_entry *p, *victim, *free = NULL, *oldest = NULL;
+	unsigned long now = jiffies;
+	u32 seqnum = 0, idx;
+	int i;
+
+	if (!rmc)
+		return 0;
 
 	/* Don't care about endianness since only match matters */
 	memcpy(&seqnum, &mesh_hdr->seqnum, sizeof(mesh_hdr->seqnum));
-	idx = le32_to_cpu(mesh_hdr->seqnum) & rmc->idx_mask;
-	list_for_each_entry_safe(p, n, &rmc->bucket[idx], list) {
-		++entries;
-		if (time_after(jiffies, p->exp_time) ||
-				(entries == RMC_QUEUE_MAX_LEN)) {
-			list_del(&p->list);
-			kmem_cache_free(rm_cache, p);
-			--entries;
-		} else if ((seqnum == p->seqnum) &&
-			   (ether_addr_equal(sa, p->sa)))
+	idx = jhash_2words(seqnum, get_unaligned((u32 *)(sa + 2)), 0);
+
+	/*
+	 * Slots ahead of a free one may still be live, since entries expire
+	 * in insertion order rather than in probe order, so always scan the
+	 * whole probe sequence.
+	 */
+	for (i = 0; i < RMC_PROBE_MAX; i++) {
+		p = &rmc->slot[(idx + i) & rmc->idx_mask];
+
+		if (!mesh_rmc_slot_live(p, now)) {
+			if (!free)
+				free = p;
+			continue;
+		}
+
+		if (p->seqnum == seqnum && ether_addr_equal(sa, p->sa)) {
+			stats->rmc_hits++;
 			return -1;
+		}
+
+		if (!oldest || time_before(p->exp_time, oldest->exp_time))
+			oldest = p;
 	}
 
-	p = kmem_cache_alloc(rm_cache, GFP_ATOMIC);
-	if (!p)
-		return 0;
+	stats->rmc_misses++;
+	victim = free;
+	if (!victim) {
+		stats->rmc_evictions++;
+		victim = oldest;
+	}
 
-	p->seqnum = seqnum;
-	p->exp_time = jiffies + RMC_TIMEOUT;
-	memcpy(p->sa, sa, ETH_ALEN);
-	list_add(&p->list, &rmc->bucket[idx]);
+	victim->seqnum = seqnum;
+	victim->exp_time = now + RMC_TIMEOUT;
+	memcpy(victim->sa, sa, ETH_ALEN);
 	return 0;
 }
 
@@ -780,10 +801,10 @@ void ieee80211_mesh_work(struct ieee80211_sub_if_data *sdata)
 		mesh_path_start_discovery(sdata);
 
 	if (test_and_clear_bit(MESH_WORK_GROW_MPATH_TABLE, &ifmsh->wrkq_flags))
-		mesh_mpath_table_grow();
+		mesh_mpath_table_grow(sdata);
 
 	if (test_and_clear_bit(MESH_WORK_GROW_MPP_TABLE, &ifmsh->wrkq_flags))
-		mesh_mpp_table_grow();
+		mesh_mpp_table_grow(sdata);
 
 	if (test_and_clear_bit(MESH_WORK_HOUSEKEEPING, &ifmsh->wrkq_flags))
 		ieee80211_mesh_housekeeping(sdata, ifmsh);
@@ -806,6 +827,28 @@ void ieee80211_mesh_notify_scan_completed(struct ieee80211_local *local)
 	rcu_read_unlock();
 }
 
+/*
+ * The RX and TX paths of a mesh interface rely on the RMC and the path
+ * tables being there, so they're allocated when the interface is brought
+ * up to fail that if they can't be, and freed with the interface.
+ */
+int ieee80211_mesh_init_tables(struct ieee80211_sub_if_data *sdata)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	int err;
+
+	if (!ifmsh->rmc) {
+		err = mesh_rmc_init(sdata);
+		if (err)
+			return err;
+	}
+
+	if (!rcu_access_pointer(ifmsh->mesh_paths))
+		return mesh_pathtbl_init(sdata);
+
+	return 0;
+}
+
 void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
@@ -820,12 +863,8 @@ void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata)
 	ifmsh->sn = 0;
 	ifmsh->num_gates = 0;
 	atomic_set(&ifmsh->mpaths, 0);
-	mesh_rmc_init(sdata);
 	ifmsh->last_preq = jiffies;
 	ifmsh->next_perr = jiffies;
-	/* Allocate all mesh structures when creating the first mesh interface. */
-	if (!mesh_allocated)
-		ieee80211s_init();
 	setup_timer(&ifmsh->mesh_path_timer,
 		    ieee80211_mesh_path_timer,
 		    (unsigned long) sdata);
@@ -833,6 +872,7 @@ void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata)
 		    ieee80211_mesh_path_root_timer,
 		    (unsigned long) sdata);
 	INIT_LIST_HEAD(&ifmsh->preq_queue.list);
+	INIT_LIST_HEAD(&ifmsh->preq_refresh_queue);
 	spin_lock_init(&ifmsh->mesh_preq_queue_lock);
 	spin_lock_init(&ifmsh->sync_offset_lock);
 
@@ -84,6 +84,7 @@ enum mesh_deferred_task_flags {
  * @discovery_timeout: timeout (lapse in jiffies) used for the last discovery
  * 	retry
  * @discovery_retries: number of discovery retries
+ * @discovery_start: when the running discovery was started, in jiffies
  * @flags: mesh path flags, as specified on &enum mesh_path_flags
  * @state_lock: mesh path state lock used to protect changes to the
  * mpath itself.  No need to take this lock when adding or removing
@@ -114,6 +115,7 @@ struct mesh_path {
 	unsigned long exp_time;
 	u32 discovery_timeout;
 	u8 discovery_retries;
+	unsigned long discovery_start;
 	enum mesh_path_flags flags;
 	spinlock_t state_lock;
 	u8 rann_snd_addr[ETH_ALEN];
@@ -137,10 +139,8 @@ struct mesh_path {
  *	buckets
  * @mean_chain_len: maximum average length for the hash buckets' list, if it is
  *	reached, the table will grow
- * @known_gates: list of known mesh gates and their mpaths by the station. The
- * gate's mpath may or may not be resolved and active.
- *
- * rcu_head: RCU head to free the table
+ * @new_tbl: table this one is being grown into, see mesh_pathtbl.c
+ * @resize_pos: buckets below this index have been copied to @new_tbl
  */
 struct mesh_table {
 	/* Number of buckets will be 2^N */
@@ -153,16 +153,16 @@ struct mesh_table {
 	int (*copy_node) (struct hlist_node *p, struct mesh_table *newtbl);
 	int size_order;
 	int mean_chain_len;
-	struct hlist_head *known_gates;
-	spinlock_t gates_lock;
 
-	struct rcu_head rcu_head;
+	struct mesh_table __rcu *new_tbl;
+	unsigned int resize_pos;
 };
 
 /* Recent multicast cache */
-/* RMC_BUCKETS must be a power of 2, maximum 256 */
-#define RMC_BUCKETS		256
-#define RMC_QUEUE_MAX_LEN	4
+/* Default number of RMC slots, rounded up to a power of 2 */
+#define RMC_DEFAULT_ENTRIES	1024
+/* Slots probed for a frame before the oldest of them is replaced */
+#define RMC_PROBE_MAX		8
 #define RMC_TIMEOUT		(3 * HZ)
 
 /**
@@ -177,15 +177,21 @@ struct mesh_table {
  * that are found in the cache.
  */
 struct rmc_entry {
-	struct list_head list;
 	u32 seqnum;
 	unsigned long exp_time;
 	u8 sa[ETH_ALEN];
 };
 
+/**
+ * struct mesh_rmc - Recent Multicast Cache
+ *
+ * @idx_mask: number of slots minus one
+ * @slot: open addressed table of entries, indexed by a hash of
+ *	(sa, seqnum). An expired slot is free, so lookups never allocate.
+ */
 struct mesh_rmc {
-	struct list_head bucket[RMC_BUCKETS];
 	u32 idx_mask;
+	struct rmc_entry slot[0];
 };
 
 #define IEEE80211_MESH_PEER_INACTIVITY_LIMIT (1800 * HZ)
@@ -232,10 +238,8 @@ int mesh_add_ht_oper_ie(struct sk_buff *skb,
 			struct ieee80211_sub_if_data *sdata);
 void mesh_rmc_free(struct ieee80211_sub_if_data *sdata);
 int mesh_rmc_init(struct ieee80211_sub_if_data *sdata);
-void ieee80211s_init(void);
 void ieee80211s_update_metric(struct ieee80211_local *local,
 		struct sta_info *sta, struct sk_buff *skb);
-void ieee80211s_stop(void);
 void ieee80211_mesh_init_sdata(struct ieee80211_sub_if_data *sdata);
 void ieee80211_start_mesh(struct ieee80211_sub_if_data *sdata);
 void ieee80211_stop_mesh(struct ieee80211_sub_if_data *sdata);
@@ -248,6 +252,7 @@ int mesh_nexthop_lookup(struct sk_buff *skb,
 int mesh_nexthop_resolve(struct sk_buff *skb,
 			 struct ieee80211_sub_if_data *sdata);
 void mesh_path_start_discovery(struct ieee80211_sub_if_data *sdata);
+void mesh_path_discovery_done(struct mesh_path *mpath);
 struct mesh_path *mesh_path_lookup(u8 *dst,
 		struct ieee80211_sub_if_data *sdata);
 struct mesh_path *mpp_path_lookup(u8 *dst,
@@ -280,16 +285,16 @@ void mesh_rx_plink_frame(struct ieee80211_sub_if_data *sdata,
 
 /* Private interfaces */
 /* Mesh tables */
-void mesh_mpath_table_grow(void);
-void mesh_mpp_table_grow(void);
+void mesh_mpath_table_grow(struct ieee80211_sub_if_data *sdata);
+void mesh_mpp_table_grow(struct ieee80211_sub_if_data *sdata);
 /* Mesh paths */
 int mesh_path_error_tx(u8 ttl, u8 *target, __le32 target_sn, __le16 target_rcode,
 		       const u8 *ra, struct ieee80211_sub_if_data *sdata);
 void mesh_path_assign_nexthop(struct mesh_path *mpath, struct sta_info *sta);
 void mesh_path_flush_pending(struct mesh_path *mpath);
 void mesh_path_tx_pending(struct mesh_path *mpath);
-int mesh_pathtbl_init(void);
-void mesh_pathtbl_unregister(void);
+int mesh_pathtbl_init(struct ieee80211_sub_if_data *sdata);
+void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata);
 int mesh_path_del(u8 *addr, struct ieee80211_sub_if_data *sdata);
 void mesh_path_timer(unsigned long data);
 void mesh_path_flush_by_nexthop(struct sta_info *sta);
@@ -300,11 +305,8 @@ void mesh_path_restart(struct ieee80211_sub_if_data *sdata);
 void mesh_path_tx_root_frame(struct ieee80211_sub_if_data *sdata);
 
 bool mesh_action_is_path_sel(struct ieee80211_mgmt *mgmt);
-extern int mesh_paths_generation;
 
 #ifdef CONFIG_MAC80211_MESH
-extern int mesh_allocated;
-
 static inline
 u32 mesh_plink_inc_estab_count(struct ieee80211_sub_if_data *sdata)
 {
@@ -333,6 +335,9 @@ static inline bool mesh_plink_availables(struct ieee80211_sub_if_data *sdata)
 
 static inline void mesh_path_activate(struct mesh_path *mpath)
 {
+	if ((mpath->flags & (MESH_PATH_RESOLVING | MESH_PATH_RESOLVED)) ==
+	    MESH_PATH_RESOLVING)
+		mesh_path_discovery_done(mpath);
 	mpath->flags |= MESH_PATH_ACTIVE | MESH_PATH_RESOLVED;
 }
 
@@ -349,8 +354,8 @@ void mesh_plink_quiesce(struct sta_info *sta);
 void mesh_plink_restart(struct sta_info *sta);
 void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata);
 void mesh_sync_adjust_tbtt(struct ieee80211_sub_if_data *sdata);
+int ieee80211_mesh_init_tables(struct ieee80211_sub_if_data *sdata);
 #else
-#define mesh_allocated	0
 static inline void
 ieee80211_mesh_notify_scan_completed(struct ieee80211_local *local) {}
 static inline void ieee80211_mesh_quiesce(struct ieee80211_sub_if_data *sdata)
@@ -363,6 +368,9 @@ static inline bool mesh_path_sel_is_hwmp(struct ieee80211_sub_if_data *sdata)
 { return false; }
 static inline void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata)
 {}
+static inline int
+ieee80211_mesh_init_tables(struct ieee80211_sub_if_data *sdata)
+{ return 0; }
 #endif
 
 #endif /* IEEE80211S_H */
@@ -19,6 +19,20 @@
 
 #define MAX_PREQ_QUEUE_LEN	64
 
+/* PREQ element without AE and targets, and the most targets that fit in it */
+#define PREQ_IE_BASE_LEN	26
+#define MAX_PREQ_TARGETS	((255 - PREQ_IE_BASE_LEN) / \
+				 sizeof(struct hwmp_preq_target))
+
+/*
+ * Peers that only take single target PREQs (as did this implementation
+ * before) drop multi-target ones unseen, so batching is opt-in.
+ */
+static bool mesh_preq_batch;
+module_param(mesh_preq_batch, bool, 0644);
+MODULE_PARM_DESC(mesh_preq_batch,
+		 "Request several queued mesh path discoveries in one PREQ");
+
 /* Destination only */
 #define MP_F_DO	0x1
 /* Reply and forward */
@@ -28,6 +42,19 @@
 /* Reason code Present */
 #define MP_F_RCODE  0x02
 
+/**
+ * struct hwmp_preq_target - per target fields of a PREQ element
+ *
+ * @flags: per target flags (MP_F_DO, MP_F_RF, ...)
+ * @addr: target address
+ * @sn: target sequence number
+ */
+struct hwmp_preq_target {
+	u8 flags;
+	u8 addr[ETH_ALEN];
+	__le32 sn;
+} __packed;
+
 static void mesh_queue_preq(struct mesh_path *, u8);
 
 static inline u32 u32_field_get(u8 *preq_elem, int offset, bool ae)
@@ -55,9 +82,9 @@ static inline u32 u16_field_get(u8 *preq_elem, int offset, bool ae)
 #define PREQ_IE_ORIG_SN(x)	u32_field_get(x, 13, 0)
 #define PREQ_IE_LIFETIME(x)	u32_field_get(x, 17, AE_F_SET(x))
 #define PREQ_IE_METRIC(x) 	u32_field_get(x, 21, AE_F_SET(x))
-#define PREQ_IE_TARGET_F(x)	(*(AE_F_SET(x) ? x + 32 : x + 26))
-#define PREQ_IE_TARGET_ADDR(x) 	(AE_F_SET(x) ? x + 33 : x + 27)
-#define PREQ_IE_TARGET_SN(x) 	u32_field_get(x, 33, AE_F_SET(x))
+#define PREQ_IE_TARGET_COUNT(x)	(*(AE_F_SET(x) ? x + 31 : x + 25))
+#define PREQ_IE_TARGETS(x)	((struct hwmp_preq_target *) \
+				 (AE_F_SET(x) ? x + 32 : x + 26))
 
 
 #define PREP_IE_FLAGS(x)	PREQ_IE_FLAGS(x)
@@ -101,24 +128,18 @@ enum mpath_frame_type {
 
 static const u8 broadcast_addr[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
-static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
-		u8 *orig_addr, __le32 orig_sn, u8 target_flags, u8 *target,
-		__le32 target_sn, const u8 *da, u8 hop_count, u8 ttl,
-		__le32 lifetime, __le32 metric, __le32 preq_id,
-		struct ieee80211_sub_if_data *sdata)
+static struct sk_buff *hwmp_frame_alloc(struct ieee80211_sub_if_data *sdata,
+					const u8 *da, u8 ie_len)
 {
 	struct ieee80211_local *local = sdata->local;
 	struct sk_buff *skb;
 	struct ieee80211_mgmt *mgmt;
-	u8 *pos, ie_len;
 	int hdr_len = offsetof(struct ieee80211_mgmt, u.action.u.mesh_action) +
 		      sizeof(mgmt->u.action.u.mesh_action);
 
-	skb = dev_alloc_skb(local->tx_headroom +
-			    hdr_len +
-			    2 + 37); /* max HWMP IE */
+	skb = dev_alloc_skb(local->tx_headroom + hdr_len + 2 + ie_len);
 	if (!skb)
-		return -1;
+		return NULL;
 	skb_reserve(skb, local->tx_headroom);
 	mgmt = (struct ieee80211_mgmt *) skb_put(skb, hdr_len);
 	memset(mgmt, 0, hdr_len);
@@ -132,31 +153,38 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 	mgmt->u.action.category = WLAN_CATEGORY_MESH_ACTION;
 	mgmt->u.action.u.mesh_action.action_code =
 					WLAN_MESH_ACTION_HWMP_PATH_SELECTION;
+	return skb;
+}
+
+static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
+		u8 *orig_addr, __le32 orig_sn, u8 *target,
+		__le32 target_sn, const u8 *da, u8 hop_count, u8 ttl,
+		__le32 lifetime, __le32 metric,
+		struct ieee80211_sub_if_data *sdata)
+{
+	struct sk_buff *skb;
+	u8 *pos, ie_len, eid;
 
 	switch (action) {
-	case MPATH_PREQ:
-		mhwmp_dbg(sdata, "sending PREQ to %pM\n", target);
-		ie_len = 37;
-		pos = skb_put(skb, 2 + ie_len);
-		*pos++ = WLAN_EID_PREQ;
-		break;
 	case MPATH_PREP:
 		mhwmp_dbg(sdata, "sending PREP to %pM\n", target);
 		ie_len = 31;
-		pos = skb_put(skb, 2 + ie_len);
-		*pos++ = WLAN_EID_PREP;
+		eid = WLAN_EID_PREP;
 		break;
 	case MPATH_RANN:
 		mhwmp_dbg(sdata, "sending RANN from %pM\n", orig_addr);
 		ie_len = sizeof(struct ieee80211_rann_ie);
-		pos = skb_put(skb, 2 + ie_len);
-		*pos++ = WLAN_EID_RANN;
+		eid = WLAN_EID_RANN;
 		break;
 	default:
-		kfree_skb(skb);
 		return -ENOTSUPP;
-		break;
 	}
+
+	skb = hwmp_frame_alloc(sdata, da, ie_len);
+	if (!skb)
+		return -1;
+	pos = skb_put(skb, 2 + ie_len);
+	*pos++ = eid;
 	*pos++ = ie_len;
 	*pos++ = flags;
 	*pos++ = hop_count;
@@ -167,10 +195,6 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 		memcpy(pos, &target_sn, 4);
 		pos += 4;
 	} else {
-		if (action == MPATH_PREQ) {
-			memcpy(pos, &preq_id, 4);
-			pos += 4;
-		}
 		memcpy(pos, orig_addr, ETH_ALEN);
 		pos += ETH_ALEN;
 		memcpy(pos, &orig_sn, 4);
@@ -180,14 +204,7 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 	pos += 4;
 	memcpy(pos, &metric, 4);
 	pos += 4;
-	if (action == MPATH_PREQ) {
-		*pos++ = 1; /* destination count */
-		*pos++ = target_flags;
-		memcpy(pos, target, ETH_ALEN);
-		pos += ETH_ALEN;
-		memcpy(pos, &target_sn, 4);
-		pos += 4;
-	} else if (action == MPATH_PREP) {
+	if (action == MPATH_PREP) {
 		memcpy(pos, orig_addr, ETH_ALEN);
 		pos += ETH_ALEN;
 		memcpy(pos, &orig_sn, 4);
@@ -198,6 +215,55 @@ static int mesh_path_sel_frame_tx(enum mpath_frame_type action, u8 flags,
 	return 0;
 }
 
+/**
+ * mesh_path_sel_preq_tx - send a PREQ for one or more targets
+ *
+ * @targets: per target fields, copied to the element as they are
+ * @n_targets: number of targets, at most MAX_PREQ_TARGETS
+ *
+ * The other arguments are the common fields of the PREQ element.
+ */
+static int mesh_path_sel_preq_tx(struct ieee80211_sub_if_data *sdata,
+		u8 flags, const u8 *orig_addr, __le32 orig_sn, const u8 *da,
+		u8 hop_count, u8 ttl, __le32 lifetime, __le32 metric,
+		__le32 preq_id, const struct hwmp_preq_target *targets,
+		int n_targets)
+{
+	struct sk_buff *skb;
+	u8 *pos, ie_len;
+
+	if (WARN_ON(n_targets < 1 || n_targets > MAX_PREQ_TARGETS))
+		return -EINVAL;
+
+	mhwmp_dbg(sdata, "sending PREQ to %pM (%d targets)\n",
+		  targets[0].addr, n_targets);
+	ie_len = PREQ_IE_BASE_LEN + n_targets * sizeof(*targets);
+	skb = hwmp_frame_alloc(sdata, da, ie_len);
+	if (!skb)
+		return -1;
+	pos = skb_put(skb, 2 + ie_len);
+	*pos++ = WLAN_EID_PREQ;
+	*pos++ = ie_len;
+	*pos++ = flags;
+	*pos++ = hop_count;
+	*pos++ = ttl;
+	memcpy(pos, &preq_id, 4);
+	pos += 4;
+	memcpy(pos, orig_addr, ETH_ALEN);
+	pos += ETH_ALEN;
+	memcpy(pos, &orig_sn, 4);
+	pos += 4;
+	memcpy(pos, &lifetime, 4);
+	pos += 4;
+	memcpy(pos, &metric, 4);
+	pos += 4;
+	*pos++ = n_targets;
+	memcpy(pos, targets, n_targets * sizeof(*targets));
+
+	ieee80211_tx_skb(sdata, skb);
+	return 0;
+}
+
 
 /*  Headroom is not adjusted.  Caller should ensure that skb has sufficient
  *  headroom in case the frame is encrypted. */
@@ -512,127 +578,145 @@ static void hwmp_preq_frame_process(struct ieee80211_sub_if_data *sdata,
 				    u8 *preq_elem, u32 metric)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
-	struct mesh_path *mpath = NULL;
-	u8 *target_addr, *orig_addr;
-	const u8 *da;
-	u8 target_flags, ttl, flags;
-	u32 orig_sn, target_sn, lifetime, orig_metric;
-	bool reply = false;
-	bool forward = true;
+	struct hwmp_preq_target fwd[MAX_PREQ_TARGETS];
+	struct hwmp_preq_target *target;
+	struct mesh_path *mpath;
+	u8 *target_addr, *orig_addr, *reply_addr;
+	const u8 *da = broadcast_addr, *target_da;
+	u8 target_flags, ttl, flags, n_targets;
+	u32 orig_sn, target_sn, reply_sn, reply_metric, lifetime;
+	int i, n_fwd = 0;
+	bool reply, forward;
 	bool root_is_gate;
 
-	/* Update target SN, if present */
-	target_addr = PREQ_IE_TARGET_ADDR(preq_elem);
 	orig_addr = PREQ_IE_ORIG_ADDR(preq_elem);
-	target_sn = PREQ_IE_TARGET_SN(preq_elem);
 	orig_sn = PREQ_IE_ORIG_SN(preq_elem);
-	target_flags = PREQ_IE_TARGET_F(preq_elem);
-	orig_metric = metric;
+	lifetime = PREQ_IE_LIFETIME(preq_elem);
+	n_targets = PREQ_IE_TARGET_COUNT(preq_elem);
+	target = PREQ_IE_TARGETS(preq_elem);
 	/* Proactive PREQ gate announcements */
 	flags = PREQ_IE_FLAGS(preq_elem);
 	root_is_gate = !!(flags & RANN_FLAG_IS_GATE);
 
 	mhwmp_dbg(sdata, "received PREQ from %pM\n", orig_addr);
 
-	if (ether_addr_equal(target_addr, sdata->vif.addr)) {
-		mhwmp_dbg(sdata, "PREQ is for us\n");
-		forward = false;
-		reply = true;
-		metric = 0;
-		if (time_after(jiffies, ifmsh->last_sn_update +
-					net_traversal_jiffies(sdata)) ||
-		    time_before(jiffies, ifmsh->last_sn_update)) {
-			target_sn = ++ifmsh->sn;
-			ifmsh->last_sn_update = jiffies;
-		}
-	} else if (is_broadcast_ether_addr(target_addr) &&
-		   (target_flags & IEEE80211_PREQ_TO_FLAG)) {
-		rcu_read_lock();
-		mpath = mesh_path_lookup(orig_addr, sdata);
-		if (mpath) {
-			if (flags & IEEE80211_PREQ_PROACTIVE_PREP_FLAG) {
-				reply = true;
-				target_addr = sdata->vif.addr;
-				target_sn = ++ifmsh->sn;
-				metric = 0;
+	rcu_read_lock();
+	for (i = 0; i < n_targets; i++, target++) {
+		/* Update target SN, if present */
+		target_addr = target->addr;
+		target_sn = le32_to_cpu(target->sn);
+		target_flags = target->flags;
+		reply_addr = target_addr;
+		reply_sn = target_sn;
+		reply_metric = 0;
+		reply = false;
+		forward = true;
+		mpath = NULL;
+
+		if (ether_addr_equal(target_addr, sdata->vif.addr)) {
+			mhwmp_dbg(sdata, "PREQ is for us\n");
+			forward = false;
+			reply = true;
+			if (time_after(jiffies, ifmsh->last_sn_update +
+						net_traversal_jiffies(sdata)) ||
+			    time_before(jiffies, ifmsh->last_sn_update)) {
+				reply_sn = ++ifmsh->sn;
 				ifmsh->last_sn_update = jiffies;
 			}
-			if (root_is_gate)
-				mesh_path_add_gate(mpath);
-		}
-		rcu_read_unlock();
-	} else {
-		rcu_read_lock();
-		mpath = mesh_path_lookup(target_addr, sdata);
-		if (mpath) {
-			if ((!(mpath->flags & MESH_PATH_SN_VALID)) ||
-					SN_LT(mpath->sn, target_sn)) {
-				mpath->sn = target_sn;
-				mpath->flags |= MESH_PATH_SN_VALID;
-			} else if ((!(target_flags & MP_F_DO)) &&
-					(mpath->flags & MESH_PATH_ACTIVE)) {
-				reply = true;
-				metric = mpath->metric;
-				target_sn = mpath->sn;
-				if (target_flags & MP_F_RF)
-					target_flags |= MP_F_DO;
-				else
-					forward = false;
+		} else if (is_broadcast_ether_addr(target_addr) &&
+			   (target_flags & IEEE80211_PREQ_TO_FLAG)) {
+			mpath = mesh_path_lookup(orig_addr, sdata);
+			if (mpath) {
+				if (flags & IEEE80211_PREQ_PROACTIVE_PREP_FLAG) {
+					reply = true;
+					reply_addr = sdata->vif.addr;
+					reply_sn = ++ifmsh->sn;
+					ifmsh->last_sn_update = jiffies;
+				}
+				if (root_is_gate)
+					mesh_path_add_gate(mpath);
+			}
+		} else {
+			mpath = mesh_path_lookup(target_addr, sdata);
+			if (mpath) {
+				if ((!(mpath->flags & MESH_PATH_SN_VALID)) ||
+						SN_LT(mpath->sn, target_sn)) {
+					mpath->sn = target_sn;
+					mpath->flags |= MESH_PATH_SN_VALID;
+				} else if ((!(target_flags & MP_F_DO)) &&
+						(mpath->flags & MESH_PATH_ACTIVE)) {
+					reply = true;
+					reply_metric = mpath->metric;
+					reply_sn = target_sn = mpath->sn;
+					if (target_flags & MP_F_RF)
+						target_flags |= MP_F_DO;
+					else
+						forward = false;
+				}
 			}
 		}
-		rcu_read_unlock();
-	}
 
-	if (reply) {
-		lifetime = PREQ_IE_LIFETIME(preq_elem);
-		ttl = ifmsh->mshcfg.element_ttl;
-		if (ttl != 0) {
-			mhwmp_dbg(sdata, "replying to the PREQ\n");
-			mesh_path_sel_frame_tx(MPATH_PREP, 0, orig_addr,
-				cpu_to_le32(orig_sn), 0, target_addr,
-				cpu_to_le32(target_sn), mgmt->sa, 0, ttl,
-				cpu_to_le32(lifetime), cpu_to_le32(metric),
-				0, sdata);
-		} else {
-			ifmsh->mshstats.dropped_frames_ttl++;
+		if (reply) {
+			ttl = ifmsh->mshcfg.element_ttl;
+			if (ttl != 0) {
+				mhwmp_dbg(sdata, "replying to the PREQ\n");
+				mesh_path_sel_frame_tx(MPATH_PREP, 0, orig_addr,
+					cpu_to_le32(orig_sn), reply_addr,
+					cpu_to_le32(reply_sn), mgmt->sa, 0, ttl,
+					cpu_to_le32(lifetime),
+					cpu_to_le32(reply_metric), sdata);
+			} else {
+				ifmsh->mshstats.dropped_frames_ttl++;
+			}
 		}
+
+		if (!forward)
+			continue;
+
+		/*
+		 * Targets still to be resolved further on are forwarded in
+		 * a single PREQ, individually addressed only if they all
+		 * lead to the same root.
+		 */
+		target_da = (mpath && mpath->is_root) ?
+			mpath->rann_snd_addr : broadcast_addr;
+		if (!n_fwd)
+			da = target_da;
+		else if (!ether_addr_equal(da, target_da))
+			da = broadcast_addr;
+
+		fwd[n_fwd].flags = target_flags;
+		memcpy(fwd[n_fwd].addr, target_addr, ETH_ALEN);
+		fwd[n_fwd].sn = cpu_to_le32(target_sn);
+		n_fwd++;
 	}
 
-	if (forward && ifmsh->mshcfg.dot11MeshForwarding) {
+	if (n_fwd && ifmsh->mshcfg.dot11MeshForwarding) {
 		u32 preq_id;
 		u8 hopcount;
 
 		ttl = PREQ_IE_TTL(preq_elem);
-		lifetime = PREQ_IE_LIFETIME(preq_elem);
 		if (ttl <= 1) {
 			ifmsh->mshstats.dropped_frames_ttl++;
-			return;
+			goto out;
 		}
 		mhwmp_dbg(sdata, "forwarding the PREQ from %pM\n", orig_addr);
 		--ttl;
 		preq_id = PREQ_IE_PREQ_ID(preq_elem);
 		hopcount = PREQ_IE_HOPCOUNT(preq_elem) + 1;
-		da = (mpath && mpath->is_root) ?
-			mpath->rann_snd_addr : broadcast_addr;
 
-		if (flags & IEEE80211_PREQ_PROACTIVE_PREP_FLAG) {
-			target_addr = PREQ_IE_TARGET_ADDR(preq_elem);
-			target_sn = PREQ_IE_TARGET_SN(preq_elem);
-			metric = orig_metric;
-		}
-
-		mesh_path_sel_frame_tx(MPATH_PREQ, flags, orig_addr,
-				cpu_to_le32(orig_sn), target_flags, target_addr,
-				cpu_to_le32(target_sn), da,
-				hopcount, ttl, cpu_to_le32(lifetime),
-				cpu_to_le32(metric), cpu_to_le32(preq_id),
-				sdata);
+		mesh_path_sel_preq_tx(sdata, flags, orig_addr,
+				cpu_to_le32(orig_sn), da, hopcount, ttl,
+				cpu_to_le32(lifetime), cpu_to_le32(metric),
+				cpu_to_le32(preq_id), fwd, n_fwd);
 		if (!is_multicast_ether_addr(da))
 			ifmsh->mshstats.fwded_unicast++;
 		else
 			ifmsh->mshstats.fwded_mcast++;
 		ifmsh->mshstats.fwded_frames++;
 	}
+out:
+	rcu_read_unlock();
 }
 
 
@@ -693,10 +777,10 @@ static void hwmp_prep_frame_process(struct ieee80211_sub_if_data *sdata,
 	orig_sn = PREP_IE_ORIG_SN(prep_elem);
 
 	mesh_path_sel_frame_tx(MPATH_PREP, flags, orig_addr,
-		cpu_to_le32(orig_sn), 0, target_addr,
+		cpu_to_le32(orig_sn), target_addr,
 		cpu_to_le32(target_sn), next_hop, hopcount,
 		ttl, cpu_to_le32(lifetime), cpu_to_le32(metric),
-		0, sdata);
+		sdata);
 	rcu_read_unlock();
 
 	sdata->u.mesh.mshstats.fwded_unicast++;
@@ -844,10 +928,10 @@ static void hwmp_rann_frame_process(struct ieee80211_sub_if_data *sdata,
 	if (ifmsh->mshcfg.dot11MeshForwarding) {
 		mesh_path_sel_frame_tx(MPATH_RANN, flags, orig_addr,
 				       cpu_to_le32(orig_sn),
-				       0, NULL, 0, broadcast_addr,
+				       NULL, 0, broadcast_addr,
 				       hopcount, ttl, cpu_to_le32(interval),
 				       cpu_to_le32(metric + metric_txsta),
-				       0, sdata);
+				       sdata);
 	}
 
 	rcu_read_unlock();
@@ -880,8 +964,13 @@ void mesh_rx_path_sel_frame(struct ieee80211_sub_if_data *sdata,
 			len - baselen, &elems);
 
 	if (elems.preq) {
-		if (elems.preq_len != 37)
-			/* Right now we support just 1 destination and no AE */
+		/* Right now we support no AE */
+		if (elems.preq_len < PREQ_IE_BASE_LEN +
+				     sizeof(struct hwmp_preq_target) ||
+		    AE_F_SET(elems.preq) ||
+		    elems.preq_len != PREQ_IE_BASE_LEN +
+				      PREQ_IE_TARGET_COUNT(elems.preq) *
+				      sizeof(struct hwmp_preq_target))
 			return;
 		last_hop_metric = hwmp_route_info_get(sdata, mgmt, elems.preq,
 						      MPATH_PREQ);
@@ -915,6 +1004,9 @@ void mesh_rx_path_sel_frame(struct ieee80211_sub_if_data *sdata,
  * @mpath: mesh path to discover
  * @flags: special attributes of the PREQ to be sent
  *
+ * Refreshes of paths that are still active are queued separately and only
+ * go out once discoveries for destinations with frames waiting are sent.
+ *
  * Locking: the function must be called from within a rcu read lock block.
  *
  */
@@ -931,7 +1023,7 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 	}
 
 	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
-	if (ifmsh->preq_queue_len == MAX_PREQ_QUEUE_LEN) {
+	if (ifmsh->preq_queue_len >= MAX_PREQ_QUEUE_LEN) {
 		spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 		kfree(preq_node);
 		if (printk_ratelimit())
@@ -953,7 +1045,10 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 	mpath->flags |= MESH_PATH_REQ_QUEUED;
 	spin_unlock(&mpath->state_lock);
 
-	list_add_tail(&preq_node->list, &ifmsh->preq_queue.list);
+	if (flags & PREQ_Q_F_REFRESH)
+		list_add_tail(&preq_node->list, &ifmsh->preq_refresh_queue);
+	else
+		list_add_tail(&preq_node->list, &ifmsh->preq_queue.list);
 	++ifmsh->preq_queue_len;
 	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 
@@ -971,19 +1066,50 @@ static void mesh_queue_preq(struct mesh_path *mpath, u8 flags)
 						min_preq_int_jiff(sdata));
 }
 
+static int mesh_preq_dequeue(struct ieee80211_if_mesh *ifmsh,
+			     struct list_head *queue, struct list_head *batch,
+			     int n, int max)
+{
+	struct mesh_preq_queue *preq_node, *tmp;
+
+	list_for_each_entry_safe(preq_node, tmp, queue, list) {
+		if (n == max)
+			break;
+		list_move_tail(&preq_node->list, batch);
+		--ifmsh->preq_queue_len;
+		n++;
+	}
+	return n;
+}
+
 /**
  * mesh_path_start_discovery - launch a path discovery from the PREQ queue
  *
  * @sdata: local mesh subif
+ *
+ * With mesh_preq_batch set, up to MAX_PREQ_TARGETS queued destinations are
+ * requested in a single PREQ, so a burst of unknown destinations is not
+ * serialized by the PREQ rate limit. Destinations whose PREQ goes to a
+ * different receiver than the first one (i.e. towards a root) are put back
+ * for the next PREQ. Retries always go out in a PREQ of their own, so that
+ * peers which drop multi-target PREQs still get to answer them.
  */
 void mesh_path_start_discovery(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
-	struct mesh_preq_queue *preq_node;
+	struct hwmp_preq_target targets[MAX_PREQ_TARGETS];
+	struct mesh_path *mpaths[MAX_PREQ_TARGETS];
+	struct mesh_preq_queue *preq_node, *tmp;
 	struct mesh_path *mpath;
-	u8 ttl, target_flags;
-	const u8 *da;
+	LIST_HEAD(batch);
+	LIST_HEAD(deferred);
+	u8 da[ETH_ALEN];
+	const u8 *target_da;
+	u8 ttl;
 	u32 lifetime;
+	int i, n = 0, max;
+	bool single = !mesh_preq_batch;
+	bool retry;
 
 	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
 	if (!ifmsh->preq_queue_len ||
@@ -993,36 +1119,70 @@ void mesh_path_start_discovery(struct ieee80211_sub_if_data *sdata)
 		return;
 	}
 
-	preq_node = list_first_entry(&ifmsh->preq_queue.list,
-			struct mesh_preq_queue, list);
-	list_del(&preq_node->list);
-	--ifmsh->preq_queue_len;
+	max = single ? 1 : MAX_PREQ_TARGETS;
+	n = mesh_preq_dequeue(ifmsh, &ifmsh->preq_queue.list, &batch, 0, max);
+	mesh_preq_dequeue(ifmsh, &ifmsh->preq_refresh_queue, &batch, n, max);
 	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
 
+	n = 0;
 	rcu_read_lock();
-	mpath = mesh_path_lookup(preq_node->dst, sdata);
-	if (!mpath)
-		goto enddiscovery;
+	list_for_each_entry_safe(preq_node, tmp, &batch, list) {
+		mpath = mesh_path_lookup(preq_node->dst, sdata);
+		if (!mpath)
+			goto next;
+
+		retry = !(preq_node->flags & (PREQ_Q_F_START |
+					      PREQ_Q_F_REFRESH));
+		target_da = mpath->is_root ? mpath->rann_snd_addr :
+					     broadcast_addr;
+		if (!n) {
+			memcpy(da, target_da, ETH_ALEN);
+		} else if (single || retry ||
+			   !ether_addr_equal(da, target_da)) {
+			list_move_tail(&preq_node->list, &deferred);
+			continue;
+		}
 
-	spin_lock_bh(&mpath->state_lock);
-	mpath->flags &= ~MESH_PATH_REQ_QUEUED;
-	if (preq_node->flags & PREQ_Q_F_START) {
-		if (mpath->flags & MESH_PATH_RESOLVING) {
+		spin_lock_bh(&mpath->state_lock);
+		mpath->flags &= ~MESH_PATH_REQ_QUEUED;
+		if (preq_node->flags & PREQ_Q_F_START) {
+			if (mpath->flags & MESH_PATH_RESOLVING) {
+				spin_unlock_bh(&mpath->state_lock);
+				goto next;
+			} else {
+				mpath->flags &= ~MESH_PATH_RESOLVED;
+				mpath->flags |= MESH_PATH_RESOLVING;
+				mpath->discovery_retries = 0;
+				mpath->discovery_timeout =
+					disc_timeout_jiff(sdata);
+				mpath->discovery_start = jiffies;
+				ifmsh->mshstats.disc_started++;
+			}
+		} else if (!(mpath->flags & MESH_PATH_RESOLVING) ||
+				mpath->flags & MESH_PATH_RESOLVED) {
+			mpath->flags &= ~MESH_PATH_RESOLVING;
 			spin_unlock_bh(&mpath->state_lock);
-			goto enddiscovery;
-		} else {
-			mpath->flags &= ~MESH_PATH_RESOLVED;
-			mpath->flags |= MESH_PATH_RESOLVING;
-			mpath->discovery_retries = 0;
-			mpath->discovery_timeout = disc_timeout_jiff(sdata);
+			goto next;
 		}
-	} else if (!(mpath->flags & MESH_PATH_RESOLVING) ||
-			mpath->flags & MESH_PATH_RESOLVED) {
-		mpath->flags &= ~MESH_PATH_RESOLVING;
+
+		if (preq_node->flags & PREQ_Q_F_REFRESH)
+			targets[n].flags = MP_F_DO;
+		else
+			targets[n].flags = MP_F_RF;
+		memcpy(targets[n].addr, mpath->dst, ETH_ALEN);
+		targets[n].sn = cpu_to_le32(mpath->sn);
 		spin_unlock_bh(&mpath->state_lock);
-		goto enddiscovery;
+		mpaths[n++] = mpath;
+		if (retry)
+			single = true;
+next:
+		list_del(&preq_node->list);
+		kfree(preq_node);
 	}
 
+	if (!n)
+		goto enddiscovery;
+
 	ifmsh->last_preq = jiffies;
 
 	if (time_after(jiffies, ifmsh->last_sn_update +
@@ -1034,28 +1194,54 @@ void mesh_path_start_discovery(struct ieee80211_sub_if_data *sdata)
 	lifetime = default_lifetime(sdata);
 	ttl = sdata->u.mesh.mshcfg.element_ttl;
 	if (ttl == 0) {
+		/* let the path timers retry or give up on the targets */
 		sdata->u.mesh.mshstats.dropped_frames_ttl++;
-		spin_unlock_bh(&mpath->state_lock);
-		goto enddiscovery;
+	} else {
+		mesh_path_sel_preq_tx(sdata, 0, sdata->vif.addr,
+				cpu_to_le32(ifmsh->sn), da, 0, ttl,
+				cpu_to_le32(lifetime), 0,
+				cpu_to_le32(ifmsh->preq_id++), targets, n);
+		ifmsh->mshstats.preq_sent++;
+		ifmsh->mshstats.preq_targets += n;
 	}
 
-	if (preq_node->flags & PREQ_Q_F_REFRESH)
-		target_flags = MP_F_DO;
-	else
-		target_flags = MP_F_RF;
-
-	spin_unlock_bh(&mpath->state_lock);
-	da = (mpath->is_root) ? mpath->rann_snd_addr : broadcast_addr;
-	mesh_path_sel_frame_tx(MPATH_PREQ, 0, sdata->vif.addr,
-			cpu_to_le32(ifmsh->sn), target_flags, mpath->dst,
-			cpu_to_le32(mpath->sn), da, 0,
-			ttl, cpu_to_le32(lifetime), 0,
-			cpu_to_le32(ifmsh->preq_id++), sdata);
-	mod_timer(&mpath->timer, jiffies + mpath->discovery_timeout);
+	for (i = 0; i < n; i++)
+		mod_timer(&mpaths[i]->timer,
+			  jiffies + mpaths[i]->discovery_timeout);
 
 enddiscovery:
 	rcu_read_unlock();
-	kfree(preq_node);
+
+	spin_lock_bh(&ifmsh->mesh_preq_queue_lock);
+	list_for_each_entry_safe_reverse(preq_node, tmp, &deferred, list) {
+		if (preq_node->flags & PREQ_Q_F_REFRESH)
+			list_move(&preq_node->list, &ifmsh->preq_refresh_queue);
+		else
+			list_move(&preq_node->list, &ifmsh->preq_queue.list);
+		++ifmsh->preq_queue_len;
+	}
+	if (ifmsh->preq_queue_len)
+		mod_timer(&ifmsh->mesh_path_timer,
+			  ifmsh->last_preq + min_preq_int_jiff(sdata));
+	spin_unlock_bh(&ifmsh->mesh_preq_queue_lock);
+}
+
+/**
+ * mesh_path_discovery_done - account for a path discovery that completed
+ *
+ * @mpath: the mesh path that was resolved
+ *
+ * Locking: must be called holding mpath->state_lock
+ */
+void mesh_path_discovery_done(struct mesh_path *mpath)
+{
+	struct mesh_stats *stats = &mpath->sdata->u.mesh.mshstats;
+	u32 latency = jiffies_to_msecs(jiffies - mpath->discovery_start);
+
+	stats->disc_resolved++;
+	stats->disc_latency_total += latency;
+	if (latency > stats->disc_latency_max)
+		stats->disc_latency_max = latency;
 }
 
 /**
@@ -1183,6 +1369,7 @@ void mesh_path_timer(unsigned long data)
 		mpath->flags = 0;
 		mpath->exp_time = jiffies;
 		spin_unlock_bh(&mpath->state_lock);
+		sdata->u.mesh.mshstats.disc_failed++;
 		if (!mpath->is_gate && mesh_gate_num(sdata) > 0) {
 			ret = mesh_path_send_to_gates(mpath);
 			if (ret)
@@ -1197,7 +1384,8 @@ mesh_path_tx_root_frame(struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	u32 interval = ifmsh->mshcfg.dot11MeshHWMPRannInterval;
-	u8 flags, target_flags = 0;
+	struct hwmp_preq_target target;
+	u8 flags;
 
 	flags = (ifmsh->mshcfg.dot11MeshGateAnnouncementProtocol)
 			? RANN_FLAG_IS_GATE : 0;
@@ -1206,22 +1394,22 @@ mesh_path_tx_root_frame(struct ieee80211_sub_if_data *sdata)
 	case IEEE80211_PROACTIVE_RANN:
 		mesh_path_sel_frame_tx(MPATH_RANN, flags, sdata->vif.addr,
 			       cpu_to_le32(++ifmsh->sn),
-			       0, NULL, 0, broadcast_addr,
+			       NULL, 0, broadcast_addr,
 			       0, ifmsh->mshcfg.element_ttl,
-			       cpu_to_le32(interval), 0, 0, sdata);
+			       cpu_to_le32(interval), 0, sdata);
 		break;
 	case IEEE80211_PROACTIVE_PREQ_WITH_PREP:
 		flags |= IEEE80211_PREQ_PROACTIVE_PREP_FLAG;
 	case IEEE80211_PROACTIVE_PREQ_NO_PREP:
 		interval = ifmsh->mshcfg.dot11MeshHWMPactivePathToRootTimeout;
-		target_flags |= IEEE80211_PREQ_TO_FLAG |
-				IEEE80211_PREQ_USN_FLAG;
-		mesh_path_sel_frame_tx(MPATH_PREQ, flags, sdata->vif.addr,
-				cpu_to_le32(++ifmsh->sn), target_flags,
-				(u8 *) broadcast_addr, 0, broadcast_addr,
+		target.flags = IEEE80211_PREQ_TO_FLAG | IEEE80211_PREQ_USN_FLAG;
+		memcpy(target.addr, broadcast_addr, ETH_ALEN);
+		target.sn = 0;
+		mesh_path_sel_preq_tx(sdata, flags, sdata->vif.addr,
+				cpu_to_le32(++ifmsh->sn), broadcast_addr,
 				0, ifmsh->mshcfg.element_ttl,
-				cpu_to_le32(interval),
-				0, cpu_to_le32(ifmsh->preq_id++), sdata);
+				cpu_to_le32(interval), 0,
+				cpu_to_le32(ifmsh->preq_id++), &target, 1);
 		break;
 	default:
 		mhwmp_dbg(sdata, "Proactive mechanism not supported\n");
@@ -37,30 +37,27 @@ struct mpath_node {
 	struct mesh_path *mpath;
 };
 
-static struct mesh_table __rcu *mesh_paths;
-static struct mesh_table __rcu *mpp_paths; /* Store paths for MPP&MAP */
+/* Buckets copied to a table being grown per run of the mesh work */
+#define MESH_RESIZE_BATCH	16
 
-int mesh_paths_generation;
-
-/* This lock will have the grow table function as writer and add / delete nodes
- * as readers. RCU provides sufficient protection only when reading the table
- * (i.e. doing lookups).  Adding or adding or removing nodes requires we take
- * the read lock or we risk operating on an old table.  The write lock is only
- * needed when modifying the number of buckets a table.
+/*
+ * Each mesh interface has its own tables. Lookups only need RCU, adding
+ * and deleting paths takes the lock of the bucket concerned.
+ *
+ * A table is grown from the mesh work, a few buckets at a time, without
+ * stopping either: the entries of the old table are copied bucket by
+ * bucket into the new one, which readers only see once it is complete.
+ * Until then, a writer holding the lock of a bucket that has been copied
+ * already (index below resize_pos) makes its change in the new table and
+ * mirrors it into the old one. Doubling the table with the same hash
+ * seed maps each old bucket onto two new ones, so no other old bucket
+ * shares them.
  */
-static DEFINE_RWLOCK(pathtbl_resize_lock);
-
-
-static inline struct mesh_table *resize_dereference_mesh_paths(void)
-{
-	return rcu_dereference_protected(mesh_paths,
-		lockdep_is_held(&pathtbl_resize_lock));
-}
 
-static inline struct mesh_table *resize_dereference_mpp_paths(void)
+static inline struct mesh_table *
+mesh_table_resize_dereference(struct mesh_table *tbl)
 {
-	return rcu_dereference_protected(mpp_paths,
-		lockdep_is_held(&pathtbl_resize_lock));
+	return rcu_dereference_check(tbl->new_tbl, 1);
 }
 
 /*
@@ -106,7 +103,8 @@ static struct mesh_table *mesh_table_alloc(int size_order)
 			sizeof(newtbl->hash_rnd));
 	for (i = 0; i <= newtbl->hash_mask; i++)
 		spin_lock_init(&newtbl->hashwlock[i]);
-	spin_lock_init(&newtbl->gates_lock);
+	RCU_INIT_POINTER(newtbl->new_tbl, NULL);
+	newtbl->resize_pos = 0;
 
 	return newtbl;
 }
@@ -122,7 +120,6 @@ static void mesh_table_free(struct mesh_table *tbl, bool free_leafs)
 {
 	struct hlist_head *mesh_hash;
 	struct hlist_node *p, *q;
-	struct mpath_node *gate;
 	int i;
 
 	mesh_hash = tbl->hash_buckets;
@@ -134,59 +131,185 @@ static void mesh_table_free(struct mesh_table *tbl, bool free_leafs)
 		}
 		spin_unlock_bh(&tbl->hashwlock[i]);
 	}
-	if (free_leafs) {
-		spin_lock_bh(&tbl->gates_lock);
-		hlist_for_each_entry_safe(gate, p, q,
-					 tbl->known_gates, list) {
-			hlist_del(&gate->list);
-			kfree(gate);
-		}
-		kfree(tbl->known_gates);
-		spin_unlock_bh(&tbl->gates_lock);
-	}
 
 	__mesh_table_free(tbl);
 }
 
-static int mesh_table_grow(struct mesh_table *oldtbl,
-			   struct mesh_table *newtbl)
+static u32 mesh_table_hash(const u8 *addr, struct mesh_table *tbl)
 {
-	struct hlist_head *oldhash;
-	struct hlist_node *p, *q;
-	int i;
+	/* Use last four bytes of hw addr as hash index */
+	return jhash_1word(get_unaligned((u32 *)(addr + 2)), tbl->hash_rnd)
+		& tbl->hash_mask;
+}
+
+static int mesh_table_resize_start(struct mesh_table *tbl)
+{
+	struct mesh_table *newtbl;
 
-	if (atomic_read(&oldtbl->entries)
-			< oldtbl->mean_chain_len * (oldtbl->hash_mask + 1))
+	if (atomic_read(&tbl->entries)
+			< tbl->mean_chain_len * (tbl->hash_mask + 1))
 		return -EAGAIN;
 
-	newtbl->free_node = oldtbl->free_node;
-	newtbl->mean_chain_len = oldtbl->mean_chain_len;
-	newtbl->copy_node = oldtbl->copy_node;
-	newtbl->known_gates = oldtbl->known_gates;
-	atomic_set(&newtbl->entries, atomic_read(&oldtbl->entries));
+	newtbl = mesh_table_alloc(tbl->size_order + 1);
+	if (!newtbl)
+		return -ENOMEM;
 
-	oldhash = oldtbl->hash_buckets;
-	for (i = 0; i <= oldtbl->hash_mask; i++)
-		hlist_for_each(p, &oldhash[i])
-			if (oldtbl->copy_node(p, newtbl) < 0)
-				goto errcopy;
+	newtbl->free_node = tbl->free_node;
+	newtbl->mean_chain_len = tbl->mean_chain_len;
+	newtbl->copy_node = tbl->copy_node;
+	newtbl->hash_rnd = tbl->hash_rnd;
 
+	tbl->resize_pos = 0;
+	rcu_assign_pointer(tbl->new_tbl, newtbl);
 	return 0;
+}
+
+static void mesh_table_resize_abort(struct mesh_table *tbl,
+				    struct mesh_table *newtbl)
+{
+	int i;
+
+	rcu_assign_pointer(tbl->new_tbl, NULL);
+	tbl->resize_pos = 0;
 
-errcopy:
-	for (i = 0; i <= newtbl->hash_mask; i++) {
-		hlist_for_each_safe(p, q, &newtbl->hash_buckets[i])
-			oldtbl->free_node(p, 0);
+	/* wait for writers that may still be mirroring into newtbl */
+	for (i = 0; i <= tbl->hash_mask; i++) {
+		spin_lock_bh(&tbl->hashwlock[i]);
+		spin_unlock_bh(&tbl->hashwlock[i]);
 	}
-	return -ENOMEM;
+
+	mesh_table_free(newtbl, false);
 }
 
-static u32 mesh_table_hash(u8 *addr, struct ieee80211_sub_if_data *sdata,
-			   struct mesh_table *tbl)
+/*
+ * Copy the next batch of buckets of *@tblp into the table it is being
+ * grown into, and replace it once all of them are. Returns true if
+ * there are buckets left to copy.
+ */
+static bool mesh_table_grow(struct ieee80211_sub_if_data *sdata,
+			    struct mesh_table __rcu **tblp)
 {
-	/* Use last four bytes of hw addr and interface index as hash index */
-	return jhash_2words(*(u32 *)(addr+2), sdata->dev->ifindex, tbl->hash_rnd)
-		& tbl->hash_mask;
+	struct mesh_table *tbl, *newtbl;
+	struct hlist_node *p;
+	unsigned int i, n;
+	int err = 0;
+
+	tbl = rcu_dereference_protected(*tblp, 1);
+	newtbl = mesh_table_resize_dereference(tbl);
+	if (!newtbl) {
+		if (mesh_table_resize_start(tbl))
+			return false;
+		newtbl = mesh_table_resize_dereference(tbl);
+	}
+
+	for (n = 0; n < MESH_RESIZE_BATCH && tbl->resize_pos <= tbl->hash_mask;
+	     n++) {
+		i = tbl->resize_pos;
+		spin_lock_bh(&tbl->hashwlock[i]);
+		hlist_for_each(p, &tbl->hash_buckets[i]) {
+			err = tbl->copy_node(p, newtbl);
+			if (err)
+				break;
+		}
+		if (!err)
+			tbl->resize_pos++;
+		spin_unlock_bh(&tbl->hashwlock[i]);
+
+		if (err) {
+			mesh_table_resize_abort(tbl, newtbl);
+			return false;
+		}
+	}
+
+	if (tbl->resize_pos <= tbl->hash_mask)
+		return true;
+
+	rcu_assign_pointer(*tblp, newtbl);
+
+	/*
+	 * Once no reader and no writer can be using the old table any
+	 * more, its nodes can go; the paths themselves now belong to
+	 * the new one.
+	 */
+	synchronize_rcu();
+	mesh_table_free(tbl, false);
+
+	mpath_dbg(sdata, "Mesh path table grown to %u buckets\n",
+		  newtbl->hash_mask + 1);
+	return false;
+}
+
+/*
+ * Lock the bucket of @addr in @tbl and, if that bucket has already been
+ * copied to a table being grown, the corresponding one in the new
+ * table, which is returned in that case. Must be called under RCU.
+ */
+static struct mesh_table *mesh_table_lock(struct mesh_table *tbl,
+					  const u8 *addr, u32 *hash_idx,
+					  u32 *new_idx)
+{
+	struct mesh_table *newtbl;
+
+	*hash_idx = mesh_table_hash(addr, tbl);
+	spin_lock_bh(&tbl->hashwlock[*hash_idx]);
+
+	newtbl = rcu_dereference(tbl->new_tbl);
+	if (!newtbl || *hash_idx >= tbl->resize_pos)
+		return NULL;
+
+	*new_idx = mesh_table_hash(addr, newtbl);
+	spin_lock(&newtbl->hashwlock[*new_idx]);
+	return newtbl;
+}
+
+static void mesh_table_unlock(struct mesh_table *tbl,
+			      struct mesh_table *newtbl,
+			      u32 hash_idx, u32 new_idx)
+{
+	if (newtbl)
+		spin_unlock(&newtbl->hashwlock[new_idx]);
+	spin_unlock_bh(&tbl->hashwlock[hash_idx]);
+}
+
+static struct mpath_node *mesh_bucket_find(struct hlist_head *bucket,
+					   const u8 *dst)
+{
+	struct mpath_node *node;
+	struct hlist_node *n;
+
+	hlist_for_each_entry(node, n, bucket, list)
+		if (ether_addr_equal(dst, node->mpath->dst))
+			return node;
+
+	return NULL;
+}
+
+/*
+ * Add @new_node to @tbl, the caller holds the locks from mesh_table_lock().
+ * When a new table is being grown, @mirror_node is used to also add the
+ * path to the old one. Returns true if the table should grow.
+ */
+static bool mesh_table_add(struct mesh_table *tbl, struct mesh_table *newtbl,
+			   u32 hash_idx, u32 new_idx,
+			   struct mpath_node *new_node,
+			   struct mpath_node *mirror_node)
+{
+	if (newtbl) {
+		hlist_add_head_rcu(&new_node->list,
+				   &newtbl->hash_buckets[new_idx]);
+		atomic_inc(&newtbl->entries);
+
+		mirror_node->mpath = new_node->mpath;
+		hlist_add_head_rcu(&mirror_node->list,
+				   &tbl->hash_buckets[hash_idx]);
+		atomic_inc(&tbl->entries);
+		return false;
+	}
+
+	hlist_add_head_rcu(&new_node->list, &tbl->hash_buckets[hash_idx]);
+	return atomic_inc_return(&tbl->entries) >=
+	       tbl->mean_chain_len * (tbl->hash_mask + 1) &&
+	       !rcu_access_pointer(tbl->new_tbl);
 }
 
 
@@ -333,11 +456,10 @@ static struct mesh_path *mpath_lookup(struct mesh_table *tbl, u8 *dst,
 	struct hlist_head *bucket;
 	struct mpath_node *node;
 
-	bucket = &tbl->hash_buckets[mesh_table_hash(dst, sdata, tbl)];
+	bucket = &tbl->hash_buckets[mesh_table_hash(dst, tbl)];
 	hlist_for_each_entry_rcu(node, n, bucket, list) {
 		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(dst, mpath->dst)) {
+		if (ether_addr_equal(dst, mpath->dst)) {
 			if (MPATH_EXPIRED(mpath)) {
 				spin_lock_bh(&mpath->state_lock);
 				mpath->flags &= ~MESH_PATH_ACTIVE;
@@ -360,19 +482,21 @@ static struct mesh_path *mpath_lookup(struct mesh_table *tbl, u8 *dst,
  */
 struct mesh_path *mesh_path_lookup(u8 *dst, struct ieee80211_sub_if_data *sdata)
 {
-	return mpath_lookup(rcu_dereference(mesh_paths), dst, sdata);
+	return mpath_lookup(rcu_dereference(sdata->u.mesh.mesh_paths), dst,
+			    sdata);
 }
 
 struct mesh_path *mpp_path_lookup(u8 *dst, struct ieee80211_sub_if_data *sdata)
 {
-	return mpath_lookup(rcu_dereference(mpp_paths), dst, sdata);
+	return mpath_lookup(rcu_dereference(sdata->u.mesh.mpp_paths), dst,
+			    sdata);
 }
 
 
 /**
  * mesh_path_lookup_by_idx - look up a path in the mesh path table by its index
  * @idx: index
- * @sdata: local subif, or NULL for all entries
+ * @sdata: local subif
  *
  * Returns: pointer to the mesh path structure, or NULL if not found.
  *
@@ -380,15 +504,13 @@ struct mesh_path *mpp_path_lookup(u8 *dst, struct ieee80211_sub_if_data *sdata)
  */
 struct mesh_path *mesh_path_lookup_by_idx(int idx, struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *tbl = rcu_dereference(mesh_paths);
+	struct mesh_table *tbl = rcu_dereference(sdata->u.mesh.mesh_paths);
 	struct mpath_node *node;
 	struct hlist_node *p;
 	int i;
 	int j = 0;
 
 	for_each_mesh_entry(tbl, p, node, i) {
-		if (sdata && node->mpath->sdata != sdata)
-			continue;
 		if (j++ == idx) {
 			if (MPATH_EXPIRED(node->mpath)) {
 				spin_lock_bh(&node->mpath->state_lock);
@@ -408,15 +530,13 @@ struct mesh_path *mesh_path_lookup_by_idx(int idx, struct ieee80211_sub_if_data
  */
 int mesh_path_add_gate(struct mesh_path *mpath)
 {
-	struct mesh_table *tbl;
+	struct ieee80211_if_mesh *ifmsh = &mpath->sdata->u.mesh;
 	struct mpath_node *gate, *new_gate;
 	struct hlist_node *n;
 	int err;
 
 	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
-
-	hlist_for_each_entry_rcu(gate, n, tbl->known_gates, list)
+	hlist_for_each_entry_rcu(gate, n, &ifmsh->known_gates, list)
 		if (gate->mpath == mpath) {
 			err = -EEXIST;
 			goto err_rcu;
@@ -431,9 +551,9 @@ int mesh_path_add_gate(struct mesh_path *mpath)
 	mpath->is_gate = true;
 	mpath->sdata->u.mesh.num_gates++;
 	new_gate->mpath = mpath;
-	spin_lock_bh(&tbl->gates_lock);
-	hlist_add_head_rcu(&new_gate->list, tbl->known_gates);
-	spin_unlock_bh(&tbl->gates_lock);
+	spin_lock_bh(&ifmsh->gates_lock);
+	hlist_add_head_rcu(&new_gate->list, &ifmsh->known_gates);
+	spin_unlock_bh(&ifmsh->gates_lock);
 	rcu_read_unlock();
 	mpath_dbg(mpath->sdata,
 		  "Mesh path: Recorded new gate: %pM. %d known gates\n",
@@ -446,24 +566,24 @@ err_rcu:
 
 /**
  * mesh_gate_del - remove a mesh gate from the list of known gates
- * @tbl: table which holds our list of known gates
  * @mpath: gate mpath
  *
  * Returns: 0 on success
  *
  * Locking: must be called inside rcu_read_lock() section
  */
-static int mesh_gate_del(struct mesh_table *tbl, struct mesh_path *mpath)
+static int mesh_gate_del(struct mesh_path *mpath)
 {
+	struct ieee80211_if_mesh *ifmsh = &mpath->sdata->u.mesh;
 	struct mpath_node *gate;
 	struct hlist_node *p, *q;
 
-	hlist_for_each_entry_safe(gate, p, q, tbl->known_gates, list)
+	hlist_for_each_entry_safe(gate, p, q, &ifmsh->known_gates, list)
 		if (gate->mpath == mpath) {
-			spin_lock_bh(&tbl->gates_lock);
+			spin_lock_bh(&ifmsh->gates_lock);
 			hlist_del_rcu(&gate->list);
 			kfree_rcu(gate, rcu);
-			spin_unlock_bh(&tbl->gates_lock);
+			spin_unlock_bh(&ifmsh->gates_lock);
 			mpath->sdata->u.mesh.num_gates--;
 			mpath->is_gate = false;
 			mpath_dbg(mpath->sdata,
@@ -497,14 +617,13 @@ int mesh_path_add(u8 *dst, struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct ieee80211_local *local = sdata->local;
-	struct mesh_table *tbl;
-	struct mesh_path *mpath, *new_mpath;
-	struct mpath_node *node, *new_node;
+	struct mesh_table *tbl, *newtbl;
+	struct mesh_path *new_mpath;
+	struct mpath_node *new_node, *mirror_node = NULL;
 	struct hlist_head *bucket;
-	struct hlist_node *n;
-	int grow = 0;
+	bool grow = false;
 	int err = 0;
-	u32 hash_idx;
+	u32 hash_idx, new_idx;
 
 	if (ether_addr_equal(dst, sdata->vif.addr))
 		/* never add ourselves as neighbours */
@@ -525,7 +644,6 @@ int mesh_path_add(u8 *dst, struct ieee80211_sub_if_data *sdata)
 	if (!new_node)
 		goto err_node_alloc;
 
-	read_lock_bh(&pathtbl_resize_lock);
 	memcpy(new_mpath->dst, dst, ETH_ALEN);
 	eth_broadcast_addr(new_mpath->rann_snd_addr);
 	new_mpath->is_root = false;
@@ -539,39 +657,38 @@ int mesh_path_add(u8 *dst, struct ieee80211_sub_if_data *sdata)
 	spin_lock_init(&new_mpath->state_lock);
 	init_timer(&new_mpath->timer);
 
-	tbl = resize_dereference_mesh_paths();
-
-	hash_idx = mesh_table_hash(dst, sdata, tbl);
-	bucket = &tbl->hash_buckets[hash_idx];
-
-	spin_lock(&tbl->hashwlock[hash_idx]);
+	rcu_read_lock();
+	tbl = rcu_dereference(ifmsh->mesh_paths);
+	newtbl = mesh_table_lock(tbl, dst, &hash_idx, &new_idx);
 
+	bucket = newtbl ? &newtbl->hash_buckets[new_idx] :
+			  &tbl->hash_buckets[hash_idx];
 	err = -EEXIST;
-	hlist_for_each_entry(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(dst, mpath->dst))
-			goto err_exists;
-	}
+	if (mesh_bucket_find(bucket, dst))
+		goto err_unlock;
 
-	hlist_add_head_rcu(&new_node->list, bucket);
-	if (atomic_inc_return(&tbl->entries) >=
-	    tbl->mean_chain_len * (tbl->hash_mask + 1))
-		grow = 1;
+	err = -ENOMEM;
+	if (newtbl) {
+		mirror_node = kmalloc(sizeof(struct mpath_node), GFP_ATOMIC);
+		if (!mirror_node)
+			goto err_unlock;
+	}
 
-	mesh_paths_generation++;
+	grow = mesh_table_add(tbl, newtbl, hash_idx, new_idx,
+			      new_node, mirror_node);
+	ifmsh->mesh_paths_generation++;
 
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
+	mesh_table_unlock(tbl, newtbl, hash_idx, new_idx);
+	rcu_read_unlock();
 	if (grow) {
 		set_bit(MESH_WORK_GROW_MPATH_TABLE,  &ifmsh->wrkq_flags);
 		ieee80211_queue_work(&local->hw, &sdata->work);
 	}
 	return 0;
 
-err_exists:
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
+err_unlock:
+	mesh_table_unlock(tbl, newtbl, hash_idx, new_idx);
+	rcu_read_unlock();
 	kfree(new_node);
 err_node_alloc:
 	kfree(new_mpath);
@@ -580,66 +697,37 @@ err_path_alloc:
 	return err;
 }
 
-static void mesh_table_free_rcu(struct rcu_head *rcu)
-{
-	struct mesh_table *tbl = container_of(rcu, struct mesh_table, rcu_head);
-
-	mesh_table_free(tbl, false);
-}
-
-void mesh_mpath_table_grow(void)
+void mesh_mpath_table_grow(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *oldtbl, *newtbl;
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 
-	write_lock_bh(&pathtbl_resize_lock);
-	oldtbl = resize_dereference_mesh_paths();
-	newtbl = mesh_table_alloc(oldtbl->size_order + 1);
-	if (!newtbl)
-		goto out;
-	if (mesh_table_grow(oldtbl, newtbl) < 0) {
-		__mesh_table_free(newtbl);
-		goto out;
+	if (mesh_table_grow(sdata, &ifmsh->mesh_paths)) {
+		set_bit(MESH_WORK_GROW_MPATH_TABLE, &ifmsh->wrkq_flags);
+		ieee80211_queue_work(&sdata->local->hw, &sdata->work);
 	}
-	rcu_assign_pointer(mesh_paths, newtbl);
-
-	call_rcu(&oldtbl->rcu_head, mesh_table_free_rcu);
-
- out:
-	write_unlock_bh(&pathtbl_resize_lock);
 }
 
-void mesh_mpp_table_grow(void)
+void mesh_mpp_table_grow(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *oldtbl, *newtbl;
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 
-	write_lock_bh(&pathtbl_resize_lock);
-	oldtbl = resize_dereference_mpp_paths();
-	newtbl = mesh_table_alloc(oldtbl->size_order + 1);
-	if (!newtbl)
-		goto out;
-	if (mesh_table_grow(oldtbl, newtbl) < 0) {
-		__mesh_table_free(newtbl);
-		goto out;
+	if (mesh_table_grow(sdata, &ifmsh->mpp_paths)) {
+		set_bit(MESH_WORK_GROW_MPP_TABLE, &ifmsh->wrkq_flags);
+		ieee80211_queue_work(&sdata->local->hw, &sdata->work);
 	}
-	rcu_assign_pointer(mpp_paths, newtbl);
-	call_rcu(&oldtbl->rcu_head, mesh_table_free_rcu);
-
- out:
-	write_unlock_bh(&pathtbl_resize_lock);
 }
 
 int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata)
 {
 	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct ieee80211_local *local = sdata->local;
-	struct mesh_table *tbl;
-	struct mesh_path *mpath, *new_mpath;
-	struct mpath_node *node, *new_node;
+	struct mesh_table *tbl, *newtbl;
+	struct mesh_path *new_mpath;
+	struct mpath_node *new_node, *mirror_node = NULL;
 	struct hlist_head *bucket;
-	struct hlist_node *n;
-	int grow = 0;
+	bool grow = false;
 	int err = 0;
-	u32 hash_idx;
+	u32 hash_idx, new_idx;
 
 	if (ether_addr_equal(dst, sdata->vif.addr))
 		/* never add ourselves as neighbours */
@@ -657,7 +745,6 @@ int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata)
 	if (!new_node)
 		goto err_node_alloc;
 
-	read_lock_bh(&pathtbl_resize_lock);
 	memcpy(new_mpath->dst, dst, ETH_ALEN);
 	memcpy(new_mpath->mpp, mpp, ETH_ALEN);
 	new_mpath->sdata = sdata;
@@ -668,37 +755,37 @@ int mpp_path_add(u8 *dst, u8 *mpp, struct ieee80211_sub_if_data *sdata)
 	new_mpath->exp_time = jiffies;
 	spin_lock_init(&new_mpath->state_lock);
 
-	tbl = resize_dereference_mpp_paths();
-
-	hash_idx = mesh_table_hash(dst, sdata, tbl);
-	bucket = &tbl->hash_buckets[hash_idx];
-
-	spin_lock(&tbl->hashwlock[hash_idx]);
+	rcu_read_lock();
+	tbl = rcu_dereference(ifmsh->mpp_paths);
+	newtbl = mesh_table_lock(tbl, dst, &hash_idx, &new_idx);
 
+	bucket = newtbl ? &newtbl->hash_buckets[new_idx] :
+			  &tbl->hash_buckets[hash_idx];
 	err = -EEXIST;
-	hlist_for_each_entry(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(dst, mpath->dst))
-			goto err_exists;
+	if (mesh_bucket_find(bucket, dst))
+		goto err_unlock;
+
+	err = -ENOMEM;
+	if (newtbl) {
+		mirror_node = kmalloc(sizeof(struct mpath_node), GFP_ATOMIC);
+		if (!mirror_node)
+			goto err_unlock;
 	}
 
-	hlist_add_head_rcu(&new_node->list, bucket);
-	if (atomic_inc_return(&tbl->entries) >=
-	    tbl->mean_chain_len * (tbl->hash_mask + 1))
-		grow = 1;
+	grow = mesh_table_add(tbl, newtbl, hash_idx, new_idx,
+			      new_node, mirror_node);
 
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
+	mesh_table_unlock(tbl, newtbl, hash_idx, new_idx);
+	rcu_read_unlock();
 	if (grow) {
 		set_bit(MESH_WORK_GROW_MPP_TABLE,  &ifmsh->wrkq_flags);
 		ieee80211_queue_work(&local->hw, &sdata->work);
 	}
 	return 0;
 
-err_exists:
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
+err_unlock:
+	mesh_table_unlock(tbl, newtbl, hash_idx, new_idx);
+	rcu_read_unlock();
 	kfree(new_node);
 err_node_alloc:
 	kfree(new_mpath);
@@ -727,7 +814,7 @@ void mesh_plink_broken(struct sta_info *sta)
 	__le16 reason = cpu_to_le16(WLAN_REASON_MESH_PATH_DEST_UNREACHABLE);
 
 	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
+	tbl = rcu_dereference(sdata->u.mesh.mesh_paths);
 	for_each_mesh_entry(tbl, p, node, i) {
 		mpath = node->mpath;
 		if (rcu_dereference(mpath->next_hop) == sta &&
@@ -756,19 +843,64 @@ static void mesh_path_node_reclaim(struct rcu_head *rp)
 	kfree(node);
 }
 
-/* needs to be called with the corresponding hashwlock taken */
-static void __mesh_path_del(struct mesh_table *tbl, struct mpath_node *node)
+/*
+ * Needs to be called with the locks from mesh_table_lock() held. @node
+ * is in the bucket of @newtbl if that is set, and the copy of it in the
+ * bucket of @tbl is removed as well then.
+ */
+static void __mesh_path_del(struct mesh_table *tbl, struct mesh_table *newtbl,
+			    u32 hash_idx, struct mpath_node *node)
 {
 	struct mesh_path *mpath;
+	struct mpath_node *mirror;
+	struct hlist_node *n;
+
 	mpath = node->mpath;
 	spin_lock(&mpath->state_lock);
 	mpath->flags |= MESH_PATH_RESOLVING;
 	if (mpath->is_gate)
-		mesh_gate_del(tbl, mpath);
+		mesh_gate_del(mpath);
 	hlist_del_rcu(&node->list);
 	call_rcu(&node->rcu, mesh_path_node_reclaim);
 	spin_unlock(&mpath->state_lock);
-	atomic_dec(&tbl->entries);
+
+	if (!newtbl) {
+		atomic_dec(&tbl->entries);
+		return;
+	}
+
+	atomic_dec(&newtbl->entries);
+	hlist_for_each_entry(mirror, n, &tbl->hash_buckets[hash_idx], list)
+		if (mirror->mpath == mpath) {
+			hlist_del_rcu(&mirror->list);
+			kfree_rcu(mirror, rcu);
+			atomic_dec(&tbl->entries);
+			break;
+		}
+}
+
+/*
+ * Delete the path to @addr from @tbl; if @mpath is given, only if it is
+ * still that one. Must be called under RCU.
+ */
+static int mesh_table_del(struct mesh_table *tbl, const u8 *addr,
+			  struct mesh_path *mpath)
+{
+	struct mesh_table *newtbl;
+	struct mpath_node *node;
+	u32 hash_idx, new_idx;
+	int err = 0;
+
+	newtbl = mesh_table_lock(tbl, addr, &hash_idx, &new_idx);
+	node = mesh_bucket_find(newtbl ? &newtbl->hash_buckets[new_idx] :
+					 &tbl->hash_buckets[hash_idx], addr);
+	if (node && (!mpath || node->mpath == mpath))
+		__mesh_path_del(tbl, newtbl, hash_idx, node);
+	else
+		err = -ENXIO;
+	mesh_table_unlock(tbl, newtbl, hash_idx, new_idx);
+
+	return err;
 }
 
 /**
@@ -784,6 +916,7 @@ static void __mesh_path_del(struct mesh_table *tbl, struct mpath_node *node)
  */
 void mesh_path_flush_by_nexthop(struct sta_info *sta)
 {
+	struct ieee80211_if_mesh *ifmsh = &sta->sdata->u.mesh;
 	struct mesh_table *tbl;
 	struct mesh_path *mpath;
 	struct mpath_node *node;
@@ -791,22 +924,17 @@ void mesh_path_flush_by_nexthop(struct sta_info *sta)
 	int i;
 
 	rcu_read_lock();
-	read_lock_bh(&pathtbl_resize_lock);
-	tbl = resize_dereference_mesh_paths();
+	tbl = rcu_dereference(ifmsh->mesh_paths);
 	for_each_mesh_entry(tbl, p, node, i) {
 		mpath = node->mpath;
-		if (rcu_dereference(mpath->next_hop) == sta) {
-			spin_lock(&tbl->hashwlock[i]);
-			__mesh_path_del(tbl, node);
-			spin_unlock(&tbl->hashwlock[i]);
-		}
+		if (rcu_dereference(mpath->next_hop) == sta &&
+		    !mesh_table_del(tbl, mpath->dst, mpath))
+			ifmsh->mesh_paths_generation++;
 	}
-	read_unlock_bh(&pathtbl_resize_lock);
 	rcu_read_unlock();
 }
 
-static void table_flush_by_iface(struct mesh_table *tbl,
-				 struct ieee80211_sub_if_data *sdata)
+static void table_flush_by_iface(struct mesh_table *tbl)
 {
 	struct mesh_path *mpath;
 	struct mpath_node *node;
@@ -816,11 +944,7 @@ static void table_flush_by_iface(struct mesh_table *tbl,
 	WARN_ON(!rcu_read_lock_held());
 	for_each_mesh_entry(tbl, p, node, i) {
 		mpath = node->mpath;
-		if (mpath->sdata != sdata)
-			continue;
-		spin_lock_bh(&tbl->hashwlock[i]);
-		__mesh_path_del(tbl, node);
-		spin_unlock_bh(&tbl->hashwlock[i]);
+		mesh_table_del(tbl, mpath->dst, mpath);
 	}
 }
 
@@ -834,15 +958,10 @@ static void table_flush_by_iface(struct mesh_table *tbl,
  */
 void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *tbl;
-
 	rcu_read_lock();
-	read_lock_bh(&pathtbl_resize_lock);
-	tbl = resize_dereference_mesh_paths();
-	table_flush_by_iface(tbl, sdata);
-	tbl = resize_dereference_mpp_paths();
-	table_flush_by_iface(tbl, sdata);
-	read_unlock_bh(&pathtbl_resize_lock);
+	table_flush_by_iface(rcu_dereference(sdata->u.mesh.mesh_paths));
+	table_flush_by_iface(rcu_dereference(sdata->u.mesh.mpp_paths));
+	sdata->u.mesh.mesh_paths_generation++;
 	rcu_read_unlock();
 }
 
@@ -856,34 +975,13 @@ void mesh_path_flush_by_iface(struct ieee80211_sub_if_data *sdata)
  */
 int mesh_path_del(u8 *addr, struct ieee80211_sub_if_data *sdata)
 {
-	struct mesh_table *tbl;
-	struct mesh_path *mpath;
-	struct mpath_node *node;
-	struct hlist_head *bucket;
-	struct hlist_node *n;
-	int hash_idx;
-	int err = 0;
-
-	read_lock_bh(&pathtbl_resize_lock);
-	tbl = resize_dereference_mesh_paths();
-	hash_idx = mesh_table_hash(addr, sdata, tbl);
-	bucket = &tbl->hash_buckets[hash_idx];
-
-	spin_lock(&tbl->hashwlock[hash_idx]);
-	hlist_for_each_entry(node, n, bucket, list) {
-		mpath = node->mpath;
-		if (mpath->sdata == sdata &&
-		    ether_addr_equal(addr, mpath->dst)) {
-			__mesh_path_del(tbl, node);
-			goto enddel;
-		}
-	}
+	int err;
 
-	err = -ENXIO;
-enddel:
-	mesh_paths_generation++;
-	spin_unlock(&tbl->hashwlock[hash_idx]);
-	read_unlock_bh(&pathtbl_resize_lock);
+	rcu_read_lock();
+	err = mesh_table_del(rcu_dereference(sdata->u.mesh.mesh_paths),
+			     addr, NULL);
+	sdata->u.mesh.mesh_paths_generation++;
+	rcu_read_unlock();
 	return err;
 }
 
@@ -916,24 +1014,12 @@ int mesh_path_send_to_gates(struct mesh_path *mpath)
 {
 	struct ieee80211_sub_if_data *sdata = mpath->sdata;
 	struct hlist_node *n;
-	struct mesh_table *tbl;
 	struct mesh_path *from_mpath = mpath;
 	struct mpath_node *gate = NULL;
 	bool copy = false;
-	struct hlist_head *known_gates;
-
-	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
-	known_gates = tbl->known_gates;
-	rcu_read_unlock();
-
-	if (!known_gates)
-		return -EHOSTUNREACH;
+	struct hlist_head *known_gates = &sdata->u.mesh.known_gates;
 
 	hlist_for_each_entry_rcu(gate, n, known_gates, list) {
-		if (gate->mpath->sdata != sdata)
-			continue;
-
 		if (gate->mpath->flags & MESH_PATH_ACTIVE) {
 			mpath_dbg(sdata, "Forwarding to %pM\n", gate->mpath->dst);
 			mesh_path_move_to_queue(gate->mpath, from_mpath, copy);
@@ -946,11 +1032,10 @@ int mesh_path_send_to_gates(struct mesh_path *mpath)
 		}
 	}
 
-	hlist_for_each_entry_rcu(gate, n, known_gates, list)
-		if (gate->mpath->sdata == sdata) {
-			mpath_dbg(sdata, "Sending to %pM\n", gate->mpath->dst);
-			mesh_path_tx_pending(gate->mpath);
-		}
+	hlist_for_each_entry_rcu(gate, n, known_gates, list) {
+		mpath_dbg(sdata, "Sending to %pM\n", gate->mpath->dst);
+		mesh_path_tx_pending(gate->mpath);
+	}
 
 	return (from_mpath == mpath) ? -EHOSTUNREACH : 0;
 }
@@ -1033,16 +1118,19 @@ static int mesh_path_node_copy(struct hlist_node *p, struct mesh_table *newtbl)
 	node = hlist_entry(p, struct mpath_node, list);
 	mpath = node->mpath;
 	new_node->mpath = mpath;
-	hash_idx = mesh_table_hash(mpath->dst, mpath->sdata, newtbl);
+	hash_idx = mesh_table_hash(mpath->dst, newtbl);
+	spin_lock(&newtbl->hashwlock[hash_idx]);
 	hlist_add_head(&new_node->list,
 			&newtbl->hash_buckets[hash_idx]);
+	spin_unlock(&newtbl->hashwlock[hash_idx]);
+	atomic_inc(&newtbl->entries);
 	return 0;
 }
 
-int mesh_pathtbl_init(void)
+int mesh_pathtbl_init(struct ieee80211_sub_if_data *sdata)
 {
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
 	struct mesh_table *tbl_path, *tbl_mpp;
-	int ret;
 
 	tbl_path = mesh_table_alloc(INIT_PATHS_SIZE_ORDER);
 	if (!tbl_path)
@@ -1050,40 +1138,25 @@ int mesh_pathtbl_init(void)
 	tbl_path->free_node = &mesh_path_node_free;
 	tbl_path->copy_node = &mesh_path_node_copy;
 	tbl_path->mean_chain_len = MEAN_CHAIN_LEN;
-	tbl_path->known_gates = kzalloc(sizeof(struct hlist_head), GFP_ATOMIC);
-	if (!tbl_path->known_gates) {
-		ret = -ENOMEM;
-		goto free_path;
-	}
-	INIT_HLIST_HEAD(tbl_path->known_gates);
-
 
 	tbl_mpp = mesh_table_alloc(INIT_PATHS_SIZE_ORDER);
 	if (!tbl_mpp) {
-		ret = -ENOMEM;
-		goto free_path;
+		mesh_table_free(tbl_path, true);
+		return -ENOMEM;
 	}
 	tbl_mpp->free_node = &mesh_path_node_free;
 	tbl_mpp->copy_node = &mesh_path_node_copy;
 	tbl_mpp->mean_chain_len = MEAN_CHAIN_LEN;
-	tbl_mpp->known_gates = kzalloc(sizeof(struct hlist_head), GFP_ATOMIC);
-	if (!tbl_mpp->known_gates) {
-		ret = -ENOMEM;
-		goto free_mpp;
-	}
-	INIT_HLIST_HEAD(tbl_mpp->known_gates);
+
+	INIT_HLIST_HEAD(&ifmsh->known_gates);
+	spin_lock_init(&ifmsh->gates_lock);
+	ifmsh->mesh_paths_generation = 0;
 
 	/* Need no locking since this is during init */
-	RCU_INIT_POINTER(mesh_paths, tbl_path);
-	RCU_INIT_POINTER(mpp_paths, tbl_mpp);
+	RCU_INIT_POINTER(ifmsh->mesh_paths, tbl_path);
+	RCU_INIT_POINTER(ifmsh->mpp_paths, tbl_mpp);
 
 	return 0;
-
-free_mpp:
-	mesh_table_free(tbl_mpp, true);
-free_path:
-	mesh_table_free(tbl_path, true);
-	return ret;
 }
 
 void mesh_path_expire(struct ieee80211_sub_if_data *sdata)
@@ -1095,10 +1168,8 @@ void mesh_path_expire(struct ieee80211_sub_if_data *sdata)
 	int i;
 
 	rcu_read_lock();
-	tbl = rcu_dereference(mesh_paths);
+	tbl = rcu_dereference(sdata->u.mesh.mesh_paths);
 	for_each_mesh_entry(tbl, p, node, i) {
-		if (node->mpath->sdata != sdata)
-			continue;
 		mpath = node->mpath;
 		if ((!(mpath->flags & MESH_PATH_RESOLVING)) &&
 		    (!(mpath->flags & MESH_PATH_FIXED)) &&
@@ -1108,9 +1179,35 @@ void mesh_path_expire(struct ieee80211_sub_if_data *sdata)
 	rcu_read_unlock();
 }
 
-void mesh_pathtbl_unregister(void)
+static void mesh_table_unregister(struct mesh_table __rcu **tblp)
 {
 	/* no need for locking during exit path */
-	mesh_table_free(rcu_dereference_protected(mesh_paths, 1), true);
-	mesh_table_free(rcu_dereference_protected(mpp_paths, 1), true);
+	struct mesh_table *tbl = rcu_dereference_protected(*tblp, 1);
+	struct mesh_table *newtbl;
+
+	if (!tbl)
+		return;
+
+	newtbl = mesh_table_resize_dereference(tbl);
+
+	/* a table being grown only has copies of the nodes */
+	if (newtbl)
+		mesh_table_free(newtbl, false);
+	mesh_table_free(tbl, true);
+	RCU_INIT_POINTER(*tblp, NULL);
+}
+
+void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata)
+{
+	struct ieee80211_if_mesh *ifmsh = &sdata->u.mesh;
+	struct mpath_node *gate;
+	struct hlist_node *p, *q;
+
+	mesh_table_unregister(&ifmsh->mesh_paths);
+	mesh_table_unregister(&ifmsh->mpp_paths);
+
+	hlist_for_each_entry_safe(gate, p, q, &ifmsh->known_gates, list) {
+		hlist_del(&gate->list);
+		kfree(gate);
+	}
 }
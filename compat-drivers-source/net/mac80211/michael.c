@@ -8,6 +8,7 @@
  */
 #include <linux/types.h>
 #include <linux/bitops.h>
+#include <linux/skbuff.h>
 #include <linux/ieee80211.h>
 #include <asm/unaligned.h>
 
@@ -41,6 +42,8 @@ static void michael_mic_hdr(struct michael_mic_ctx *mctx, const u8 *key,
 
 	mctx->l = get_unaligned_le32(key);
 	mctx->r = get_unaligned_le32(key + 4);
+	mctx->pending = 0;
+	mctx->pending_len = 0;
 
 	/*
 	 * A pseudo header (DA, SA, Priority, 0, 0, 0) is used in Michael MIC
@@ -53,34 +56,81 @@ static void michael_mic_hdr(struct michael_mic_ctx *mctx, const u8 *key,
 	michael_block(mctx, tid);
 }
 
+/*
+ * Feed data into the MIC, which may come in chunks of any size. The
+ * data words are chained through the block function, so the only thing
+ * to gain per word is not going through the partial word handling.
+ */
+static void michael_update(struct michael_mic_ctx *mctx,
+			   const u8 *data, size_t len)
+{
+	/* complete a word begun in the previous chunk */
+	while (mctx->pending_len && len) {
+		mctx->pending |= (u32)*data++ << (8 * mctx->pending_len);
+		len--;
+		if (++mctx->pending_len == 4) {
+			michael_block(mctx, mctx->pending);
+			mctx->pending = 0;
+			mctx->pending_len = 0;
+		}
+	}
+
+	for (; len >= 16; data += 16, len -= 16) {
+		michael_block(mctx, get_unaligned_le32(data));
+		michael_block(mctx, get_unaligned_le32(data + 4));
+		michael_block(mctx, get_unaligned_le32(data + 8));
+		michael_block(mctx, get_unaligned_le32(data + 12));
+	}
+
+	for (; len >= 4; data += 4, len -= 4)
+		michael_block(mctx, get_unaligned_le32(data));
+
+	while (len--)
+		mctx->pending |= (u32)*data++ << (8 * mctx->pending_len++);
+}
+
+static void michael_final(struct michael_mic_ctx *mctx, u8 *mic)
+{
+	/* Partial block of 0..3 bytes and padding: 0x5a + 4..7 zeros to make
+	 * total length a multiple of 4. */
+	michael_block(mctx, mctx->pending | (0x5a << (8 * mctx->pending_len)));
+	michael_block(mctx, 0);
+
+	put_unaligned_le32(mctx->l, mic);
+	put_unaligned_le32(mctx->r, mic + 4);
+}
+
 void michael_mic(const u8 *key, struct ieee80211_hdr *hdr,
 		 const u8 *data, size_t data_len, u8 *mic)
 {
-	u32 val;
-	size_t block, blocks, left;
 	struct michael_mic_ctx mctx;
 
 	michael_mic_hdr(&mctx, key, hdr);
+	michael_update(&mctx, data, data_len);
+	michael_final(&mctx, mic);
+}
 
-	/* Real data */
-	blocks = data_len / 4;
-	left = data_len % 4;
+/*
+ * Compute the MIC over @len bytes of @skb starting at @offset, which may
+ * span page fragments and a frag_list (as left by defragmentation).
+ */
+void michael_mic_skb(const u8 *key, struct ieee80211_hdr *hdr,
+		     struct sk_buff *skb, unsigned int offset,
+		     unsigned int len, u8 *mic)
+{
+	struct michael_mic_ctx mctx;
+	struct skb_seq_state st;
+	unsigned int consumed = 0, n;
+	const u8 *data;
 
-	for (block = 0; block < blocks; block++)
-		michael_block(&mctx, get_unaligned_le32(&data[block * 4]));
+	michael_mic_hdr(&mctx, key, hdr);
 
-	/* Partial block of 0..3 bytes and padding: 0x5a + 4..7 zeros to make
-	 * total length a multiple of 4. */
-	val = 0x5a;
-	while (left > 0) {
-		val <<= 8;
-		left--;
-		val |= data[blocks * 4 + left];
+	skb_prepare_seq_read(skb, offset, offset + len, &st);
+	while ((n = skb_seq_read(consumed, &data, &st)) != 0) {
+		michael_update(&mctx, data, n);
+		consumed += n;
 	}
+	skb_abort_seq_read(&st);
 
-	michael_block(&mctx, val);
-	michael_block(&mctx, 0);
-
-	put_unaligned_le32(mctx.l, mic);
-	put_unaligned_le32(mctx.r, mic + 4);
+	michael_final(&mctx, mic);
 }
@@ -11,14 +11,21 @@
 #define MICHAEL_H
 
 #include <linux/types.h>
+#include <linux/skbuff.h>
 
 #define MICHAEL_MIC_LEN 8
 
 struct michael_mic_ctx {
 	u32 l, r;
+	/* bytes left over from the last chunk, and their number */
+	u32 pending;
+	unsigned int pending_len;
 };
 
 void michael_mic(const u8 *key, struct ieee80211_hdr *hdr,
 		 const u8 *data, size_t data_len, u8 *mic);
+void michael_mic_skb(const u8 *key, struct ieee80211_hdr *hdr,
+		     struct sk_buff *skb, unsigned int offset,
+		     unsigned int len, u8 *mic);
 
 #endif /* MICHAEL_H */
@@ -20,6 +20,7 @@
 #include <linux/rtnetlink.h>
 #include <linux/pm_qos.h>
 #include <linux/crc32.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <net/mac80211.h>
@@ -2522,6 +2523,75 @@ static const u64 care_about_ies =
 	(1ULL << WLAN_EID_HT_CAPABILITY) |
 	(1ULL << WLAN_EID_HT_OPERATION);
 
+/*
+ * Hash the beacon interval, capabilities and IEs of a beacon, leaving out
+ * the TIM since it changes with every beacon, and find the TIM on the way.
+ * This only walks the element headers, which is much cheaper than parsing
+ * them. Returns false if the IEs are malformed.
+ */
+static bool ieee80211_beacon_ie_hash(struct ieee80211_mgmt *mgmt, size_t len,
+				     u32 *hash, struct ieee80211_tim_ie **tim,
+				     u8 *tim_len)
+{
+	u8 *start = mgmt->u.beacon.variable;
+	u8 *pos = start, *end = (u8 *)mgmt + len;
+	u32 h;
+
+	h = jhash(&mgmt->u.beacon.beacon_int, 4, 0);
+	*tim = NULL;
+	*tim_len = 0;
+
+	while (end - pos >= 2) {
+		u8 id = pos[0], elen = pos[1];
+
+		if (elen > end - pos - 2)
+			return false;
+
+		if (id == WLAN_EID_TIM) {
+			h = jhash(start, pos - start, h);
+			start = pos + 2 + elen;
+			if (!*tim) {
+				*tim = (void *)(pos + 2);
+				*tim_len = elen;
+			}
+		}
+		pos += 2 + elen;
+	}
+
+	*hash = jhash(start, end - start, h);
+	return true;
+}
+
+static void ieee80211_rx_beacon_tim(struct ieee80211_sub_if_data *sdata,
+				    struct ieee80211_tim_ie *tim, u8 tim_len)
+{
+	struct ieee80211_local *local = sdata->local;
+
+	if (!(local->hw.flags & IEEE80211_HW_PS_NULLFUNC_STACK) ||
+	    !ieee80211_check_tim(tim, tim_len, sdata->u.mgd.aid))
+		return;
+
+	if (local->hw.conf.dynamic_ps_timeout > 0) {
+		if (local->hw.conf.flags & IEEE80211_CONF_PS) {
+			local->hw.conf.flags &= ~IEEE80211_CONF_PS;
+			ieee80211_hw_config(local, IEEE80211_CONF_CHANGE_PS);
+		}
+		ieee80211_send_nullfunc(local, sdata, 0);
+	} else if (!local->pspolling && sdata->u.mgd.powersave) {
+		local->pspolling = true;
+
+		/*
+		 * Here is assumed that the driver will be
+		 * able to send ps-poll frame and receive a
+		 * response even though power save mode is
+		 * enabled, but some drivers might require
+		 * to disable power save here. This needs
+		 * to be investigated.
+		 */
+		ieee80211_send_pspoll(local, sdata);
+	}
+}
+
 static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 				     struct ieee80211_mgmt *mgmt,
 				     size_t len,
@@ -2537,8 +2607,10 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	u32 changed = 0;
 	bool erp_valid;
 	u8 erp_value = 0;
-	u32 ncrc;
-	u8 *bssid;
+	u32 ncrc, hash = 0;
+	bool hash_valid;
+	struct ieee80211_tim_ie *tim;
+	u8 *bssid, tim_len;
 
 	lockdep_assert_held(&ifmgd->mtx);
 
@@ -2660,38 +2732,26 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 	 */
 	ieee80211_sta_reset_beacon_monitor(sdata);
 
+	/*
+	 * Most beacons only differ from the previous one in the TIM, don't
+	 * parse those. The P2P attributes are in the hashed IEs as well.
+	 */
+	hash_valid = ieee80211_beacon_ie_hash(mgmt, len, &hash,
+					      &tim, &tim_len);
+	if (hash_valid && ifmgd->beacon_ie_hash_valid &&
+	    ifmgd->beacon_crc_valid && hash == ifmgd->beacon_ie_hash) {
+		ifmgd->beacon_parses_avoided++;
+		ieee80211_rx_beacon_tim(sdata, tim, tim_len);
+		return;
+	}
+
+	ifmgd->beacon_parses++;
 	ncrc = crc32_be(0, (void *)&mgmt->u.beacon.beacon_int, 4);
 	ncrc = ieee802_11_parse_elems_crc(mgmt->u.beacon.variable,
 					  len - baselen, &elems,
 					  care_about_ies, ncrc);
 
-	if (local->hw.flags & IEEE80211_HW_PS_NULLFUNC_STACK) {
-		bool directed_tim = ieee80211_check_tim(elems.tim,
-							elems.tim_len,
-							ifmgd->aid);
-		if (directed_tim) {
-			if (local->hw.conf.dynamic_ps_timeout > 0) {
-				if (local->hw.conf.flags & IEEE80211_CONF_PS) {
-					local->hw.conf.flags &= ~IEEE80211_CONF_PS;
-					ieee80211_hw_config(local,
-							    IEEE80211_CONF_CHANGE_PS);
-				}
-				ieee80211_send_nullfunc(local, sdata, 0);
-			} else if (!local->pspolling && sdata->u.mgd.powersave) {
-				local->pspolling = true;
-
-				/*
-				 * Here is assumed that the driver will be
-				 * able to send ps-poll frame and receive a
-				 * response even though power save mode is
-				 * enabled, but some drivers might require
-				 * to disable power save here. This needs
-				 * to be investigated.
-				 */
-				ieee80211_send_pspoll(local, sdata);
-			}
-		}
-	}
+	ieee80211_rx_beacon_tim(sdata, elems.tim, elems.tim_len);
 
 	if (sdata->vif.p2p) {
 		u8 noa[2];
@@ -2714,6 +2774,9 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_sub_if_data *sdata,
 		}
 	}
 
+	ifmgd->beacon_ie_hash = hash;
+	ifmgd->beacon_ie_hash_valid = hash_valid;
+
 	if (ncrc == ifmgd->beacon_crc && ifmgd->beacon_crc_valid)
 		return;
 	ifmgd->beacon_crc = ncrc;
@@ -148,6 +148,47 @@ static const struct file_operations rcname_ops = {
 	.open = simple_open,
 	.llseek = default_llseek,
 };
+
+#ifdef CONFIG_MAC80211_DEBUG_COUNTERS
+static ssize_t rctiming_read(struct file *file, char __user *userbuf,
+			     size_t count, loff_t *ppos)
+{
+	struct rate_control_ref *ref = file->private_data;
+	struct rate_control_timing *t[] = {
+		&ref->get_rate_time, &ref->tx_status_time,
+	};
+	static const char * const names[] = { "get_rate", "tx_status" };
+	char buf[128];
+	int i, len = 0;
+
+	for (i = 0; i < ARRAY_SIZE(t); i++) {
+		u32 calls = t[i]->calls;
+
+		len += scnprintf(buf + len, sizeof(buf) - len,
+				 "%s: %u calls, %llu ns/call\n", names[i],
+				 calls, calls ? div_u64(t[i]->ns, calls) : 0);
+	}
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, len);
+}
+
+static ssize_t rctiming_write(struct file *file, const char __user *userbuf,
+			      size_t count, loff_t *ppos)
+{
+	struct rate_control_ref *ref = file->private_data;
+
+	memset(&ref->get_rate_time, 0, sizeof(ref->get_rate_time));
+	memset(&ref->tx_status_time, 0, sizeof(ref->tx_status_time));
+	return count;
+}
+
+static const struct file_operations rctiming_ops = {
+	.read = rctiming_read,
+	.write = rctiming_write,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+#endif
 #endif
 
 static struct rate_control_ref *rate_control_alloc(const char *name,
@@ -156,7 +197,7 @@ static struct rate_control_ref *rate_control_alloc(const char *name,
 	struct dentry *debugfsdir = NULL;
 	struct rate_control_ref *ref;
 
-	ref = kmalloc(sizeof(struct rate_control_ref), GFP_KERNEL);
+	ref = kzalloc(sizeof(struct rate_control_ref), GFP_KERNEL);
 	if (!ref)
 		goto fail_ref;
 	ref->local = local;
@@ -168,6 +209,9 @@ static struct rate_control_ref *rate_control_alloc(const char *name,
 	debugfsdir = debugfs_create_dir("rc", local->hw.wiphy->debugfsdir);
 	local->debugfs.rcdir = debugfsdir;
 	debugfs_create_file("name", 0400, debugfsdir, ref, &rcname_ops);
+#ifdef CONFIG_MAC80211_DEBUG_COUNTERS
+	debugfs_create_file("timing", 0600, debugfsdir, ref, &rctiming_ops);
+#endif
 #endif
 
 	ref->priv = ref->ops->alloc(&local->hw, debugfsdir);
@@ -437,6 +481,7 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 	int i;
 	u32 mask;
 	u8 mcs_mask[IEEE80211_HT_MCS_MASK_LEN];
+	u64 start;
 
 	if (sta && test_sta_flag(sta, WLAN_STA_RATE_CONTROL)) {
 		ista = &sta->sta;
@@ -452,7 +497,9 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 	if (sdata->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL)
 		return;
 
+	start = rate_control_timing_start();
 	ref->ops->get_rate(ref->priv, ista, priv_sta, txrc);
+	rate_control_timing_end(&ref->get_rate_time, start);
 
 	/*
 	 * Try to enforce the rateidx mask the user wanted. skip this if the
@@ -13,18 +13,44 @@
 
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/ktime.h>
 #include <linux/types.h>
 #include <net/mac80211.h>
 #include "ieee80211_i.h"
 #include "sta_info.h"
 #include "driver-ops.h"
 
+/* CPU time spent in one of the algorithm's callbacks */
+struct rate_control_timing {
+	u64 ns;
+	u32 calls;
+};
+
 struct rate_control_ref {
 	struct ieee80211_local *local;
 	struct rate_control_ops *ops;
 	void *priv;
+	struct rate_control_timing get_rate_time, tx_status_time;
 };
 
+static inline u64 rate_control_timing_start(void)
+{
+#ifdef CONFIG_MAC80211_DEBUG_COUNTERS
+	return ktime_to_ns(ktime_get());
+#else
+	return 0;
+#endif
+}
+
+static inline void rate_control_timing_end(struct rate_control_timing *t,
+					   u64 start)
+{
+#ifdef CONFIG_MAC80211_DEBUG_COUNTERS
+	t->ns += ktime_to_ns(ktime_get()) - start;
+	t->calls++;
+#endif
+}
+
 void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 			   struct sta_info *sta,
 			   struct ieee80211_tx_rate_control *txrc);
@@ -37,11 +63,14 @@ static inline void rate_control_tx_status(struct ieee80211_local *local,
 	struct rate_control_ref *ref = local->rate_ctrl;
 	struct ieee80211_sta *ista = &sta->sta;
 	void *priv_sta = sta->rate_ctrl_priv;
+	u64 start;
 
 	if (!ref || !test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
 		return;
 
+	start = rate_control_timing_start();
 	ref->ops->tx_status(ref->priv, sband, ista, priv_sta, skb);
+	rate_control_timing_end(&ref->tx_status_time, start);
 }
 
 
@@ -127,24 +127,33 @@ minstrel_get_ratestats(struct minstrel_ht_sta *mi, int index)
 
 
 /*
- * Recalculate success probabilities and counters for a rate using EWMA
+ * Number of statistics updates since a rate was last attempted
+ */
+static inline unsigned int
+minstrel_ht_sample_skipped(struct minstrel_ht_sta *mi,
+			   struct minstrel_rate_stats *mr)
+{
+	return mi->stats_seq - mr->stats_seq;
+}
+
+/*
+ * Recalculate success probabilities and counters for a rate using EWMA.
+ * Only called for rates attempted since the last update, the others keep
+ * their probability and count as skipped through stats_seq.
  */
 static void
-minstrel_calc_rate_ewma(struct minstrel_rate_stats *mr)
+minstrel_calc_rate_ewma(struct minstrel_ht_sta *mi,
+			struct minstrel_rate_stats *mr)
 {
-	if (unlikely(mr->attempts > 0)) {
-		mr->sample_skipped = 0;
-		mr->cur_prob = MINSTREL_FRAC(mr->success, mr->attempts);
-		if (!mr->att_hist)
-			mr->probability = mr->cur_prob;
-		else
-			mr->probability = minstrel_ewma(mr->probability,
-				mr->cur_prob, EWMA_LEVEL);
-		mr->att_hist += mr->attempts;
-		mr->succ_hist += mr->success;
-	} else {
-		mr->sample_skipped++;
-	}
+	mr->stats_seq = mi->stats_seq;
+	mr->cur_prob = MINSTREL_FRAC(mr->success, mr->attempts);
+	if (!mr->att_hist)
+		mr->probability = mr->cur_prob;
+	else
+		mr->probability = minstrel_ewma(mr->probability,
+			mr->cur_prob, EWMA_LEVEL);
+	mr->att_hist += mr->attempts;
+	mr->succ_hist += mr->success;
 	mr->last_success = mr->success;
 	mr->last_attempts = mr->attempts;
 	mr->success = 0;
@@ -173,9 +182,66 @@ minstrel_ht_calc_tp(struct minstrel_ht_sta *mi, int group, int rate)
 	mr->cur_tp = MINSTREL_TRUNC((1000000 / usecs) * mr->probability);
 }
 
+/*
+ * Select the primary rates of a group from the current rate statistics
+ */
+static void
+minstrel_ht_group_select(struct minstrel_ht_sta *mi, int group)
+{
+	struct minstrel_mcs_group_data *mg = &mi->groups[group];
+	struct minstrel_rate_stats *mr;
+	int cur_prob = 0, cur_prob_tp = 0, cur_tp = 0, cur_tp2 = 0;
+	int i, index;
+
+	mg->max_tp_rate = 0;
+	mg->max_tp_rate2 = 0;
+	mg->max_prob_rate = 0;
+
+	for (i = 0; i < MCS_GROUP_RATES; i++) {
+		if (!(mg->supported & BIT(i)))
+			continue;
+
+		mr = &mg->rates[i];
+		index = MCS_GROUP_RATES * group + i;
+
+		if (!mr->cur_tp)
+			continue;
+
+		/* ignore the lowest rate of each single-stream group */
+		if (!i && minstrel_mcs_groups[group].streams == 1)
+			continue;
+
+		if ((mr->cur_tp > cur_prob_tp && mr->probability >
+		     MINSTREL_FRAC(3, 4)) || mr->probability > cur_prob) {
+			mg->max_prob_rate = index;
+			cur_prob = mr->probability;
+			cur_prob_tp = mr->cur_tp;
+		}
+
+		if (mr->cur_tp > cur_tp) {
+			swap(index, mg->max_tp_rate);
+			cur_tp = mr->cur_tp;
+			mr = minstrel_get_ratestats(mi, index);
+		}
+
+		if (index >= mg->max_tp_rate)
+			continue;
+
+		if (mr->cur_tp > cur_tp2) {
+			mg->max_tp_rate2 = index;
+			cur_tp2 = mr->cur_tp;
+		}
+	}
+}
+
 /*
  * Update rate statistics and select new primary rates
  *
+ * Only the rates attempted since the last update get new statistics, and
+ * only their groups need to select new primary rates. Throughput and
+ * retry counts of all rates depend on the average A-MPDU length though,
+ * so everything is recalculated when that changes.
+ *
  * Rules for rate selection:
  *  - max_prob_rate must use only one stream, as a tradeoff between delivery
  *    probability and throughput during strong fluctuations
@@ -188,15 +254,21 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	struct minstrel_mcs_group_data *mg;
 	struct minstrel_rate_stats *mr;
 	int cur_prob, cur_prob_tp, cur_tp, cur_tp2;
-	int group, i, index;
+	unsigned int ampdu_len;
+	bool update_all = false;
+	u8 updated, recalc;
+	int group, i;
 
 	if (mi->ampdu_packets > 0) {
+		ampdu_len = MINSTREL_TRUNC(mi->avg_ampdu_len);
 		mi->avg_ampdu_len = minstrel_ewma(mi->avg_ampdu_len,
 			MINSTREL_FRAC(mi->ampdu_len, mi->ampdu_packets), EWMA_LEVEL);
 		mi->ampdu_len = 0;
 		mi->ampdu_packets = 0;
+		update_all = MINSTREL_TRUNC(mi->avg_ampdu_len) != ampdu_len;
 	}
 
+	mi->stats_seq++;
 	mi->sample_slow = 0;
 	mi->sample_count = 0;
 	mi->max_tp_rate = 0;
@@ -204,58 +276,30 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	mi->max_prob_rate = 0;
 
 	for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++) {
-		cur_prob = 0;
-		cur_prob_tp = 0;
-		cur_tp = 0;
-		cur_tp2 = 0;
-
 		mg = &mi->groups[group];
 		if (!mg->supported)
 			continue;
 
-		mg->max_tp_rate = 0;
-		mg->max_tp_rate2 = 0;
-		mg->max_prob_rate = 0;
 		mi->sample_count++;
 
+		updated = mg->updated & mg->supported;
+		mg->updated = 0;
+		recalc = update_all ? mg->supported : updated;
+		if (!recalc)
+			continue;
+
 		for (i = 0; i < MCS_GROUP_RATES; i++) {
-			if (!(mg->supported & BIT(i)))
+			if (!(recalc & BIT(i)))
 				continue;
 
 			mr = &mg->rates[i];
 			mr->retry_updated = false;
-			index = MCS_GROUP_RATES * group + i;
-			minstrel_calc_rate_ewma(mr);
+			if ((updated & BIT(i)) && mr->attempts)
+				minstrel_calc_rate_ewma(mi, mr);
 			minstrel_ht_calc_tp(mi, group, i);
-
-			if (!mr->cur_tp)
-				continue;
-
-			/* ignore the lowest rate of each single-stream group */
-			if (!i && minstrel_mcs_groups[group].streams == 1)
-				continue;
-
-			if ((mr->cur_tp > cur_prob_tp && mr->probability >
-			     MINSTREL_FRAC(3, 4)) || mr->probability > cur_prob) {
-				mg->max_prob_rate = index;
-				cur_prob = mr->probability;
-				cur_prob_tp = mr->cur_tp;
-			}
-
-			if (mr->cur_tp > cur_tp) {
-				swap(index, mg->max_tp_rate);
-				cur_tp = mr->cur_tp;
-				mr = minstrel_get_ratestats(mi, index);
-			}
-
-			if (index >= mg->max_tp_rate)
-				continue;
-
-			if (mr->cur_tp > cur_tp2) {
-				mg->max_tp_rate2 = index;
-				cur_tp2 = mr->cur_tp;
-			}
 		}
+
+		minstrel_ht_group_select(mi, group);
 	}
 
 	/* try to sample up to half of the available rates during each interval */
@@ -426,6 +470,7 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 
 		group = minstrel_ht_get_group_idx(&ar[i]);
 		rate = &mi->groups[group].rates[ar[i].idx % 8];
+		mi->groups[group].updated |= BIT(ar[i].idx % 8);
 
 		if (last)
 			rate->success += info->status.ampdu_ack_len;
@@ -585,7 +630,7 @@ minstrel_get_sample_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	 */
 	if (minstrel_get_duration(sample_idx) >
 	    minstrel_get_duration(mi->max_tp_rate)) {
-		if (mr->sample_skipped < 20)
+		if (minstrel_ht_sample_skipped(mi, mr) < 20)
 			return -1;
 
 		if (mi->sample_slow++ > 2)
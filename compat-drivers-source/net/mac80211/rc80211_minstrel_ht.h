@@ -31,26 +31,35 @@ struct mcs_group {
 
 extern const struct mcs_group minstrel_mcs_groups[];
 
+/*
+ * Fields used for every frame (rate selection and TX status) come first,
+ * the ones only needed by the statistics update and debugfs last.
+ */
 struct minstrel_rate_stats {
-	/* current / last sampling period attempts/success counters */
-	unsigned int attempts, last_attempts;
-	unsigned int success, last_success;
+	/* current sampling period attempts/success counters */
+	unsigned int attempts, success;
 
-	/* total attempts/success counters */
-	u64 att_hist, succ_hist;
+	/* packet delivery probability (EWMA) */
+	unsigned int probability;
 
 	/* current throughput */
 	unsigned int cur_tp;
 
-	/* packet delivery probabilities */
-	unsigned int cur_prob, probability;
-
 	/* maximum retry counts */
-	unsigned int retry_count;
-	unsigned int retry_count_rtscts;
+	u8 retry_count;
+	u8 retry_count_rtscts;
 
 	bool retry_updated;
-	u8 sample_skipped;
+
+	/* statistics update this rate was last attempted before */
+	u32 stats_seq;
+
+	/* last sampling period attempts/success counters and probability */
+	unsigned int last_attempts, last_success;
+	unsigned int cur_prob;
+
+	/* total attempts/success counters */
+	u64 att_hist, succ_hist;
 };
 
 struct minstrel_mcs_group_data {
@@ -60,6 +69,9 @@ struct minstrel_mcs_group_data {
 	/* bitfield of supported MCS rates of this group */
 	u8 supported;
 
+	/* bitfield of rates attempted since the last statistics update */
+	u8 updated;
+
 	/* selected primary rates */
 	unsigned int max_tp_rate;
 	unsigned int max_tp_rate2;
@@ -89,6 +101,9 @@ struct minstrel_ht_sta {
 	/* time of last status update */
 	unsigned long stats_update;
 
+	/* number of statistics updates so far */
+	u32 stats_seq;
+
 	/* overhead time in usec for each frame */
 	unsigned int overhead;
 	unsigned int overhead_rtscts;
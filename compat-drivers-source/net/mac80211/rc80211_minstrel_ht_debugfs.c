@@ -55,6 +55,8 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 		for (j = 0; j < MCS_GROUP_RATES; j++) {
 			struct minstrel_rate_stats *mr = &mi->groups[i].rates[j];
 			int idx = i * MCS_GROUP_RATES + j;
+			/* last period counters are stale for skipped rates */
+			bool last = mr->stats_seq == mi->stats_seq;
 
 			if (!(mi->groups[i].supported & BIT(j)))
 				continue;
@@ -76,8 +78,8 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 					tp / 10, tp % 10,
 					eprob / 10, eprob % 10,
 					prob / 10, prob % 10,
-					mr->last_success,
-					mr->last_attempts,
+					last ? mr->last_success : 0,
+					last ? mr->last_attempts : 0,
 					(unsigned long long)mr->succ_hist,
 					(unsigned long long)mr->att_hist);
 		}
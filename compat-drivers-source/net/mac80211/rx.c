@@ -358,6 +358,22 @@ ieee80211_add_rx_radiotap_header(struct ieee80211_local *local,
  * returns a cleaned-up SKB that no longer includes the FCS nor the
  * radiotap header the driver might have added.
  */
+static void ieee80211_rx_stats(struct ieee80211_local *local,
+			       struct net_device *dev, unsigned int len)
+{
+	spin_lock(&local->rx_stats_lock);
+	dev->stats.rx_packets++;
+	dev->stats.rx_bytes += len;
+	spin_unlock(&local->rx_stats_lock);
+}
+
+#define IEEE80211_RX_MESH_CTR_INC(local, msh, name)		\
+	do {							\
+		spin_lock(&(local)->rx_stats_lock);		\
+		IEEE80211_IFSTA_MESH_CTR_INC(msh, name);	\
+		spin_unlock(&(local)->rx_stats_lock);		\
+	} while (0)
+
 static struct sk_buff *
 ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 		     struct ieee80211_rate *rate)
@@ -457,8 +473,7 @@ ieee80211_rx_monitor(struct ieee80211_local *local, struct sk_buff *origskb,
 		}
 
 		prev_dev = sdata->dev;
-		sdata->dev->stats.rx_packets++;
-		sdata->dev->stats.rx_bytes += skb->len;
+		ieee80211_rx_stats(local, sdata->dev, skb->len);
 	}
 
 	if (prev_dev) {
@@ -666,43 +681,180 @@ static inline u16 seq_sub(u16 sq1, u16 sq2)
 	return (sq1 - sq2) & SEQ_MASK;
 }
 
+static inline int ieee80211_reorder_index(struct tid_ampdu_rx *tid_agg_rx,
+					   u16 seq)
+{
+	return seq_sub(seq, tid_agg_rx->ssn) % tid_agg_rx->buf_size;
+}
+
+/*
+ * Slot indices only follow sequence numbers until the distance to the SSN
+ * wraps around, as buf_size need not divide the sequence number space.
+ * Returns the number of slots from the head that can be walked in ring
+ * order before reaching that point.
+ */
+static int ieee80211_reorder_run_limit(struct tid_ampdu_rx *tid_agg_rx)
+{
+	return SEQ_MODULO - seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn);
+}
+
+/*
+ * Returns the number of sequence numbers from the head (inclusive) to the
+ * next stored frame; there must be at least one frame stored.
+ */
+static int ieee80211_reorder_next_stored(struct tid_ampdu_rx *tid_agg_rx)
+{
+	int index = ieee80211_reorder_index(tid_agg_rx,
+					    tid_agg_rx->head_seq_num);
+	int limit = ieee80211_reorder_run_limit(tid_agg_rx);
+	int j, skipped;
+
+	j = find_next_bit(tid_agg_rx->reorder_bitmap, tid_agg_rx->buf_size,
+			  index);
+	if (j < tid_agg_rx->buf_size)
+		skipped = j - index;
+	else
+		skipped = tid_agg_rx->buf_size - index +
+			  find_first_bit(tid_agg_rx->reorder_bitmap, index);
+
+	if (skipped < limit)
+		return skipped;
+
+	/* past the wrap the sequence numbers start over at slot 0 */
+	return limit + find_first_bit(tid_agg_rx->reorder_bitmap,
+				      tid_agg_rx->buf_size);
+}
+
+/*
+ * Returns the number of consecutively stored frames starting at the head
+ * slot @index, in ring order and stopping at the sequence number wrap.
+ */
+static int ieee80211_reorder_run_len(struct tid_ampdu_rx *tid_agg_rx,
+				     int index)
+{
+	int j, len;
+
+	j = find_next_zero_bit(tid_agg_rx->reorder_bitmap,
+			       tid_agg_rx->buf_size, index);
+	if (j < tid_agg_rx->buf_size || index == 0)
+		len = j - index;
+	else
+		len = tid_agg_rx->buf_size - index +
+		      find_first_zero_bit(tid_agg_rx->reorder_bitmap, index);
+
+	return min(len, ieee80211_reorder_run_limit(tid_agg_rx));
+}
+
 static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
 					    struct tid_ampdu_rx *tid_agg_rx,
-					    int index)
+					    int index,
+					    struct sk_buff_head *frames)
 {
-	struct ieee80211_local *local = sdata->local;
 	struct sk_buff *skb = tid_agg_rx->reorder_buf[index];
 	struct ieee80211_rx_status *status;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
-	if (!skb)
-		goto no_frame;
-
 	/* release the frame from the reorder ring buffer */
 	tid_agg_rx->stored_mpdu_num--;
 	tid_agg_rx->reorder_buf[index] = NULL;
+	__clear_bit(index, tid_agg_rx->reorder_bitmap);
 	status = IEEE80211_SKB_RXCB(skb);
 	status->rx_flags |= IEEE80211_RX_DEFERRED_RELEASE;
-	skb_queue_tail(&local->rx_skb_queue, skb);
+	__skb_queue_tail(frames, skb);
+}
+
+/*
+ * Release all frames stored in the slots [@start, @end), which must not
+ * wrap around the end of the ring. The head sequence number is left to
+ * the caller.
+ */
+static void ieee80211_release_reorder_range(struct ieee80211_sub_if_data *sdata,
+					    struct tid_ampdu_rx *tid_agg_rx,
+					    int start, int end,
+					    struct sk_buff_head *frames)
+{
+	int i;
+
+	for (i = find_next_bit(tid_agg_rx->reorder_bitmap, end, start);
+	     i < end;
+	     i = find_next_bit(tid_agg_rx->reorder_bitmap, end, i + 1))
+		ieee80211_release_reorder_frame(sdata, tid_agg_rx, i, frames);
+}
+
+/*
+ * Release the @len slots starting at the head of the reorder buffer and
+ * move the head past them.
+ */
+static void ieee80211_release_reorder_slots(struct ieee80211_sub_if_data *sdata,
+					    struct tid_ampdu_rx *tid_agg_rx,
+					    int len,
+					    struct sk_buff_head *frames)
+{
+	int index, end, n;
+
+	while (len > 0) {
+		index = ieee80211_reorder_index(tid_agg_rx,
+						tid_agg_rx->head_seq_num);
+		n = min(len, ieee80211_reorder_run_limit(tid_agg_rx));
+		end = index + n;
+
+		if (tid_agg_rx->stored_mpdu_num) {
+			ieee80211_release_reorder_range(sdata, tid_agg_rx, index,
+					min_t(int, end, tid_agg_rx->buf_size),
+					frames);
+			if (end > tid_agg_rx->buf_size)
+				ieee80211_release_reorder_range(sdata,
+						tid_agg_rx, 0,
+						end - tid_agg_rx->buf_size,
+						frames);
+		}
 
-no_frame:
-	tid_agg_rx->head_seq_num = seq_inc(tid_agg_rx->head_seq_num);
+		tid_agg_rx->head_seq_num =
+			(tid_agg_rx->head_seq_num + n) & SEQ_MASK;
+		len -= n;
+	}
+}
+
+/*
+ * Release the stored frames at the head of the reorder buffer up to the
+ * next missing one.
+ */
+static void ieee80211_release_reorder_head(struct ieee80211_sub_if_data *sdata,
+					   struct tid_ampdu_rx *tid_agg_rx,
+					   struct sk_buff_head *frames)
+{
+	int index = ieee80211_reorder_index(tid_agg_rx,
+					    tid_agg_rx->head_seq_num);
+
+	/* a run stops at the sequence number wrap, so check the head again */
+	while (test_bit(index, tid_agg_rx->reorder_bitmap)) {
+		ieee80211_release_reorder_slots(sdata, tid_agg_rx,
+				ieee80211_reorder_run_len(tid_agg_rx, index),
+				frames);
+		index = ieee80211_reorder_index(tid_agg_rx,
+						tid_agg_rx->head_seq_num);
+	}
 }
 
 static void ieee80211_release_reorder_frames(struct ieee80211_sub_if_data *sdata,
 					     struct tid_ampdu_rx *tid_agg_rx,
-					     u16 head_seq_num)
+					     u16 head_seq_num,
+					     struct sk_buff_head *frames)
 {
-	int index;
+	int len;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
-	while (seq_less(tid_agg_rx->head_seq_num, head_seq_num)) {
-		index = seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
-							tid_agg_rx->buf_size;
-		ieee80211_release_reorder_frame(sdata, tid_agg_rx, index);
-	}
+	if (!seq_less(tid_agg_rx->head_seq_num, head_seq_num))
+		return;
+
+	/* no more than the whole buffer can hold frames to release */
+	len = seq_sub(head_seq_num, tid_agg_rx->head_seq_num);
+	ieee80211_release_reorder_slots(sdata, tid_agg_rx,
+					min_t(int, len, tid_agg_rx->buf_size),
+					frames);
+	tid_agg_rx->head_seq_num = head_seq_num;
 }
 
 /*
@@ -717,68 +869,52 @@ static void ieee80211_release_reorder_frames(struct ieee80211_sub_if_data *sdata
 #define HT_RX_REORDER_BUF_TIMEOUT (HZ / 10)
 
 static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
-					  struct tid_ampdu_rx *tid_agg_rx)
+					  struct tid_ampdu_rx *tid_agg_rx,
+					  struct sk_buff_head *frames)
 {
-	int index, j;
+	unsigned long expires;
+	int skipped, j;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
 	/* release the buffer until next missing frame */
-	index = seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
-						tid_agg_rx->buf_size;
-	if (!tid_agg_rx->reorder_buf[index] &&
-	    tid_agg_rx->stored_mpdu_num) {
-		/*
-		 * No buffers ready to be released, but check whether any
-		 * frames in the reorder buffer have timed out.
-		 */
-		int skipped = 1;
-		for (j = (index + 1) % tid_agg_rx->buf_size; j != index;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (!tid_agg_rx->reorder_buf[j]) {
-				skipped++;
-				continue;
-			}
-			if (skipped &&
-			    !time_after(jiffies, tid_agg_rx->reorder_time[j] +
-					HT_RX_REORDER_BUF_TIMEOUT))
-				goto set_release_timer;
+	ieee80211_release_reorder_head(sdata, tid_agg_rx, frames);
 
-			ht_dbg_ratelimited(sdata,
-					   "release an RX reorder frame due to timeout on earlier frames\n");
-			ieee80211_release_reorder_frame(sdata, tid_agg_rx, j);
+	/*
+	 * The head is missing now; release the frames behind each gap as
+	 * long as the first of them has timed out, which means the earlier
+	 * frames that were not yet received are assumed to be lost.
+	 */
+	while (tid_agg_rx->stored_mpdu_num) {
+		skipped = ieee80211_reorder_next_stored(tid_agg_rx);
+		j = ieee80211_reorder_index(tid_agg_rx,
+				(tid_agg_rx->head_seq_num + skipped) & SEQ_MASK);
 
-			/*
-			 * Increment the head seq# also for the skipped slots.
-			 */
-			tid_agg_rx->head_seq_num =
-				(tid_agg_rx->head_seq_num + skipped) & SEQ_MASK;
-			skipped = 0;
+		/*
+		 * The timer only depends on the first frame behind the gap
+		 * at the head, so it rarely needs to be modified.
+		 */
+		if (!time_after(jiffies, tid_agg_rx->reorder_time[j] +
+				HT_RX_REORDER_BUF_TIMEOUT)) {
+			expires = tid_agg_rx->reorder_time[j] + 1 +
+				  HT_RX_REORDER_BUF_TIMEOUT;
+			if (!timer_pending(&tid_agg_rx->reorder_timer) ||
+			    tid_agg_rx->reorder_timer.expires != expires)
+				mod_timer(&tid_agg_rx->reorder_timer, expires);
+			return;
 		}
-	} else while (tid_agg_rx->reorder_buf[index]) {
-		ieee80211_release_reorder_frame(sdata, tid_agg_rx, index);
-		index =	seq_sub(tid_agg_rx->head_seq_num, tid_agg_rx->ssn) %
-							tid_agg_rx->buf_size;
-	}
 
-	if (tid_agg_rx->stored_mpdu_num) {
-		j = index = seq_sub(tid_agg_rx->head_seq_num,
-				    tid_agg_rx->ssn) % tid_agg_rx->buf_size;
+		ht_dbg_ratelimited(sdata,
+				   "release an RX reorder frame due to timeout on earlier frames\n");
 
-		for (; j != (index - 1) % tid_agg_rx->buf_size;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (tid_agg_rx->reorder_buf[j])
-				break;
-		}
-
- set_release_timer:
+		/* increment the head seq# also for the skipped slots */
+		tid_agg_rx->head_seq_num =
+			(tid_agg_rx->head_seq_num + skipped) & SEQ_MASK;
+		ieee80211_release_reorder_head(sdata, tid_agg_rx, frames);
+	}
 
-		mod_timer(&tid_agg_rx->reorder_timer,
-			  tid_agg_rx->reorder_time[j] + 1 +
-			  HT_RX_REORDER_BUF_TIMEOUT);
-	} else {
+	if (timer_pending(&tid_agg_rx->reorder_timer))
 		del_timer(&tid_agg_rx->reorder_timer);
-	}
 }
 
 /*
@@ -788,7 +924,8 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
  */
 static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata,
 					     struct tid_ampdu_rx *tid_agg_rx,
-					     struct sk_buff *skb)
+					     struct sk_buff *skb,
+					     struct sk_buff_head *frames)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 	u16 sc = le16_to_cpu(hdr->seq_ctrl);
@@ -816,15 +953,15 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 		head_seq_num = seq_inc(seq_sub(mpdu_seq_num, buf_size));
 		/* release stored frames up to new head to stack */
 		ieee80211_release_reorder_frames(sdata, tid_agg_rx,
-						 head_seq_num);
+						 head_seq_num, frames);
 	}
 
 	/* Now the new frame is always in the range of the reordering buffer */
 
-	index = seq_sub(mpdu_seq_num, tid_agg_rx->ssn) % tid_agg_rx->buf_size;
+	index = ieee80211_reorder_index(tid_agg_rx, mpdu_seq_num);
 
 	/* check if we already stored this frame */
-	if (tid_agg_rx->reorder_buf[index]) {
+	if (test_bit(index, tid_agg_rx->reorder_bitmap)) {
 		dev_kfree_skb(skb);
 		goto out;
 	}
@@ -845,8 +982,9 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	/* put the frame in the reordering buffer */
 	tid_agg_rx->reorder_buf[index] = skb;
 	tid_agg_rx->reorder_time[index] = jiffies;
+	__set_bit(index, tid_agg_rx->reorder_bitmap);
 	tid_agg_rx->stored_mpdu_num++;
-	ieee80211_sta_reorder_release(sdata, tid_agg_rx);
+	ieee80211_sta_reorder_release(sdata, tid_agg_rx, frames);
 
  out:
 	spin_unlock(&tid_agg_rx->reorder_lock);
@@ -857,7 +995,8 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
  * Reorder MPDUs from A-MPDUs, keeping them on a buffer. Returns
  * true if the MPDU was buffered, false if it should be processed.
  */
-static void ieee80211_rx_reorder_ampdu(struct ieee80211_rx_data *rx)
+static void ieee80211_rx_reorder_ampdu(struct ieee80211_rx_data *rx,
+				       struct sk_buff_head *frames)
 {
 	struct sk_buff *skb = rx->skb;
 	struct ieee80211_local *local = rx->local;
@@ -916,17 +1055,16 @@ static void ieee80211_rx_reorder_ampdu(struct ieee80211_rx_data *rx)
 	}
 
 	/*
-	 * No locking needed -- we will only ever process one
-	 * RX packet at a time, and thus own tid_agg_rx. All
-	 * other code manipulating it needs to (and does) make
-	 * sure that we cannot get to it any more before doing
-	 * anything with it.
+	 * The reorder buffer is protected by its reorder_lock, frames
+	 * released from it are handed back on the caller's list and
+	 * processed in order under the station's RX path lock.
 	 */
-	if (ieee80211_sta_manage_reorder_buf(rx->sdata, tid_agg_rx, skb))
+	if (ieee80211_sta_manage_reorder_buf(rx->sdata, tid_agg_rx, skb,
+					     frames))
 		return;
 
  dont_reorder:
-	skb_queue_tail(&local->rx_skb_queue, skb);
+	__skb_queue_tail(frames, skb);
 }
 
 static ieee80211_rx_result debug_noinline
@@ -1252,6 +1390,7 @@ static void sta_ps_start(struct sta_info *sta)
 
 	atomic_inc(&ps->num_sta_ps);
 	set_sta_flag(sta, WLAN_STA_PS_STA);
+	ieee80211_clear_fast_xmit(sta);
 	if (!(local->hw.flags & IEEE80211_HW_AP_LINK_PS))
 		drv_sta_notify(local, sdata, STA_NOTIFY_SLEEP, &sta->sta);
 	ps_dbg(sdata, "STA %pM aid %d enters power save mode\n",
@@ -1488,25 +1627,56 @@ ieee80211_rx_h_sta_process(struct ieee80211_rx_data *rx)
 	return RX_CONTINUE;
 } /* ieee80211_rx_h_sta_process */
 
+/*
+ * Fragments from a known station are reassembled in a context selected
+ * directly by the station and TID; only fragments from unknown senders
+ * share the small per-interface cache.
+ */
+static struct ieee80211_fragment_entry *
+ieee80211_reassemble_slot(struct ieee80211_rx_data *rx)
+{
+	struct ieee80211_sub_if_data *sdata = rx->sdata;
+	struct sta_info *sta = rx->sta;
+	struct ieee80211_fragment_entry *entry;
+	int i;
+
+	if (!sta) {
+		entry = &sdata->fragments[sdata->fragment_next++];
+		if (sdata->fragment_next >= IEEE80211_FRAGMENT_MAX)
+			sdata->fragment_next = 0;
+		return entry;
+	}
+
+	if (!sta->fragments) {
+		sta->fragments = kcalloc(IEEE80211_NUM_TIDS + 1,
+					 sizeof(*sta->fragments), GFP_ATOMIC);
+		if (!sta->fragments)
+			return NULL;
+		for (i = 0; i <= IEEE80211_NUM_TIDS; i++)
+			__skb_queue_head_init(&sta->fragments[i].skb_list);
+	}
+
+	return &sta->fragments[rx->seqno_idx];
+}
+
 static inline struct ieee80211_fragment_entry *
-ieee80211_reassemble_add(struct ieee80211_sub_if_data *sdata,
-			 unsigned int frag, unsigned int seq, int rx_queue,
-			 struct sk_buff **skb)
+ieee80211_reassemble_add(struct ieee80211_rx_data *rx,
+			 unsigned int frag, unsigned int seq)
 {
 	struct ieee80211_fragment_entry *entry;
 
-	entry = &sdata->fragments[sdata->fragment_next++];
-	if (sdata->fragment_next >= IEEE80211_FRAGMENT_MAX)
-		sdata->fragment_next = 0;
+	entry = ieee80211_reassemble_slot(rx);
+	if (!entry)
+		return NULL;
 
 	if (!skb_queue_empty(&entry->skb_list))
 		__skb_queue_purge(&entry->skb_list);
 
-	__skb_queue_tail(&entry->skb_list, *skb); /* no need for locking */
-	*skb = NULL;
+	__skb_queue_tail(&entry->skb_list, rx->skb); /* no need for locking */
+	rx->skb = NULL;
 	entry->first_frag_time = jiffies;
 	entry->seq = seq;
-	entry->rx_queue = rx_queue;
+	entry->rx_queue = rx->seqno_idx;
 	entry->last_frag = frag;
 	entry->ccmp = 0;
 	entry->extra_len = 0;
@@ -1514,44 +1684,66 @@ ieee80211_reassemble_add(struct ieee80211_sub_if_data *sdata,
 	return entry;
 }
 
+static bool
+ieee80211_reassemble_match(struct ieee80211_fragment_entry *entry,
+			   unsigned int frag, unsigned int seq,
+			   int rx_queue, struct ieee80211_hdr *hdr)
+{
+	struct ieee80211_hdr *f_hdr;
+
+	if (skb_queue_empty(&entry->skb_list) || entry->seq != seq ||
+	    entry->rx_queue != rx_queue ||
+	    entry->last_frag + 1 != frag)
+		return false;
+
+	f_hdr = (struct ieee80211_hdr *)entry->skb_list.next->data;
+
+	/*
+	 * Check ftype and addresses are equal, else check next fragment
+	 */
+	if (((hdr->frame_control ^ f_hdr->frame_control) &
+	     cpu_to_le16(IEEE80211_FCTL_FTYPE)) ||
+	    !ether_addr_equal(hdr->addr1, f_hdr->addr1) ||
+	    !ether_addr_equal(hdr->addr2, f_hdr->addr2))
+		return false;
+
+	if (time_after(jiffies, entry->first_frag_time + 2 * HZ)) {
+		__skb_queue_purge(&entry->skb_list);
+		return false;
+	}
+
+	return true;
+}
+
 static inline struct ieee80211_fragment_entry *
-ieee80211_reassemble_find(struct ieee80211_sub_if_data *sdata,
+ieee80211_reassemble_find(struct ieee80211_rx_data *rx,
 			  unsigned int frag, unsigned int seq,
-			  int rx_queue, struct ieee80211_hdr *hdr)
+			  struct ieee80211_hdr *hdr)
 {
+	struct ieee80211_sub_if_data *sdata = rx->sdata;
 	struct ieee80211_fragment_entry *entry;
 	int i, idx;
 
+	if (rx->sta) {
+		if (!rx->sta->fragments)
+			return NULL;
+		entry = &rx->sta->fragments[rx->seqno_idx];
+		if (!ieee80211_reassemble_match(entry, frag, seq,
+						rx->seqno_idx, hdr))
+			return NULL;
+		return entry;
+	}
+
 	idx = sdata->fragment_next;
 	for (i = 0; i < IEEE80211_FRAGMENT_MAX; i++) {
-		struct ieee80211_hdr *f_hdr;
-
 		idx--;
 		if (idx < 0)
 			idx = IEEE80211_FRAGMENT_MAX - 1;
 
 		entry = &sdata->fragments[idx];
-		if (skb_queue_empty(&entry->skb_list) || entry->seq != seq ||
-		    entry->rx_queue != rx_queue ||
-		    entry->last_frag + 1 != frag)
-			continue;
-
-		f_hdr = (struct ieee80211_hdr *)entry->skb_list.next->data;
-
-		/*
-		 * Check ftype and addresses are equal, else check next fragment
-		 */
-		if (((hdr->frame_control ^ f_hdr->frame_control) &
-		     cpu_to_le16(IEEE80211_FCTL_FTYPE)) ||
-		    !ether_addr_equal(hdr->addr1, f_hdr->addr1) ||
-		    !ether_addr_equal(hdr->addr2, f_hdr->addr2))
-			continue;
-
-		if (time_after(jiffies, entry->first_frag_time + 2 * HZ)) {
-			__skb_queue_purge(&entry->skb_list);
-			continue;
-		}
-		return entry;
+		if (ieee80211_reassemble_match(entry, frag, seq,
+					       rx->seqno_idx, hdr))
+			return entry;
 	}
 
 	return NULL;
@@ -1565,7 +1757,7 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	__le16 fc;
 	unsigned int frag, seq;
 	struct ieee80211_fragment_entry *entry;
-	struct sk_buff *skb;
+	struct sk_buff *skb, **next;
 	struct ieee80211_rx_status *status;
 
 	hdr = (struct ieee80211_hdr *)rx->skb->data;
@@ -1584,21 +1776,17 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	}
 	I802_DEBUG_INC(rx->local->rx_handlers_fragments);
 
-	if (skb_linearize(rx->skb))
-		return RX_DROP_UNUSABLE;
-
 	/*
-	 *  skb_linearize() might change the skb->data and
-	 *  previously cached variables (in this case, hdr) need to
-	 *  be refreshed with the new data.
+	 * The fragments are chained rather than copied together, so they
+	 * don't need to be linear; the header was pulled in already.
 	 */
-	hdr = (struct ieee80211_hdr *)rx->skb->data;
 	seq = (sc & IEEE80211_SCTL_SEQ) >> 4;
 
 	if (frag == 0) {
 		/* This is the first fragment of a new frame. */
-		entry = ieee80211_reassemble_add(rx->sdata, frag, seq,
-						 rx->seqno_idx, &(rx->skb));
+		entry = ieee80211_reassemble_add(rx, frag, seq);
+		if (!entry)
+			return RX_DROP_UNUSABLE;
 		if (rx->key && rx->key->conf.cipher == WLAN_CIPHER_SUITE_CCMP &&
 		    ieee80211_has_protected(fc)) {
 			int queue = rx->security_idx;
@@ -1615,8 +1803,7 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 	/* This is a fragment for a frame that should already be pending in
 	 * fragment cache. Add this fragment to the end of the pending entry.
 	 */
-	entry = ieee80211_reassemble_find(rx->sdata, frag, seq,
-					  rx->seqno_idx, hdr);
+	entry = ieee80211_reassemble_find(rx, frag, seq, hdr);
 	if (!entry) {
 		I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
 		return RX_DROP_MONITOR;
@@ -1652,22 +1839,31 @@ ieee80211_rx_h_defragment(struct ieee80211_rx_data *rx)
 		return RX_QUEUED;
 	}
 
+	/*
+	 * Hang the remaining fragments off the first one's frag_list. Its
+	 * shared info is modified, so it must not be shared with a clone,
+	 * and it can't already have a frag_list of its own.
+	 */
 	rx->skb = __skb_dequeue(&entry->skb_list);
-	if (skb_tailroom(rx->skb) < entry->extra_len) {
-		I802_DEBUG_INC(rx->local->rx_expand_skb_head2);
-		if (unlikely(pskb_expand_head(rx->skb, 0, entry->extra_len,
-					      GFP_ATOMIC))) {
-			I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
-			__skb_queue_purge(&entry->skb_list);
-			return RX_DROP_UNUSABLE;
-		}
+	if (unlikely(skb_has_frag_list(rx->skb) ? skb_linearize(rx->skb) :
+		     (skb_cloned(rx->skb) &&
+		      pskb_expand_head(rx->skb, 0, 0, GFP_ATOMIC)))) {
+		I802_DEBUG_INC(rx->local->rx_handlers_drop_defrag);
+		__skb_queue_purge(&entry->skb_list);
+		return RX_DROP_UNUSABLE;
 	}
+
+	next = &skb_shinfo(rx->skb)->frag_list;
 	while ((skb = __skb_dequeue(&entry->skb_list))) {
-		memcpy(skb_put(rx->skb, skb->len), skb->data, skb->len);
-		dev_kfree_skb(skb);
+		*next = skb;
+		next = &skb->next;
+		rx->skb->len += skb->len;
+		rx->skb->data_len += skb->len;
+		rx->skb->truesize += skb->truesize;
 	}
 
 	/* Complete frame has been reassembled - process it now */
+	hdr = (struct ieee80211_hdr *)rx->skb->data;
 	status = IEEE80211_SKB_RXCB(rx->skb);
 	status->rx_flags |= IEEE80211_RX_FRAGMENTED;
 
@@ -1970,8 +2166,7 @@ ieee80211_rx_h_amsdu(struct ieee80211_rx_data *rx)
 			dev_kfree_skb(rx->skb);
 			continue;
 		}
-		dev->stats.rx_packets++;
-		dev->stats.rx_bytes += rx->skb->len;
+		ieee80211_rx_stats(rx->local, dev, rx->skb->len);
 
 		ieee80211_deliver_skb(rx);
 	}
@@ -1980,6 +2175,41 @@ ieee80211_rx_h_amsdu(struct ieee80211_rx_data *rx)
 }
 
 #ifdef CONFIG_MAC80211_MESH
+/*
+ * Get the frame to forward. A unicast frame that isn't addressed to us
+ * is only still needed by cooked monitor interfaces once it has been
+ * forwarded, so unless there are any, forward the received frame itself
+ * rather than a copy. Either way make sure the frame has the headroom and
+ * tailroom needed for encryption, as the pending path doesn't resize it.
+ */
+static struct sk_buff *ieee80211_mesh_fwd_skb(struct ieee80211_rx_data *rx,
+					      struct ieee80211_hdr *hdr)
+{
+	struct ieee80211_local *local = rx->local;
+	struct sk_buff *skb = rx->skb;
+	int head_need, tail_need;
+
+	head_need = local->tx_headroom + IEEE80211_ENCRYPT_HEADROOM;
+	tail_need = IEEE80211_ENCRYPT_TAILROOM;
+
+	if (is_multicast_ether_addr(hdr->addr1) ||
+	    rx->sdata->dev->flags & IFF_PROMISC || local->cooked_mntrs ||
+	    skb_cloned(skb) || skb_linearize(skb))
+		return skb_copy_expand(skb, max_t(int, head_need,
+						  skb_headroom(skb)),
+				       max_t(int, tail_need, skb_tailroom(skb)),
+				       GFP_ATOMIC);
+
+	head_need = max_t(int, 0, head_need - skb_headroom(skb));
+	tail_need = max_t(int, 0, tail_need - skb_tailroom(skb));
+	if ((head_need || tail_need) &&
+	    pskb_expand_head(skb, head_need, tail_need, GFP_ATOMIC))
+		return NULL;
+
+	I802_DEBUG_INC(local->rx_fwd_copy_avoided);
+	return skb;
+}
+
 static ieee80211_rx_result
 ieee80211_rx_h_mesh_fwding(struct ieee80211_rx_data *rx)
 {
@@ -2061,20 +2291,21 @@ ieee80211_rx_h_mesh_fwding(struct ieee80211_rx_data *rx)
 
 	q = ieee80211_select_queue_80211(sdata, skb, hdr);
 	if (ieee80211_queue_stopped(&local->hw, q)) {
-		IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, dropped_frames_congestion);
+		IEEE80211_RX_MESH_CTR_INC(local, ifmsh,
+					  dropped_frames_congestion);
 		return RX_DROP_MONITOR;
 	}
 	skb_set_queue_mapping(skb, q);
 
 	if (!--mesh_hdr->ttl) {
-		IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, dropped_frames_ttl);
+		IEEE80211_RX_MESH_CTR_INC(local, ifmsh, dropped_frames_ttl);
 		goto out;
 	}
 
 	if (!ifmsh->mshcfg.dot11MeshForwarding)
 		goto out;
 
-	fwd_skb = skb_copy(skb, GFP_ATOMIC);
+	fwd_skb = ieee80211_mesh_fwd_skb(rx, hdr);
 	if (!fwd_skb) {
 		net_info_ratelimited("%s: failed to clone mesh frame\n",
 				    sdata->name);
@@ -2088,22 +2319,31 @@ ieee80211_rx_h_mesh_fwding(struct ieee80211_rx_data *rx)
 	info->control.vif = &rx->sdata->vif;
 	info->control.jiffies = jiffies;
 	if (is_multicast_ether_addr(fwd_hdr->addr1)) {
-		IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, fwded_mcast);
+		IEEE80211_RX_MESH_CTR_INC(local, ifmsh, fwded_mcast);
 		memcpy(fwd_hdr->addr2, sdata->vif.addr, ETH_ALEN);
 	} else if (!mesh_nexthop_lookup(fwd_skb, sdata)) {
-		IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, fwded_unicast);
+		IEEE80211_RX_MESH_CTR_INC(local, ifmsh, fwded_unicast);
 	} else {
 		/* unable to resolve next hop */
 		mesh_path_error_tx(ifmsh->mshcfg.element_ttl, fwd_hdr->addr3,
 				   0, reason, fwd_hdr->addr2, sdata);
-		IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, dropped_frames_no_route);
+		IEEE80211_RX_MESH_CTR_INC(local, ifmsh,
+					  dropped_frames_no_route);
+		if (fwd_skb == skb) {
+			kfree_skb(fwd_skb);
+			return RX_QUEUED;
+		}
 		kfree_skb(fwd_skb);
 		return RX_DROP_MONITOR;
 	}
 
-	IEEE80211_IFSTA_MESH_CTR_INC(ifmsh, fwded_frames);
+	IEEE80211_RX_MESH_CTR_INC(local, ifmsh, fwded_frames);
 	ieee80211_add_pending_skb(local, fwd_skb);
+	if (fwd_skb == skb)
+		return RX_QUEUED;
  out:
+	/* the frame may have been reallocated while preparing to forward */
+	hdr = (struct ieee80211_hdr *) skb->data;
 	if (is_multicast_ether_addr(hdr->addr1) ||
 	    sdata->dev->flags & IFF_PROMISC)
 		return RX_CONTINUE;
@@ -2159,8 +2399,7 @@ ieee80211_rx_h_data(struct ieee80211_rx_data *rx)
 
 	rx->skb->dev = dev;
 
-	dev->stats.rx_packets++;
-	dev->stats.rx_bytes += rx->skb->len;
+	ieee80211_rx_stats(local, dev, rx->skb->len);
 
 	if (local->ps_sdata && local->hw.conf.dynamic_ps_timeout > 0 &&
 	    !is_multicast_ether_addr(
@@ -2177,7 +2416,7 @@ ieee80211_rx_h_data(struct ieee80211_rx_data *rx)
 }
 
 static ieee80211_rx_result debug_noinline
-ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx)
+ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx, struct sk_buff_head *frames)
 {
 	struct sk_buff *skb = rx->skb;
 	struct ieee80211_bar *bar = (struct ieee80211_bar *)skb->data;
@@ -2216,7 +2455,7 @@ ieee80211_rx_h_ctrl(struct ieee80211_rx_data *rx)
 		spin_lock(&tid_agg_rx->reorder_lock);
 		/* release stored frames up to start of BAR */
 		ieee80211_release_reorder_frames(rx->sdata, tid_agg_rx,
-						 start_seq_num);
+						 start_seq_num, frames);
 		spin_unlock(&tid_agg_rx->reorder_lock);
 
 		kfree_skb(skb);
@@ -2751,8 +2990,7 @@ static void ieee80211_rx_cooked_monitor(struct ieee80211_rx_data *rx,
 		}
 
 		prev_dev = sdata->dev;
-		sdata->dev->stats.rx_packets++;
-		sdata->dev->stats.rx_bytes += skb->len;
+		ieee80211_rx_stats(local, sdata->dev, skb->len);
 	}
 
 	if (prev_dev) {
@@ -2801,10 +3039,30 @@ static void ieee80211_rx_handlers_result(struct ieee80211_rx_data *rx,
 	}
 }
 
-static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx)
+/*
+ * Frames are serialized per station rather than per device, so that the
+ * handler chain for different stations can run concurrently, e.g. the
+ * reorder release timer of one station against RX of another.
+ *
+ * Frames without a station and group addressed frames touch per-interface
+ * state (group key RX counters, fragment cache for unknown senders) and
+ * are additionally serialized against each other by the device-wide lock.
+ * Fragments from a station are reassembled in the station's own contexts.
+ * The station lock always nests outside the device lock.
+ */
+static bool ieee80211_rx_needs_local_lock(struct ieee80211_rx_data *rx)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)rx->skb->data;
+
+	return !rx->sta || is_multicast_ether_addr(hdr->addr1);
+}
+
+static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx,
+				  struct sk_buff_head *frames)
 {
 	ieee80211_rx_result res = RX_DROP_MONITOR;
 	struct sk_buff *skb;
+	bool local_lock;
 
 #define CALL_RXH(rxh)			\
 	do {				\
@@ -2813,15 +3071,10 @@ static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx)
 			goto rxh_next;  \
 	} while (0);
 
-	spin_lock(&rx->local->rx_skb_queue.lock);
-	if (rx->local->running_rx_handler)
-		goto unlock;
-
-	rx->local->running_rx_handler = true;
-
-	while ((skb = __skb_dequeue(&rx->local->rx_skb_queue))) {
-		spin_unlock(&rx->local->rx_skb_queue.lock);
+	if (rx->sta)
+		spin_lock(&rx->sta->rx_path_lock);
 
+	while ((skb = __skb_dequeue(frames))) {
 		/*
 		 * all the other fields are valid across frames
 		 * that belong to an aMPDU since they are on the
@@ -2829,6 +3082,10 @@ static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx)
 		 */
 		rx->skb = skb;
 
+		local_lock = ieee80211_rx_needs_local_lock(rx);
+		if (local_lock)
+			spin_lock(&rx->local->rx_path_lock);
+
 		CALL_RXH(ieee80211_rx_h_decrypt)
 		CALL_RXH(ieee80211_rx_h_check_more_data)
 		CALL_RXH(ieee80211_rx_h_uapsd_and_pspoll)
@@ -2842,7 +3099,12 @@ static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx)
 #endif
 		CALL_RXH(ieee80211_rx_h_amsdu)
 		CALL_RXH(ieee80211_rx_h_data)
-		CALL_RXH(ieee80211_rx_h_ctrl);
+
+		/* special treatment -- needs the queue */
+		res = ieee80211_rx_h_ctrl(rx, frames);
+		if (res != RX_CONTINUE)
+			goto rxh_next;
+
 		CALL_RXH(ieee80211_rx_h_mgmt_check)
 		CALL_RXH(ieee80211_rx_h_action)
 		CALL_RXH(ieee80211_rx_h_userspace_mgmt)
@@ -2851,20 +3113,23 @@ static void ieee80211_rx_handlers(struct ieee80211_rx_data *rx)
 
  rxh_next:
 		ieee80211_rx_handlers_result(rx, res);
-		spin_lock(&rx->local->rx_skb_queue.lock);
+
+		if (local_lock)
+			spin_unlock(&rx->local->rx_path_lock);
 #undef CALL_RXH
 	}
 
-	rx->local->running_rx_handler = false;
-
- unlock:
-	spin_unlock(&rx->local->rx_skb_queue.lock);
+	if (rx->sta)
+		spin_unlock(&rx->sta->rx_path_lock);
 }
 
 static void ieee80211_invoke_rx_handlers(struct ieee80211_rx_data *rx)
 {
+	struct sk_buff_head reorder_release;
 	ieee80211_rx_result res = RX_DROP_MONITOR;
 
+	__skb_queue_head_init(&reorder_release);
+
 #define CALL_RXH(rxh)			\
 	do {				\
 		res = rxh(rx);		\
@@ -2874,9 +3139,9 @@ static void ieee80211_invoke_rx_handlers(struct ieee80211_rx_data *rx)
 
 	CALL_RXH(ieee80211_rx_h_check)
 
-	ieee80211_rx_reorder_ampdu(rx);
+	ieee80211_rx_reorder_ampdu(rx, &reorder_release);
 
-	ieee80211_rx_handlers(rx);
+	ieee80211_rx_handlers(rx, &reorder_release);
 	return;
 
  rxh_next:
@@ -2891,6 +3156,7 @@ static void ieee80211_invoke_rx_handlers(struct ieee80211_rx_data *rx)
  */
 void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid)
 {
+	struct sk_buff_head frames;
 	struct ieee80211_rx_data rx = {
 		.sta = sta,
 		.sdata = sta->sdata,
@@ -2906,11 +3172,13 @@ void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid)
 	if (!tid_agg_rx)
 		return;
 
+	__skb_queue_head_init(&frames);
+
 	spin_lock(&tid_agg_rx->reorder_lock);
-	ieee80211_sta_reorder_release(sta->sdata, tid_agg_rx);
+	ieee80211_sta_reorder_release(sta->sdata, tid_agg_rx, &frames);
 	spin_unlock(&tid_agg_rx->reorder_lock);
 
-	ieee80211_rx_handlers(&rx);
+	ieee80211_rx_handlers(&rx, &frames);
 }
 
 /* main receive path */
@@ -3033,7 +3301,17 @@ static bool ieee80211_prepare_and_rx_handle(struct ieee80211_rx_data *rx,
 		return false;
 
 	if (!consume) {
-		skb = skb_copy(skb, GFP_ATOMIC);
+		/*
+		 * Only the linear part is copied, the paged data is shared
+		 * with the other receivers. Flag it (on the original too,
+		 * which goes to the last receiver) so that the RX handlers
+		 * don't write to it, e.g. to decrypt in place.
+		 */
+		if (skb_is_nonlinear(skb)) {
+			status->rx_flags |= IEEE80211_RX_SHARED_FRAGS;
+			I802_DEBUG_INC(local->rx_copy_linear_only);
+		}
+		skb = pskb_copy(skb, GFP_ATOMIC);
 		if (!skb) {
 			if (net_ratelimit())
 				wiphy_debug(local->hw.wiphy,
@@ -3049,12 +3327,25 @@ static bool ieee80211_prepare_and_rx_handle(struct ieee80211_rx_data *rx,
 	return true;
 }
 
+/*
+ * State shared by the frames of one ieee80211_rx_list() batch. Drivers
+ * typically hand over whole A-MPDUs, so consecutive data frames tend to
+ * come from the same transmitter; remember the result of the station
+ * lookup for it. Only valid within the RCU read-side section that covers
+ * the whole batch.
+ */
+struct ieee80211_rx_batch {
+	u8 addr[ETH_ALEN];
+	struct sta_info *sta;
+};
+
 /*
  * This is the actual Rx frames handler. as it blongs to Rx path it must
  * be called with rcu_read_lock protection.
  */
 static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
-					 struct sk_buff *skb)
+					 struct sk_buff *skb,
+					 struct ieee80211_rx_batch *batch)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct ieee80211_sub_if_data *sdata;
@@ -3062,6 +3353,7 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	__le16 fc;
 	struct ieee80211_rx_data rx;
 	struct ieee80211_sub_if_data *prev;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta, *tmp, *prev_sta;
 	int err = 0;
 
@@ -3099,7 +3391,13 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 	if (ieee80211_is_data(fc)) {
 		prev_sta = NULL;
 
-		for_each_sta_info(local, hdr->addr2, sta, tmp) {
+		if (batch && batch->sta &&
+		    ether_addr_equal(batch->addr, hdr->addr2)) {
+			prev_sta = batch->sta;
+			goto handle_sta;
+		}
+
+		for_each_sta_info(local, tbl, hdr->addr2, sta, tmp) {
 			if (!prev_sta) {
 				prev_sta = sta;
 				continue;
@@ -3110,8 +3408,16 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 			ieee80211_prepare_and_rx_handle(&rx, skb, false);
 
 			prev_sta = sta;
+			batch = NULL;
+		}
+
+		/* only cache the common case of a single matching station */
+		if (batch) {
+			memcpy(batch->addr, hdr->addr2, ETH_ALEN);
+			batch->sta = prev_sta;
 		}
 
+ handle_sta:
 		if (prev_sta) {
 			rx.sta = prev_sta;
 			rx.sdata = prev_sta->sdata;
@@ -3163,25 +3469,11 @@ static void __ieee80211_rx_handle_packet(struct ieee80211_hw *hw,
 }
 
 /*
- * This is the receive path handler. It is called by a low level driver when an
- * 802.11 MPDU is received from the hardware.
+ * Checks that don't depend on the frame, done once per ieee80211_rx() call
+ * or once per ieee80211_rx_list() batch.
  */
-void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
+static bool ieee80211_rx_accepting(struct ieee80211_local *local)
 {
-	struct ieee80211_local *local = hw_to_local(hw);
-	struct ieee80211_rate *rate = NULL;
-	struct ieee80211_supported_band *sband;
-	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
-
-	WARN_ON_ONCE(softirq_count() == 0);
-
-	if (WARN_ON(status->band >= IEEE80211_NUM_BANDS))
-		goto drop;
-
-	sband = local->hw.wiphy->bands[status->band];
-	if (WARN_ON(!sband))
-		goto drop;
-
 	/*
 	 * If we're suspending, it is possible although not too likely
 	 * that we'd be receiving frames after having already partially
@@ -3190,18 +3482,41 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
 	 * driver callbacks be invoked.
 	 */
 	if (unlikely(local->quiescing || local->suspended))
-		goto drop;
+		return false;
 
 	/* We might be during a HW reconfig, prevent Rx for the same reason */
 	if (unlikely(local->in_reconfig))
-		goto drop;
+		return false;
 
 	/*
 	 * The same happens when we're not even started,
 	 * but that's worth a warning.
 	 */
 	if (WARN_ON(!local->started))
-		goto drop;
+		return false;
+
+	return true;
+}
+
+/*
+ * Validate the RX status the driver filled in, returns false if the
+ * frame must be dropped.
+ */
+static bool ieee80211_rx_check_status(struct ieee80211_local *local,
+				      struct sk_buff *skb,
+				      struct ieee80211_rate **rate)
+{
+	struct ieee80211_supported_band *sband;
+	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
+
+	*rate = NULL;
+
+	if (WARN_ON(status->band >= IEEE80211_NUM_BANDS))
+		return false;
+
+	sband = local->hw.wiphy->bands[status->band];
+	if (WARN_ON(!sband))
+		return false;
 
 	if (likely(!(status->flag & RX_FLAG_FAILED_PLCP_CRC))) {
 		/*
@@ -3226,29 +3541,32 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
 				 "an MCS index [0-76]: %d (0x%02x)\n",
 				 status->rate_idx,
 				 status->rate_idx))
-				goto drop;
+				return false;
 		} else if (status->flag & RX_FLAG_VHT) {
 			if (WARN_ONCE(status->rate_idx > 9 ||
 				      !status->vht_nss ||
 				      status->vht_nss > 8,
 				      "Rate marked as a VHT rate but data is invalid: MCS: %d, NSS: %d\n",
 				      status->rate_idx, status->vht_nss))
-				goto drop;
+				return false;
 		} else {
 			if (WARN_ON(status->rate_idx >= sband->n_bitrates))
-				goto drop;
-			rate = &sband->bitrates[status->rate_idx];
+				return false;
+			*rate = &sband->bitrates[status->rate_idx];
 		}
 	}
 
 	status->rx_flags = 0;
 
-	/*
-	 * key references and virtual interfaces are protected using RCU
-	 * and this requires that we are in a read-side RCU section during
-	 * receive processing
-	 */
-	rcu_read_lock();
+	return true;
+}
+
+/* must be called under RCU read lock */
+static void ieee80211_rx_one(struct ieee80211_hw *hw, struct sk_buff *skb,
+			     struct ieee80211_rate *rate,
+			     struct ieee80211_rx_batch *batch)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
 
 	/*
 	 * Frames with failed FCS/PLCP checksum are not returned,
@@ -3257,16 +3575,39 @@ void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
 	 * Also, frames with less than 16 bytes are dropped.
 	 */
 	skb = ieee80211_rx_monitor(local, skb, rate);
-	if (!skb) {
-		rcu_read_unlock();
+	if (!skb)
 		return;
-	}
 
 	ieee80211_tpt_led_trig_rx(local,
 			((struct ieee80211_hdr *)skb->data)->frame_control,
 			skb->len);
-	__ieee80211_rx_handle_packet(hw, skb);
+	__ieee80211_rx_handle_packet(hw, skb, batch);
+}
 
+/*
+ * This is the receive path handler. It is called by a low level driver when an
+ * 802.11 MPDU is received from the hardware.
+ */
+void ieee80211_rx(struct ieee80211_hw *hw, struct sk_buff *skb)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct ieee80211_rate *rate;
+
+	WARN_ON_ONCE(softirq_count() == 0);
+
+	if (!ieee80211_rx_check_status(local, skb, &rate))
+		goto drop;
+
+	if (!ieee80211_rx_accepting(local))
+		goto drop;
+
+	/*
+	 * key references and virtual interfaces are protected using RCU
+	 * and this requires that we are in a read-side RCU section during
+	 * receive processing
+	 */
+	rcu_read_lock();
+	ieee80211_rx_one(hw, skb, rate, NULL);
 	rcu_read_unlock();
 
 	return;
@@ -3279,6 +3620,33 @@ EXPORT_SYMBOL(ieee80211_rx);
 EXPORT_SYMBOL(mac80211_ieee80211_rx);
 #endif
 
+void ieee80211_rx_list(struct ieee80211_hw *hw, struct sk_buff_head *list)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct ieee80211_rx_batch batch = {};
+	struct ieee80211_rate *rate;
+	struct sk_buff *skb;
+
+	WARN_ON_ONCE(softirq_count() == 0);
+
+	if (!ieee80211_rx_accepting(local)) {
+		__skb_queue_purge(list);
+		return;
+	}
+
+	rcu_read_lock();
+	while ((skb = __skb_dequeue(list))) {
+		if (!ieee80211_rx_check_status(local, skb, &rate)) {
+			kfree_skb(skb);
+			continue;
+		}
+
+		ieee80211_rx_one(hw, skb, rate, &batch);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(ieee80211_rx_list);
+
 
 /* This is a version of the rx handler that can be called from hard irq
  * context. Post the skb on the queue and schedule the tasklet */
@@ -17,6 +17,8 @@
 #include <linux/if_arp.h>
 #include <linux/timer.h>
 #include <linux/rtnetlink.h>
+#include <linux/random.h>
+#include <linux/log2.h>
 
 #include <net/mac80211.h>
 #include "ieee80211_i.h"
@@ -63,34 +65,129 @@
  * freed before they are done using it.
  */
 
+static struct sta_hash_table *sta_hash_table_alloc(int size_order, int link)
+{
+	struct sta_hash_table *tbl;
+
+	tbl = kzalloc(sizeof(*tbl) +
+		      (sizeof(tbl->buckets[0]) << size_order), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	tbl->hash_mask = (1 << size_order) - 1;
+	tbl->link = link;
+	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
+
+	return tbl;
+}
+
+static inline struct sta_hash_table *
+sta_hash_table_get(struct ieee80211_local *local)
+{
+	return rcu_dereference_protected(local->sta_hash,
+					 lockdep_is_held(&local->sta_mtx));
+}
+
+static bool sta_info_hash_overloaded(struct ieee80211_local *local,
+				     struct sta_hash_table *tbl)
+{
+	return local->num_sta > (tbl->hash_mask + 1) * STA_HASH_MAX_LOAD &&
+	       ilog2(tbl->hash_mask + 1) < STA_HASH_MAX_ORDER;
+}
+
+/*
+ * Grow the table from process context, the old table can only be freed
+ * (and its link reused) after a grace period.
+ */
+static void sta_info_hash_grow(struct work_struct *work)
+{
+	struct ieee80211_local *local =
+		container_of(work, struct ieee80211_local, sta_hash_work);
+	struct sta_hash_table *oldtbl, *newtbl;
+	struct sta_info *sta;
+	struct sta_info __rcu **bucket;
+	int order;
+
+	mutex_lock(&local->sta_mtx);
+
+	oldtbl = sta_hash_table_get(local);
+	if (!sta_info_hash_overloaded(local, oldtbl)) {
+		mutex_unlock(&local->sta_mtx);
+		return;
+	}
+
+	order = ilog2(oldtbl->hash_mask + 1) + 1;
+	newtbl = sta_hash_table_alloc(order, !oldtbl->link);
+	if (!newtbl) {
+		mutex_unlock(&local->sta_mtx);
+		return;
+	}
+
+	/*
+	 * Readers of the old table follow hnext[oldtbl->link], which
+	 * isn't touched here. Every station is linked into the new
+	 * table before it is published.
+	 */
+	list_for_each_entry(sta, &local->sta_list, list) {
+		bucket = sta_hash_bucket(newtbl, sta->sta.addr);
+		RCU_INIT_POINTER(sta->hnext[newtbl->link],
+				 rcu_access_pointer(*bucket));
+		RCU_INIT_POINTER(*bucket, sta);
+	}
+
+	rcu_assign_pointer(local->sta_hash, newtbl);
+	mutex_unlock(&local->sta_mtx);
+
+	/*
+	 * Wait for all readers of the old table before freeing it, this
+	 * also makes its link available again for the next resize.
+	 */
+	synchronize_rcu();
+	kfree(oldtbl);
+}
+
 /* Caller must hold local->sta_mtx */
 static int sta_info_hash_del(struct ieee80211_local *local,
 			     struct sta_info *sta)
 {
+	struct sta_hash_table *tbl = sta_hash_table_get(local);
+	struct sta_info __rcu **pprev = sta_hash_bucket(tbl, sta->sta.addr);
 	struct sta_info *s;
 
-	s = rcu_dereference_protected(local->sta_hash[STA_HASH(sta->sta.addr)],
-				      lockdep_is_held(&local->sta_mtx));
-	if (!s)
-		return -ENOENT;
-	if (s == sta) {
-		rcu_assign_pointer(local->sta_hash[STA_HASH(sta->sta.addr)],
-				   s->hnext);
-		return 0;
-	}
-
-	while (rcu_access_pointer(s->hnext) &&
-	       rcu_access_pointer(s->hnext) != sta)
-		s = rcu_dereference_protected(s->hnext,
-					lockdep_is_held(&local->sta_mtx));
-	if (rcu_access_pointer(s->hnext)) {
-		rcu_assign_pointer(s->hnext, sta->hnext);
-		return 0;
+	while ((s = rcu_dereference_protected(*pprev,
+				lockdep_is_held(&local->sta_mtx)))) {
+		if (s == sta) {
+			rcu_assign_pointer(*pprev, s->hnext[tbl->link]);
+			return 0;
+		}
+		pprev = &s->hnext[tbl->link];
 	}
 
 	return -ENOENT;
 }
 
+static void sta_info_purge_txqs(struct ieee80211_local *local,
+				struct sta_info *sta)
+{
+	int i;
+
+	if (!sta->sta.txq[0])
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++)
+		ieee80211_txq_purge(local, to_txq_info(sta->sta.txq[i]));
+}
+
+static void sta_info_ps_unlink(struct sta_info *sta)
+{
+	struct ieee80211_local *local = sta->local;
+	unsigned long flags;
+
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+	list_del_init(&sta->ps_buf_list);
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
+}
+
 static void cleanup_single_sta(struct sta_info *sta)
 {
 	int ac, i;
@@ -129,12 +226,19 @@ static void cleanup_single_sta(struct sta_info *sta)
 		sta_info_recalc_tim(sta);
 	}
 
+	sta_info_ps_unlink(sta);
+
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
-		local->total_ps_buffered -= skb_queue_len(&sta->ps_tx_buf[ac]);
+		atomic_sub(skb_queue_len(&sta->ps_tx_buf[ac]),
+			   &local->total_ps_buffered);
 		ieee80211_purge_tx_queue(&local->hw, &sta->ps_tx_buf[ac]);
+		sta->ps_tx_bytes[ac] = 0;
 		ieee80211_purge_tx_queue(&local->hw, &sta->tx_filtered[ac]);
 	}
 
+	/* catch frames queued by TX paths that raced with the removal */
+	sta_info_purge_txqs(local, sta);
+
 #ifdef CONFIG_MAC80211_MESH
 	if (ieee80211_vif_is_mesh(&sdata->vif)) {
 		mesh_accept_plinks_update(sdata);
@@ -198,15 +302,18 @@ struct sta_info *sta_info_get(struct ieee80211_sub_if_data *sdata,
 			      const u8 *addr)
 {
 	struct ieee80211_local *local = sdata->local;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta;
 
-	sta = rcu_dereference_check(local->sta_hash[STA_HASH(addr)],
+	tbl = rcu_dereference_check(local->sta_hash,
+				    lockdep_is_held(&local->sta_mtx));
+	sta = rcu_dereference_check(*sta_hash_bucket(tbl, addr),
 				    lockdep_is_held(&local->sta_mtx));
 	while (sta) {
 		if (sta->sdata == sdata &&
 		    ether_addr_equal(sta->sta.addr, addr))
 			break;
-		sta = rcu_dereference_check(sta->hnext,
+		sta = rcu_dereference_check(sta->hnext[tbl->link],
 					    lockdep_is_held(&local->sta_mtx));
 	}
 	return sta;
@@ -220,16 +327,19 @@ struct sta_info *sta_info_get_bss(struct ieee80211_sub_if_data *sdata,
 				  const u8 *addr)
 {
 	struct ieee80211_local *local = sdata->local;
+	struct sta_hash_table *tbl;
 	struct sta_info *sta;
 
-	sta = rcu_dereference_check(local->sta_hash[STA_HASH(addr)],
+	tbl = rcu_dereference_check(local->sta_hash,
+				    lockdep_is_held(&local->sta_mtx));
+	sta = rcu_dereference_check(*sta_hash_bucket(tbl, addr),
 				    lockdep_is_held(&local->sta_mtx));
 	while (sta) {
 		if ((sta->sdata == sdata ||
 		     (sta->sdata->bss && sta->sdata->bss == sdata->bss)) &&
 		    ether_addr_equal(sta->sta.addr, addr))
 			break;
-		sta = rcu_dereference_check(sta->hnext,
+		sta = rcu_dereference_check(sta->hnext[tbl->link],
 					    lockdep_is_held(&local->sta_mtx));
 	}
 	return sta;
@@ -271,6 +381,19 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 	if (sta->rate_ctrl)
 		rate_control_free_sta(sta);
 
+	if (sta->sta.txq[0])
+		kfree(to_txq_info(sta->sta.txq[0]));
+
+	if (sta->fragments) {
+		int i;
+
+		for (i = 0; i <= IEEE80211_NUM_TIDS; i++)
+			__skb_queue_purge(&sta->fragments[i].skb_list);
+		kfree(sta->fragments);
+	}
+
+	kfree(rcu_dereference_raw(sta->fast_tx));
+
 	sta_dbg(sta->sdata, "Destroyed STA %pM\n", sta->sta.addr);
 
 	kfree(sta);
@@ -280,9 +403,19 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 static void sta_info_hash_add(struct ieee80211_local *local,
 			      struct sta_info *sta)
 {
+	struct sta_hash_table *tbl;
+	struct sta_info __rcu **bucket;
+
 	lockdep_assert_held(&local->sta_mtx);
-	sta->hnext = local->sta_hash[STA_HASH(sta->sta.addr)];
-	rcu_assign_pointer(local->sta_hash[STA_HASH(sta->sta.addr)], sta);
+
+	tbl = sta_hash_table_get(local);
+	if (sta_info_hash_overloaded(local, tbl))
+		schedule_work(&local->sta_hash_work);
+
+	bucket = sta_hash_bucket(tbl, sta->sta.addr);
+	RCU_INIT_POINTER(sta->hnext[tbl->link],
+			 rcu_access_pointer(*bucket));
+	rcu_assign_pointer(*bucket, sta);
 }
 
 static void sta_unblock(struct work_struct *wk)
@@ -342,6 +475,8 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 		return NULL;
 
 	spin_lock_init(&sta->lock);
+	INIT_LIST_HEAD(&sta->ps_buf_list);
+	spin_lock_init(&sta->rx_path_lock);
 	INIT_WORK(&sta->drv_unblock_wk, sta_unblock);
 	INIT_WORK(&sta->ampdu_mlme.work, ieee80211_ba_session_work);
 	mutex_init(&sta->ampdu_mlme.mtx);
@@ -357,7 +492,25 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	sta->last_connected = uptime.tv_sec;
 	ewma_init(&sta->avg_signal, 1024, 8);
 
+	if (local->ops->wake_tx_queue) {
+		void *txq_data;
+		int size = ALIGN(sizeof(struct txq_info) +
+				 local->hw.txq_data_size, sizeof(void *));
+
+		txq_data = kcalloc(ARRAY_SIZE(sta->sta.txq), size, gfp);
+		if (!txq_data) {
+			kfree(sta);
+			return NULL;
+		}
+
+		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++)
+			ieee80211_init_tx_queue(sdata, sta,
+						txq_data + i * size, i);
+	}
+
 	if (sta_prepare_rate_control(local, sta, gfp)) {
+		if (sta->sta.txq[0])
+			kfree(to_txq_info(sta->sta.txq[0]));
 		kfree(sta);
 		return NULL;
 	}
@@ -480,6 +633,8 @@ static int sta_info_insert_finish(struct sta_info *sta) __acquires(RCU)
 
 	set_sta_flag(sta, WLAN_STA_INSERTED);
 
+	ieee80211_check_fast_xmit(sta);
+
 	ieee80211_sta_debugfs_add(sta);
 	rate_control_add_sta_debugfs(sta);
 
@@ -539,22 +694,50 @@ int sta_info_insert(struct sta_info *sta)
 	return err;
 }
 
-static inline void __bss_tim_set(u8 *tim, u16 id)
+static inline void __bss_tim_set(struct ps_data *ps, u16 id)
 {
+	u8 *tim = &ps->tim[id / 8];
+	u8 mask = 1 << (id % 8);
+
+	if (*tim & mask)
+		return;
+
 	/*
 	 * This format has been mandated by the IEEE specifications,
 	 * so this line may not be changed to use the __set_bit() format.
 	 */
-	tim[id / 8] |= (1 << (id % 8));
+	*tim |= mask;
+
+	if (!ps->tim_bits++) {
+		ps->tim_first = ps->tim_last = id / 8;
+	} else {
+		ps->tim_first = min_t(u8, ps->tim_first, id / 8);
+		ps->tim_last = max_t(u8, ps->tim_last, id / 8);
+	}
 }
 
-static inline void __bss_tim_clear(u8 *tim, u16 id)
+static inline void __bss_tim_clear(struct ps_data *ps, u16 id)
 {
+	u8 *tim = &ps->tim[id / 8];
+	u8 mask = 1 << (id % 8);
+
+	if (!(*tim & mask))
+		return;
+
 	/*
 	 * This format has been mandated by the IEEE specifications,
 	 * so this line may not be changed to use the __clear_bit() format.
 	 */
-	tim[id / 8] &= ~(1 << (id % 8));
+	*tim &= ~mask;
+
+	if (!--ps->tim_bits || *tim)
+		return;
+
+	/* if this was the first or last byte with bits set, move inwards */
+	while (!ps->tim[ps->tim_first])
+		ps->tim_first++;
+	while (!ps->tim[ps->tim_last])
+		ps->tim_last--;
 }
 
 static unsigned long ieee80211_tids_for_ac(int ac)
@@ -575,6 +758,47 @@ static unsigned long ieee80211_tids_for_ac(int ac)
 	}
 }
 
+/*
+ * Buffer a frame for a dozing station. Stations go to the end of the
+ * local list when they start buffering; a station that had all of its
+ * frames released while staying on the list is only removed from it
+ * when frames have to be dropped, see purge_old_ps_buffers().
+ */
+void sta_info_ps_queue(struct sta_info *sta, int ac, struct sk_buff *skb)
+{
+	struct ieee80211_local *local = sta->local;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
+	__skb_queue_tail(&sta->ps_tx_buf[ac], skb);
+	sta->ps_tx_bytes[ac] += skb->len;
+	spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
+
+	atomic_inc(&local->total_ps_buffered);
+
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+	if (list_empty(&sta->ps_buf_list))
+		list_add_tail(&sta->ps_buf_list, &local->ps_buf_stas);
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
+}
+
+struct sk_buff *sta_info_ps_dequeue(struct sta_info *sta, int ac)
+{
+	unsigned long flags;
+	struct sk_buff *skb;
+
+	spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
+	skb = __skb_dequeue(&sta->ps_tx_buf[ac]);
+	if (skb)
+		sta->ps_tx_bytes[ac] -= skb->len;
+	spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
+
+	if (skb)
+		atomic_dec(&sta->local->total_ps_buffered);
+
+	return skb;
+}
+
 void sta_info_recalc_tim(struct sta_info *sta)
 {
 	struct ieee80211_local *local = sta->local;
@@ -633,9 +857,9 @@ void sta_info_recalc_tim(struct sta_info *sta)
 	spin_lock_irqsave(&local->tim_lock, flags);
 
 	if (indicate_tim)
-		__bss_tim_set(ps->tim, id);
+		__bss_tim_set(ps, id);
 	else
-		__bss_tim_clear(ps->tim, id);
+		__bss_tim_clear(ps, id);
 
 	if (local->ops->set_tim) {
 		local->tim_in_locked_section = true;
@@ -708,10 +932,12 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 	for (;;) {
 		spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
 		skb = skb_peek(&sta->ps_tx_buf[ac]);
-		if (sta_info_buffer_expired(sta, skb))
-			skb = __skb_dequeue(&sta->ps_tx_buf[ac]);
-		else
+		if (sta_info_buffer_expired(sta, skb)) {
+			__skb_unlink(skb, &sta->ps_tx_buf[ac]);
+			sta->ps_tx_bytes[ac] -= skb->len;
+		} else {
 			skb = NULL;
+		}
 		spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
 
 		/*
@@ -722,7 +948,7 @@ static bool sta_info_cleanup_expire_buffered_ac(struct ieee80211_local *local,
 		if (!skb)
 			break;
 
-		local->total_ps_buffered--;
+		atomic_dec(&local->total_ps_buffered);
 		ps_dbg(sta->sdata, "Buffered frame expired (STA %pM)\n",
 		       sta->sta.addr);
 		ieee80211_free_txskb(&local->hw, skb);
@@ -815,6 +1041,9 @@ int __must_check __sta_info_destroy(struct sta_info *sta)
 		}
 	}
 
+	/* the driver must not find frames for the station after this */
+	sta_info_purge_txqs(local, sta);
+
 	if (sta->uploaded) {
 		ret = drv_sta_state(local, sdata, sta, IEEE80211_STA_NONE,
 				    IEEE80211_STA_NOTEXIST);
@@ -882,19 +1111,37 @@ static void sta_info_cleanup(unsigned long data)
 		  round_jiffies(jiffies + STA_INFO_CLEANUP_INTERVAL));
 }
 
-void sta_info_init(struct ieee80211_local *local)
+int sta_info_init(struct ieee80211_local *local)
 {
+	struct sta_hash_table *tbl;
+
+	tbl = sta_hash_table_alloc(STA_HASH_MIN_ORDER, 0);
+	if (!tbl)
+		return -ENOMEM;
+	RCU_INIT_POINTER(local->sta_hash, tbl);
+
 	spin_lock_init(&local->tim_lock);
 	mutex_init(&local->sta_mtx);
 	INIT_LIST_HEAD(&local->sta_list);
+	INIT_WORK(&local->sta_hash_work, sta_info_hash_grow);
+	spin_lock_init(&local->ps_buf_lock);
+	INIT_LIST_HEAD(&local->ps_buf_stas);
 
 	setup_timer(&local->sta_cleanup, sta_info_cleanup,
 		    (unsigned long)local);
+	return 0;
+}
+
+void sta_info_deinit(struct ieee80211_local *local)
+{
+	kfree(rcu_dereference_raw(local->sta_hash));
+	RCU_INIT_POINTER(local->sta_hash, NULL);
 }
 
 void sta_info_stop(struct ieee80211_local *local)
 {
 	del_timer_sync(&local->sta_cleanup);
+	cancel_work_sync(&local->sta_hash_work);
 }
 
 
@@ -950,13 +1197,14 @@ struct ieee80211_sta *ieee80211_find_sta_by_ifaddr(struct ieee80211_hw *hw,
 					       const u8 *addr,
 					       const u8 *localaddr)
 {
+	struct sta_hash_table *tbl;
 	struct sta_info *sta, *nxt;
 
 	/*
 	 * Just return a random station if localaddr is NULL
 	 * ... first in list.
 	 */
-	for_each_sta_info(hw_to_local(hw), addr, sta, nxt) {
+	for_each_sta_info(hw_to_local(hw), tbl, addr, sta, nxt) {
 		if (localaddr &&
 		    !ether_addr_equal(sta->sdata->vif.addr, localaddr))
 			continue;
@@ -1024,6 +1272,9 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 
 	skb_queue_head_init(&pending);
 
+	/* frames buffered from now on put the station back on the list */
+	sta_info_ps_unlink(sta);
+
 	/* Send all buffered frames to the station */
 	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
 		int count = skb_queue_len(&pending), tmp;
@@ -1037,6 +1288,7 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 
 		spin_lock_irqsave(&sta->ps_tx_buf[ac].lock, flags);
 		skb_queue_splice_tail_init(&sta->ps_tx_buf[ac], &pending);
+		sta->ps_tx_bytes[ac] = 0;
 		spin_unlock_irqrestore(&sta->ps_tx_buf[ac].lock, flags);
 		tmp = skb_queue_len(&pending);
 		buffered += tmp - count;
@@ -1044,10 +1296,12 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 
 	ieee80211_add_pending_skbs_fn(local, &pending, clear_sta_ps_flags, sta);
 
-	local->total_ps_buffered -= buffered;
+	atomic_sub(buffered, &local->total_ps_buffered);
 
 	sta_info_recalc_tim(sta);
 
+	ieee80211_check_fast_xmit(sta);
+
 	ps_dbg(sdata,
 	       "STA %pM aid %d sending %d filtered/%d PS frames since STA not sleeping anymore\n",
 	       sta->sta.addr, sta->sta.aid, filtered, buffered);
@@ -1164,12 +1418,9 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 
 				while (n_frames > 0) {
 					skb = skb_dequeue(&sta->tx_filtered[ac]);
-					if (!skb) {
-						skb = skb_dequeue(
-							&sta->ps_tx_buf[ac]);
-						if (skb)
-							local->total_ps_buffered--;
-					}
+					if (!skb)
+						skb = sta_info_ps_dequeue(sta,
+									  ac);
 					if (!skb)
 						break;
 					n_frames--;
@@ -1503,5 +1754,7 @@ int sta_info_move_state(struct sta_info *sta,
 
 	sta->sta_state = new_state;
 
+	ieee80211_check_fast_xmit(sta);
+
 	return 0;
 }
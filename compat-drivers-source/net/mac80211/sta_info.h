@@ -15,6 +15,7 @@
 #include <linux/workqueue.h>
 #include <linux/average.h>
 #include <linux/etherdevice.h>
+#include <linux/jhash.h>
 #include "key.h"
 
 /**
@@ -147,6 +148,7 @@ struct tid_ampdu_tx {
  *
  * @reorder_buf: buffer to reorder incoming aggregated MPDUs
  * @reorder_time: jiffies when skb was added
+ * @reorder_bitmap: slots of @reorder_buf holding a frame
  * @session_timer: check if peer keeps Tx-ing on the TID (by timeout value)
  * @reorder_timer: releases expired frames from the reorder buffer.
  * @last_rx: jiffies of last rx activity
@@ -172,6 +174,7 @@ struct tid_ampdu_rx {
 	spinlock_t reorder_lock;
 	struct sk_buff **reorder_buf;
 	unsigned long *reorder_time;
+	unsigned long reorder_bitmap[BITS_TO_LONGS(IEEE80211_MAX_AMPDU_BUF)];
 	struct timer_list session_timer;
 	struct timer_list reorder_timer;
 	unsigned long last_rx;
@@ -215,6 +218,29 @@ struct sta_ampdu_mlme {
 	u8 dialog_token_allocator;
 };
 
+/**
+ * struct ieee80211_fast_tx - TX fast path information
+ *
+ * Data frames to an authorized station usually go through the TX
+ * handlers with the same outcome, this caches what they'd decide so
+ * that such frames can be converted and handed to the driver directly.
+ *
+ * @key: hardware key to use, if any
+ * @hdr_len: length of the 802.11 header, including QoS control and room
+ *	for the CCMP header or TKIP IV if the hardware needs it
+ * @da_offs: offset of the destination address in @hdr
+ * @sa_offs: offset of the source address in @hdr
+ * @hdr: 802.11 header template, followed by the RFC 1042 header
+ * @rcu_head: RCU head used for freeing this struct
+ */
+struct ieee80211_fast_tx {
+	struct ieee80211_key *key;
+	u8 hdr_len;
+	u8 da_offs;
+	u8 sa_offs;
+	u8 hdr[30 + 2 + CCMP_HDR_LEN + sizeof(rfc1042_header)];
+	struct rcu_head rcu_head;
+};
 
 /**
  * struct sta_info - STA information
@@ -223,7 +249,8 @@ struct sta_ampdu_mlme {
  * mac80211 is communicating with.
  *
  * @list: global linked list entry
- * @hnext: hash table linked list pointer
+ * @hnext: hash table linked list pointers, one per table link, see
+ *	&struct sta_hash_table
  * @local: pointer to the global information
  * @sdata: virtual interface this station belongs to
  * @ptk: peer key negotiated with this station, if any
@@ -237,11 +264,22 @@ struct sta_ampdu_mlme {
  * @last_rx_rate_vht_nss: rx status nss of last data packet
  * @lock: used for locking all fields that require locking, see comments
  *	in the header file.
+ * @rx_path_lock: serializes the RX handlers for frames from this station,
+ *	including frames released from the reorder buffers
+ * @fragments: defragmentation contexts indexed by RX sequence number index
+ *	(TID, or IEEE80211_NUM_TIDS for non-QoS), allocated when the station
+ *	first sends a fragmented frame; protected by @rx_path_lock
+ * @fast_tx: TX fast path information, rebuilt by ieee80211_check_fast_xmit()
+ *	whenever anything it depends on changes; updates are protected by
+ *	@lock
  * @drv_unblock_wk: used for driver PS unblocking
  * @listen_interval: listen interval of this station, when we're acting as AP
  * @_flags: STA flags, see &enum ieee80211_sta_info_flags, do not use directly
  * @ps_tx_buf: buffers (per AC) of frames to transmit to this station
  *	when it leaves power saving state or polls
+ * @ps_tx_bytes: bytes (per AC) in @ps_tx_buf, protected by the queue locks
+ * @ps_buf_list: entry in the local list of stations with PS-buffered
+ *	frames, protected by local->ps_buf_lock
  * @tx_filtered: buffers (per AC) of frames we already tried to
  *	transmit but were filtered by hardware due to STA having
  *	entered power saving state, these are also delivered to
@@ -296,7 +334,7 @@ struct sta_info {
 	/* General information, mostly static */
 	struct list_head list;
 	struct rcu_head rcu_head;
-	struct sta_info __rcu *hnext;
+	struct sta_info __rcu *hnext[2];
 	struct ieee80211_local *local;
 	struct ieee80211_sub_if_data *sdata;
 	struct ieee80211_key __rcu *gtk[NUM_DEFAULT_KEYS + NUM_DEFAULT_MGMT_KEYS];
@@ -304,6 +342,9 @@ struct sta_info {
 	struct rate_control_ref *rate_ctrl;
 	void *rate_ctrl_priv;
 	spinlock_t lock;
+	spinlock_t rx_path_lock;
+	struct ieee80211_fragment_entry *fragments;
+	struct ieee80211_fast_tx __rcu *fast_tx;
 
 	struct work_struct drv_unblock_wk;
 
@@ -323,6 +364,8 @@ struct sta_info {
 	 * locking required.
 	 */
 	struct sk_buff_head ps_tx_buf[IEEE80211_NUM_ACS];
+	unsigned int ps_tx_bytes[IEEE80211_NUM_ACS];
+	struct list_head ps_buf_list;
 	struct sk_buff_head tx_filtered[IEEE80211_NUM_ACS];
 	unsigned long driver_buffered_tids;
 
@@ -473,13 +516,60 @@ rcu_dereference_protected_tid_tx(struct sta_info *sta, int tid)
 					 lockdep_is_held(&sta->ampdu_mlme.mtx));
 }
 
-#define STA_HASH_SIZE 256
-#define STA_HASH(sta) (sta[5])
+/*
+ * The station hash table starts out with 2^STA_HASH_MIN_ORDER buckets
+ * and is doubled, shortly after the number of stations exceeds the number
+ * of buckets times STA_HASH_MAX_LOAD, up to 2^STA_HASH_MAX_ORDER buckets.
+ */
+#define STA_HASH_MIN_ORDER	6
+#define STA_HASH_MAX_ORDER	14
+#define STA_HASH_MAX_LOAD	2
+
+/**
+ * struct sta_hash_table - station hash table
+ *
+ * Stations are hashed by their full MAC address only, so that all
+ * stations with the same address (on different interfaces) share a
+ * chain, as required by for_each_sta_info() and sta_info_get_bss().
+ *
+ * The table is resized from a work item, since stations may be added
+ * within an RCU read-side critical section. Under
+ * &ieee80211_local.sta_mtx, the work builds a new table that chains
+ * the stations through the other @hnext link and publishes it, then
+ * waits for an RCU grace period before the old table is freed. Readers
+ * keep following the link of the table they started with, so they
+ * never observe a half-built chain.
+ *
+ * @hash_mask: number of buckets minus one
+ * @hash_rnd: random seed for the hash function
+ * @link: index into &struct sta_info.hnext used by this table
+ * @buckets: hash buckets
+ */
+struct sta_hash_table {
+	u32 hash_mask;
+	u32 hash_rnd;
+	int link;
+	struct sta_info __rcu *buckets[0];
+};
+
+static inline u32 sta_hash_index(struct sta_hash_table *tbl, const u8 *addr)
+{
+	return jhash(addr, ETH_ALEN, tbl->hash_rnd) & tbl->hash_mask;
+}
+
+static inline struct sta_info __rcu **
+sta_hash_bucket(struct sta_hash_table *tbl, const u8 *addr)
+{
+	return &tbl->buckets[sta_hash_index(tbl, addr)];
+}
 
 
 /* Maximum number of frames to buffer per power saving station per AC */
 #define STA_MAX_TX_BUFFER	64
 
+/* Maximum number of bytes to buffer per power saving station per AC */
+#define STA_MAX_TX_BUFFER_BYTES	(48 * 1024)
+
 /* Minimum buffered frame expiry time. If STA uses listen interval that is
  * smaller than this value, the minimum value here is used instead. */
 #define STA_TX_BUFFER_EXPIRE (10 * HZ)
@@ -499,23 +589,30 @@ struct sta_info *sta_info_get_bss(struct ieee80211_sub_if_data *sdata,
 
 static inline
 void for_each_sta_info_type_check(struct ieee80211_local *local,
+				  struct sta_hash_table *tbl,
 				  const u8 *addr,
 				  struct sta_info *sta,
 				  struct sta_info *nxt)
 {
 }
 
-#define for_each_sta_info(local, _addr, _sta, nxt)			\
+/*
+ * Iterate all stations with the given address, must be under RCU
+ * read lock. @tbl is a caller-provided cursor that pins the hash
+ * table (and thereby the link) the walk was started on.
+ */
+#define for_each_sta_info(local, tbl, _addr, _sta, nxt)		\
 	for (	/* initialise loop */					\
-		_sta = rcu_dereference(local->sta_hash[STA_HASH(_addr)]),\
-		nxt = _sta ? rcu_dereference(_sta->hnext) : NULL;	\
+		tbl = rcu_dereference((local)->sta_hash),		\
+		_sta = rcu_dereference(*sta_hash_bucket(tbl, (_addr))),	\
+		nxt = _sta ? rcu_dereference(_sta->hnext[tbl->link]) : NULL;\
 		/* typecheck */						\
-		for_each_sta_info_type_check(local, (_addr), _sta, nxt),\
+		for_each_sta_info_type_check(local, tbl, (_addr), _sta, nxt),\
 		/* continue condition */				\
 		_sta;							\
 		/* advance loop */					\
 		_sta = nxt,						\
-		nxt = _sta ? rcu_dereference(_sta->hnext) : NULL	\
+		nxt = _sta ? rcu_dereference(_sta->hnext[tbl->link]) : NULL\
 	     )								\
 	/* compare address and run code only if it matches */		\
 	if (ether_addr_equal(_sta->sta.addr, (_addr)))
@@ -552,8 +649,11 @@ int sta_info_destroy_addr_bss(struct ieee80211_sub_if_data *sdata,
 			      const u8 *addr);
 
 void sta_info_recalc_tim(struct sta_info *sta);
+void sta_info_ps_queue(struct sta_info *sta, int ac, struct sk_buff *skb);
+struct sk_buff *sta_info_ps_dequeue(struct sta_info *sta, int ac);
 
-void sta_info_init(struct ieee80211_local *local);
+int sta_info_init(struct ieee80211_local *local);
+void sta_info_deinit(struct ieee80211_local *local);
 void sta_info_stop(struct ieee80211_local *local);
 int sta_info_flush_defer(struct ieee80211_sub_if_data *sdata);
 
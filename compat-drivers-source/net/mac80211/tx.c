@@ -313,53 +313,43 @@ ieee80211_tx_h_check_assoc(struct ieee80211_tx_data *tx)
 	return TX_CONTINUE;
 }
 
-/* This function is called whenever the AP is about to exceed the maximum limit
- * of buffered frames for power saving STAs. This situation should not really
- * happen often during normal operation, so dropping the oldest buffered packet
- * from each queue should be OK to make some room for new frames. */
-static void purge_old_ps_buffers(struct ieee80211_local *local)
+/*
+ * Drop a frame buffered for the station that has been buffering the
+ * longest, from the lowest-priority AC that has frames at all. The
+ * station then goes to the end of the list so that stations take turns
+ * losing frames. Stations whose frames were all released or expired
+ * while they stayed on the list are taken off it on the way.
+ *
+ * Returns whether a frame was dropped.
+ */
+static bool purge_old_ps_buffers(struct ieee80211_local *local)
 {
-	int total = 0, purged = 0;
-	struct sk_buff *skb;
-	struct ieee80211_sub_if_data *sdata;
+	struct sk_buff *skb = NULL;
 	struct sta_info *sta;
+	unsigned long flags;
+	int ac;
 
-	list_for_each_entry_rcu(sdata, &local->interfaces, list) {
-		struct ps_data *ps;
+	spin_lock_irqsave(&local->ps_buf_lock, flags);
+	while (!skb && !list_empty(&local->ps_buf_stas)) {
+		sta = list_first_entry(&local->ps_buf_stas, struct sta_info,
+				       ps_buf_list);
 
-		if (sdata->vif.type == NL80211_IFTYPE_AP)
-			ps = &sdata->u.ap.ps;
-		else
-			continue;
+		for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO && !skb; ac--)
+			skb = sta_info_ps_dequeue(sta, ac);
 
-		skb = skb_dequeue(&ps->bc_buf);
-		if (skb) {
-			purged++;
-			dev_kfree_skb(skb);
-		}
-		total += skb_queue_len(&ps->bc_buf);
+		if (skb)
+			list_move_tail(&sta->ps_buf_list, &local->ps_buf_stas);
+		else
+			list_del_init(&sta->ps_buf_list);
 	}
+	spin_unlock_irqrestore(&local->ps_buf_lock, flags);
 
-	/*
-	 * Drop one frame from each station from the lowest-priority
-	 * AC that has frames at all.
-	 */
-	list_for_each_entry_rcu(sta, &local->sta_list, list) {
-		int ac;
-
-		for (ac = IEEE80211_AC_BK; ac >= IEEE80211_AC_VO; ac--) {
-			skb = skb_dequeue(&sta->ps_tx_buf[ac]);
-			total += skb_queue_len(&sta->ps_tx_buf[ac]);
-			if (skb) {
-				purged++;
-				ieee80211_free_txskb(&local->hw, skb);
-				break;
-			}
-		}
-	}
+	if (!skb)
+		return false;
 
-	local->total_ps_buffered = total;
-	ps_dbg_hw(&local->hw, "PS buffers full - purged %d frames\n", purged);
+	ps_dbg_hw(&local->hw, "PS buffers full - purged a frame\n");
+	ieee80211_free_txskb(&local->hw, skb);
+	return true;
 }
 
 static ieee80211_tx_result
@@ -406,15 +396,20 @@ ieee80211_tx_h_multicast_ps_buf(struct ieee80211_tx_data *tx)
 		return TX_CONTINUE;
 
 	/* buffered in mac80211 */
-	if (tx->local->total_ps_buffered >= TOTAL_MAX_TX_BUFFER)
-		purge_old_ps_buffers(tx->local);
-
-	if (skb_queue_len(&ps->bc_buf) >= AP_MAX_BC_BUFFER) {
+	/*
+	 * Unicast frames go first when all buffers are full, multicast
+	 * frames only make room for each other.
+	 */
+	if (skb_queue_len(&ps->bc_buf) >= AP_MAX_BC_BUFFER ||
+	    (atomic_read(&tx->local->total_ps_buffered) >=
+						TOTAL_MAX_TX_BUFFER &&
+	     !purge_old_ps_buffers(tx->local) &&
+	     !skb_queue_empty(&ps->bc_buf))) {
 		ps_dbg(tx->sdata,
 		       "BC TX buffer full - dropping the oldest frame\n");
 		dev_kfree_skb(skb_dequeue(&ps->bc_buf));
 	} else
-		tx->local->total_ps_buffered++;
+		atomic_inc(&tx->local->total_ps_buffered);
 
 	skb_queue_tail(&ps->bc_buf, tx->skb);
 
@@ -464,21 +459,28 @@ ieee80211_tx_h_unicast_ps_buf(struct ieee80211_tx_data *tx)
 
 		ps_dbg(sta->sdata, "STA %pM aid %d: PS buffer for AC %d\n",
 		       sta->sta.addr, sta->sta.aid, ac);
-		if (tx->local->total_ps_buffered >= TOTAL_MAX_TX_BUFFER)
+		if (atomic_read(&tx->local->total_ps_buffered) >=
+							TOTAL_MAX_TX_BUFFER)
 			purge_old_ps_buffers(tx->local);
-		if (skb_queue_len(&sta->ps_tx_buf[ac]) >= STA_MAX_TX_BUFFER) {
-			struct sk_buff *old = skb_dequeue(&sta->ps_tx_buf[ac]);
+
+		/* make room within the frame and byte limits of the AC */
+		while (skb_queue_len(&sta->ps_tx_buf[ac]) >= STA_MAX_TX_BUFFER ||
+		       sta->ps_tx_bytes[ac] + tx->skb->len >
+						STA_MAX_TX_BUFFER_BYTES) {
+			struct sk_buff *old = sta_info_ps_dequeue(sta, ac);
+
+			if (!old)
+				break;
 			ps_dbg(tx->sdata,
 			       "STA %pM TX buffer for AC %d full - dropping oldest frame\n",
 			       sta->sta.addr, ac);
 			ieee80211_free_txskb(&local->hw, old);
-		} else
-			tx->local->total_ps_buffered++;
+		}
 
 		info->control.jiffies = jiffies;
 		info->control.vif = &tx->sdata->vif;
 		info->flags |= IEEE80211_TX_INTFL_NEED_TXPROCESSING;
-		skb_queue_tail(&sta->ps_tx_buf[ac], tx->skb);
+		sta_info_ps_queue(sta, ac, tx->skb);
 
 		if (!timer_pending(&local->sta_cleanup))
 			mod_timer(&local->sta_cleanup,
@@ -1200,6 +1202,75 @@ ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
 	return TX_CONTINUE;
 }
 
+/*
+ * Returns the intermediate queue a frame should wait on, if the driver
+ * uses them. Only data MSDUs that won't be fragmented are queued;
+ * management and null data frames, retransmissions and frames that have
+ * to go out on a particular hardware queue are handed to the driver
+ * directly. So are multicast frames of AP_VLAN interfaces, their keys
+ * couldn't be found again when they leave the AP's queue.
+ */
+static struct txq_info *ieee80211_get_txq(struct ieee80211_local *local,
+					  struct ieee80211_sub_if_data *sdata,
+					  struct sta_info *sta,
+					  struct sk_buff *skb)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_txq *txq = NULL;
+
+	if (!local->ops->wake_tx_queue)
+		return NULL;
+
+	if (!ieee80211_is_data_present(hdr->frame_control) ||
+	    !(info->flags & IEEE80211_TX_CTL_DONTFRAG) ||
+	    (info->flags & (IEEE80211_TX_CTL_SEND_AFTER_DTIM |
+			    IEEE80211_TX_CTL_TX_OFFCHAN |
+			    IEEE80211_TX_INTFL_RETRANSMISSION)))
+		return NULL;
+
+	if (sta && sta->uploaded)
+		txq = sta->sta.txq[skb->priority & IEEE80211_QOS_CTL_TID_MASK];
+	else if (sdata->vif.type != NL80211_IFTYPE_AP_VLAN &&
+		 sdata->vif.type != NL80211_IFTYPE_MONITOR)
+		txq = sdata->vif.txq;
+
+	return txq ? to_txq_info(txq) : NULL;
+}
+
+/*
+ * Puts a frame that has been through the early TX handlers on its
+ * intermediate queue. Returns false if it has to be sent directly.
+ */
+static bool ieee80211_queue_skb(struct ieee80211_local *local,
+				struct ieee80211_sub_if_data *sdata,
+				struct sta_info *sta,
+				struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct txq_info *txqi;
+	__le16 fc;
+
+	txqi = ieee80211_get_txq(local, sdata, sta, skb);
+	if (!txqi)
+		return false;
+
+	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN)
+		sdata = container_of(sdata->bss,
+				     struct ieee80211_sub_if_data, u.ap);
+
+	fc = ((struct ieee80211_hdr *)skb->data)->frame_control;
+	info->control.vif = &sdata->vif;
+
+	ieee80211_tpt_led_trig_tx(local, fc, skb->len);
+	ieee80211_led_tx(local, 1);
+
+	ieee80211_txq_enqueue(local, txqi, skb);
+	drv_wake_tx_queue(local, txqi);
+
+	return true;
+}
+
 static bool ieee80211_tx_frags(struct ieee80211_local *local,
 			       struct ieee80211_vif *vif,
 			       struct ieee80211_sta *sta,
@@ -1240,6 +1311,8 @@ static bool ieee80211_tx_frags(struct ieee80211_local *local,
 					       flags);
 			return false;
 		}
+		if (local->hw.flags & IEEE80211_HW_REPORTS_ALL_TX_STATUS)
+			__ieee80211_tx_limit_queued(local, skb);
 		spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
 		info->control.vif = vif;
@@ -1315,15 +1388,6 @@ static bool __ieee80211_tx(struct ieee80211_local *local,
 	return result;
 }
 
-/*
- * Invoke TX handlers, return 0 on success and non-zero if the
- * frame was dropped or queued.
- */
-static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
-{
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
-	ieee80211_tx_result res = TX_DROP;
-
 #define CALL_TXH(txh) \
 	do {				\
 		res = txh(tx);		\
@@ -1331,6 +1395,33 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 			goto txh_done;	\
 	} while (0)
 
+static int ieee80211_tx_handlers_done(struct ieee80211_tx_data *tx,
+				      ieee80211_tx_result res)
+{
+	if (unlikely(res == TX_DROP)) {
+		I802_DEBUG_INC(tx->local->tx_handlers_drop);
+		if (tx->skb)
+			ieee80211_free_txskb(&tx->local->hw, tx->skb);
+		else
+			ieee80211_purge_tx_queue(&tx->local->hw, &tx->skbs);
+		return -1;
+	} else if (unlikely(res == TX_QUEUED)) {
+		I802_DEBUG_INC(tx->local->tx_handlers_queued);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Invoke the TX handlers that decide whether and how a frame is sent,
+ * return 0 on success and non-zero if the frame was dropped or queued.
+ * Frames for intermediate TX queues wait there after these.
+ */
+static int invoke_tx_handlers_early(struct ieee80211_tx_data *tx)
+{
+	ieee80211_tx_result res = TX_DROP;
+
 	CALL_TXH(ieee80211_tx_h_dynamic_ps);
 	CALL_TXH(ieee80211_tx_h_check_assoc);
 	CALL_TXH(ieee80211_tx_h_ps_buf);
@@ -1339,6 +1430,20 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
 		CALL_TXH(ieee80211_tx_h_rate_ctrl);
 
+ txh_done:
+	return ieee80211_tx_handlers_done(tx, res);
+}
+
+/*
+ * Invoke the TX handlers that assign the sequence number, fragment and
+ * encrypt, return 0 on success and non-zero if the frame was dropped.
+ * Afterwards the frame (or its fragments) is on tx->skbs.
+ */
+static int invoke_tx_handlers_late(struct ieee80211_tx_data *tx)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
+	ieee80211_tx_result res = TX_CONTINUE;
+
 	if (unlikely(info->flags & IEEE80211_TX_INTFL_RETRANSMISSION)) {
 		__skb_queue_tail(&tx->skbs, tx->skb);
 		tx->skb = NULL;
@@ -1353,22 +1458,24 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 	CALL_TXH(ieee80211_tx_h_encrypt);
 	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
 		CALL_TXH(ieee80211_tx_h_calculate_duration);
-#undef CALL_TXH
 
  txh_done:
-	if (unlikely(res == TX_DROP)) {
-		I802_DEBUG_INC(tx->local->tx_handlers_drop);
-		if (tx->skb)
-			ieee80211_free_txskb(&tx->local->hw, tx->skb);
-		else
-			ieee80211_purge_tx_queue(&tx->local->hw, &tx->skbs);
-		return -1;
-	} else if (unlikely(res == TX_QUEUED)) {
-		I802_DEBUG_INC(tx->local->tx_handlers_queued);
-		return -1;
-	}
+	return ieee80211_tx_handlers_done(tx, res);
+}
 
-	return 0;
+#undef CALL_TXH
+
+/*
+ * Invoke TX handlers, return 0 on success and non-zero if the
+ * frame was dropped or queued.
+ */
+static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
+{
+	int r = invoke_tx_handlers_early(tx);
+
+	if (r)
+		return r;
+	return invoke_tx_handlers_late(tx);
 }
 
 /*
@@ -1409,7 +1516,13 @@ static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 		info->hw_queue =
 			sdata->vif.hw_queue[skb_get_queue_mapping(skb)];
 
-	if (!invoke_tx_handlers(&tx))
+	if (invoke_tx_handlers_early(&tx))
+		return true;
+
+	if (ieee80211_queue_skb(local, sdata, tx.sta, tx.skb))
+		return true;
+
+	if (!invoke_tx_handlers_late(&tx))
 		result = __ieee80211_tx(local, &tx.skbs, led_len,
 					tx.sta, txpending);
 
@@ -1431,13 +1544,22 @@ static int ieee80211_skb_resize(struct ieee80211_sub_if_data *sdata,
 		tail_need = max_t(int, tail_need, 0);
 	}
 
-	if (skb_cloned(skb))
+	/*
+	 * A clone can be used as is if only its (private) header is going
+	 * to be modified, see IEEE80211_HW_SUPPORTS_CLONED_SKBS.
+	 */
+	if (skb_cloned(skb) &&
+	    (!(local->hw.flags & IEEE80211_HW_SUPPORTS_CLONED_SKBS) ||
+	     !skb_clone_writable(skb, ETH_HLEN) ||
+	     (may_encrypt && sdata->crypto_tx_tailroom_needed_cnt)))
 		I802_DEBUG_INC(local->tx_expand_skb_head_cloned);
 	else if (head_need || tail_need)
 		I802_DEBUG_INC(local->tx_expand_skb_head);
 	else
 		return 0;
 
+	I802_DEBUG_INC(local->tx_realloc_count);
+
 	if (pskb_expand_head(skb, head_need, tail_need, GFP_ATOMIC)) {
 		wiphy_debug(local->hw.wiphy,
 			    "failed to reallocate TX buffer\n");
@@ -1717,6 +1839,513 @@ fail:
 	return NETDEV_TX_OK; /* meaning, we dealt with the skb */
 }
 
+/*
+ * TX fast path
+ *
+ * For data frames to authorized stations most of the work done by
+ * ieee80211_subif_start_xmit() and the TX handlers gives the same result
+ * every time. ieee80211_check_fast_xmit() precomputes it, and has to be
+ * called whenever anything it depends on changes: station state, power
+ * save state, keys and the interface the station belongs to. Anything
+ * unusual about a single frame still sends it through the slow path.
+ */
+void ieee80211_check_fast_xmit(struct sta_info *sta)
+{
+	struct ieee80211_fast_tx build = {}, *fast_tx = NULL, *old;
+	struct ieee80211_local *local = sta->local;
+	struct ieee80211_sub_if_data *sdata = sta->sdata;
+	struct ieee80211_hdr *hdr = (void *)build.hdr;
+	struct ieee80211_key *key;
+	__le16 fc;
+
+	spin_lock_bh(&sta->lock);
+	rcu_read_lock();
+
+	/* dynamic power save needs ieee80211_tx_h_dynamic_ps() */
+	if ((local->hw.flags & IEEE80211_HW_SUPPORTS_PS) &&
+	    !(local->hw.flags & IEEE80211_HW_SUPPORTS_DYNAMIC_PS) &&
+	    sdata->vif.type == NL80211_IFTYPE_STATION)
+		goto out;
+
+	if (!sta->uploaded || !test_sta_flag(sta, WLAN_STA_AUTHORIZED))
+		goto out;
+
+	if (test_sta_flag(sta, WLAN_STA_PS_STA) ||
+	    test_sta_flag(sta, WLAN_STA_PS_DRIVER))
+		goto out;
+
+	fc = cpu_to_le16(IEEE80211_FTYPE_DATA | IEEE80211_STYPE_DATA);
+
+	switch (sdata->vif.type) {
+	case NL80211_IFTYPE_AP_VLAN:
+		if (rcu_access_pointer(sdata->u.vlan.sta) == sta) {
+			fc |= cpu_to_le16(IEEE80211_FCTL_FROMDS |
+					  IEEE80211_FCTL_TODS);
+			/* RA TA DA SA */
+			memcpy(hdr->addr1, sta->sta.addr, ETH_ALEN);
+			memcpy(hdr->addr2, sdata->vif.addr, ETH_ALEN);
+			build.da_offs = offsetof(struct ieee80211_hdr, addr3);
+			build.sa_offs = offsetof(struct ieee80211_hdr, addr4);
+			build.hdr_len = 30;
+			break;
+		}
+		/* fall through */
+	case NL80211_IFTYPE_AP:
+		fc |= cpu_to_le16(IEEE80211_FCTL_FROMDS);
+		/* DA BSSID SA */
+		memcpy(hdr->addr2, sdata->vif.addr, ETH_ALEN);
+		build.da_offs = offsetof(struct ieee80211_hdr, addr1);
+		build.sa_offs = offsetof(struct ieee80211_hdr, addr3);
+		build.hdr_len = 24;
+		break;
+	case NL80211_IFTYPE_STATION:
+		if (test_sta_flag(sta, WLAN_STA_TDLS_PEER))
+			goto out;
+
+		if (sdata->u.mgd.use_4addr) {
+			fc |= cpu_to_le16(IEEE80211_FCTL_FROMDS |
+					  IEEE80211_FCTL_TODS);
+			/* RA TA DA SA */
+			memcpy(hdr->addr1, sta->sta.addr, ETH_ALEN);
+			memcpy(hdr->addr2, sdata->vif.addr, ETH_ALEN);
+			build.da_offs = offsetof(struct ieee80211_hdr, addr3);
+			build.sa_offs = offsetof(struct ieee80211_hdr, addr4);
+			build.hdr_len = 30;
+		} else {
+			fc |= cpu_to_le16(IEEE80211_FCTL_TODS);
+			/* BSSID SA DA */
+			memcpy(hdr->addr1, sta->sta.addr, ETH_ALEN);
+			build.da_offs = offsetof(struct ieee80211_hdr, addr3);
+			build.sa_offs = offsetof(struct ieee80211_hdr, addr2);
+			build.hdr_len = 24;
+		}
+		break;
+	default:
+		goto out;
+	}
+
+	/* receiver and we are QoS enabled, use a QoS type frame */
+	if (test_sta_flag(sta, WLAN_STA_WME) &&
+	    local->hw.queues >= IEEE80211_NUM_ACS) {
+		fc |= cpu_to_le16(IEEE80211_STYPE_QOS_DATA);
+		build.hdr_len += 2;
+	}
+
+	/*
+	 * Only keys the hardware encrypts with can be used. Room for a CCMP
+	 * header or TKIP IV the hardware wants is part of the template, its
+	 * contents are filled in by ieee80211_xmit_fast_finish(); a software
+	 * Michael MIC or WEP IV needs the slow path.
+	 */
+	key = rcu_dereference(sta->ptk);
+	if (!key)
+		key = rcu_dereference(sdata->default_unicast_key);
+	if (key) {
+		bool iv = key->conf.flags & (IEEE80211_KEY_FLAG_GENERATE_IV |
+					     IEEE80211_KEY_FLAG_PUT_IV_SPACE);
+
+		if (!(key->flags & KEY_FLAG_UPLOADED_TO_HARDWARE) ||
+		    key->flags & KEY_FLAG_TAINTED)
+			goto out;
+
+		switch (key->conf.cipher) {
+		case WLAN_CIPHER_SUITE_WEP40:
+		case WLAN_CIPHER_SUITE_WEP104:
+			if (iv)
+				goto out;
+			break;
+		case WLAN_CIPHER_SUITE_CCMP:
+			if (iv)
+				build.hdr_len += CCMP_HDR_LEN;
+			break;
+		case WLAN_CIPHER_SUITE_TKIP:
+			if (key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_MMIC)
+				goto out;
+			if (iv)
+				build.hdr_len += TKIP_IV_LEN;
+			break;
+		default:
+			goto out;
+		}
+
+		fc |= cpu_to_le16(IEEE80211_FCTL_PROTECTED);
+		build.key = key;
+	} else if (sdata->drop_unencrypted) {
+		goto out;
+	}
+
+	hdr->frame_control = fc;
+
+	memcpy(build.hdr + build.hdr_len, rfc1042_header,
+	       sizeof(rfc1042_header));
+
+	fast_tx = kmemdup(&build, sizeof(build), GFP_ATOMIC);
+	/* if the allocation failed, just use the slow path */
+
+ out:
+	old = rcu_dereference_protected(sta->fast_tx,
+					lockdep_is_held(&sta->lock));
+	rcu_assign_pointer(sta->fast_tx, fast_tx);
+	if (old)
+		kfree_rcu(old, rcu_head);
+
+	rcu_read_unlock();
+	spin_unlock_bh(&sta->lock);
+}
+
+void ieee80211_check_fast_xmit_iface(struct ieee80211_sub_if_data *sdata)
+{
+	struct ieee80211_local *local = sdata->local;
+	struct sta_info *sta;
+
+	rcu_read_lock();
+
+	list_for_each_entry_rcu(sta, &local->sta_list, list) {
+		/* AP_VLAN stations use the AP's keys */
+		if (sta->sdata != sdata &&
+		    (!sdata->bss || sta->sdata->bss != sdata->bss))
+			continue;
+		ieee80211_check_fast_xmit(sta);
+	}
+
+	rcu_read_unlock();
+}
+
+void ieee80211_clear_fast_xmit(struct sta_info *sta)
+{
+	struct ieee80211_fast_tx *old;
+
+	spin_lock_bh(&sta->lock);
+	old = rcu_dereference_protected(sta->fast_tx,
+					lockdep_is_held(&sta->lock));
+	RCU_INIT_POINTER(sta->fast_tx, NULL);
+	spin_unlock_bh(&sta->lock);
+
+	if (old)
+		kfree_rcu(old, rcu_head);
+}
+
+static struct sta_info *
+ieee80211_fast_xmit_sta(struct ieee80211_sub_if_data *sdata,
+			struct sk_buff *skb)
+{
+	struct sta_info *sta;
+
+	switch (sdata->vif.type) {
+	case NL80211_IFTYPE_AP_VLAN:
+		sta = rcu_dereference(sdata->u.vlan.sta);
+		if (sta)
+			return sta;
+		/* fall through */
+	case NL80211_IFTYPE_AP:
+		if (is_multicast_ether_addr(skb->data))
+			return NULL;
+		return sta_info_get(sdata, skb->data);
+	case NL80211_IFTYPE_STATION:
+		if (sdata->wdev.wiphy->flags & WIPHY_FLAG_SUPPORTS_TDLS) {
+			sta = sta_info_get(sdata, skb->data);
+			if (sta && test_sta_flag(sta, WLAN_STA_TDLS_PEER))
+				return NULL;
+		}
+		return sta_info_get(sdata, sdata->u.mgd.bssid);
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Assigns the sequence number and accounts the frame to the station, the
+ * parts of the fast path that have to happen in transmit order. Frames
+ * on an intermediate queue get this only when they are dequeued.
+ */
+static void ieee80211_xmit_fast_finish(struct ieee80211_sub_if_data *sdata,
+				       struct sta_info *sta,
+				       struct ieee80211_key *key,
+				       struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	u8 tid;
+
+	/* see ccmp_encrypt_skb() and tkip_encrypt_skb() */
+	if (key && key->conf.flags & IEEE80211_KEY_FLAG_GENERATE_IV)
+		ieee80211_crypto_add_iv(key, skb->data +
+				ieee80211_hdrlen(hdr->frame_control));
+
+	/* see ieee80211_tx_h_sequence() */
+	if (ieee80211_is_data_qos(hdr->frame_control)) {
+		tid = *ieee80211_get_qos_ctl(hdr) & IEEE80211_QOS_CTL_TID_MASK;
+		hdr->seq_ctrl = cpu_to_le16(sta->tid_seq[tid]);
+		sta->tid_seq[tid] = (sta->tid_seq[tid] + 0x10) &
+				    IEEE80211_SCTL_SEQ;
+	} else {
+		info->flags |= IEEE80211_TX_CTL_ASSIGN_SEQ;
+		hdr->seq_ctrl = cpu_to_le16(sdata->sequence_number);
+		sdata->sequence_number += 0x10;
+	}
+
+	/* see ieee80211_tx_h_stats() */
+	sta->tx_packets++;
+	sta->tx_fragments++;
+	sta->tx_bytes += skb->len;
+}
+
+/*
+ * Returns true if the frame was handled (transmitted, queued or freed),
+ * false if it has to go through the slow path; it isn't modified then.
+ * Must be called under RCU read lock.
+ */
+static bool ieee80211_xmit_fast(struct ieee80211_sub_if_data *sdata,
+				struct net_device *dev, struct sk_buff *skb)
+{
+	struct ieee80211_local *local = sdata->local;
+	u16 ethertype = (skb->data[12] << 8) | skb->data[13];
+	struct ieee80211_chanctx_conf *chanctx_conf;
+	struct ieee80211_sub_if_data *ap_sdata;
+	struct tid_ampdu_tx *tid_tx = NULL;
+	struct ieee80211_fast_tx *fast_tx;
+	struct ieee80211_tx_info *info;
+	struct ieee80211_tx_data tx;
+	struct ieee80211_hdr *hdr;
+	ieee80211_tx_result r;
+	struct sta_info *sta;
+	u8 eth[2 * ETH_ALEN];
+	int extra_head, head_need;
+	u8 tid;
+
+	sta = ieee80211_fast_xmit_sta(sdata, skb);
+	if (!sta)
+		return false;
+
+	fast_tx = rcu_dereference(sta->fast_tx);
+	if (!fast_tx)
+		return false;
+
+	/* the control port protocol needs the unauthorized port handling */
+	if (cpu_to_be16(ethertype) == sdata->control_port_protocol)
+		return false;
+
+	/* only RFC 1042 encapsulation is in the template */
+	if (ethertype < 0x600 ||
+	    ethertype == ETH_P_AARP || ethertype == ETH_P_IPX)
+		return false;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,3,0))
+	if (skb->sk && skb_shinfo(skb)->tx_flags & SKBTX_WIFI_STATUS)
+		return false;
+#endif
+
+	if (skb_shared(skb))
+		return false;
+
+	extra_head = fast_tx->hdr_len + sizeof(rfc1042_header) -
+		     (ETH_HLEN - 2);
+
+	/* frames that need to be fragmented take the slow path */
+	if (skb->len + extra_head + FCS_LEN > local->hw.wiphy->frag_threshold)
+		return false;
+
+	/*
+	 * The descriptor is cleared when these change, but the frame may
+	 * race with that; the slow path buffers or drops it correctly.
+	 */
+	if (unlikely(test_sta_flag(sta, WLAN_STA_PS_STA) ||
+		     test_sta_flag(sta, WLAN_STA_PS_DRIVER)))
+		return false;
+
+	if (unlikely(fast_tx->key && fast_tx->key->flags & KEY_FLAG_TAINTED))
+		return false;
+
+	if (unlikely(test_bit(SCAN_SW_SCANNING, &local->scanning) &&
+		     test_bit(SDATA_STATE_OFFCHANNEL, &sdata->state)))
+		return false;
+
+	if (ieee80211_is_data_qos(((struct ieee80211_hdr *)fast_tx->hdr)->
+				  frame_control)) {
+		tid = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
+
+		if ((local->hw.flags & IEEE80211_HW_AMPDU_AGGREGATION) &&
+		    !(local->hw.flags & IEEE80211_HW_TX_AMPDU_SETUP_IN_HW)) {
+			tid_tx = rcu_dereference(sta->ampdu_mlme.tid_tx[tid]);
+			/* session setup or teardown may need to queue it */
+			if (tid_tx &&
+			    !test_bit(HT_AGG_STATE_OPERATIONAL, &tid_tx->state))
+				return false;
+		}
+	}
+
+	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN) {
+		ap_sdata = container_of(sdata->bss,
+					struct ieee80211_sub_if_data, u.ap);
+		chanctx_conf = rcu_dereference(ap_sdata->vif.chanctx_conf);
+	} else {
+		chanctx_conf = rcu_dereference(sdata->vif.chanctx_conf);
+	}
+	if (!chanctx_conf)
+		return false;
+
+	/* the frame is modified from here on, it can't go back */
+	memcpy(eth, skb->data, sizeof(eth));
+
+	head_need = extra_head + local->tx_headroom - skb_headroom(skb);
+	if (ieee80211_skb_resize(sdata, skb, max_t(int, head_need, 0),
+				 false)) {
+		kfree_skb(skb);
+		return true;
+	}
+
+	skb_pull(skb, ETH_HLEN - 2);
+	hdr = (void *)skb_push(skb, fast_tx->hdr_len +
+				    sizeof(rfc1042_header));
+	memcpy(hdr, fast_tx->hdr, fast_tx->hdr_len + sizeof(rfc1042_header));
+	memcpy((u8 *)hdr + fast_tx->da_offs, eth, ETH_ALEN);
+	memcpy((u8 *)hdr + fast_tx->sa_offs, eth + ETH_ALEN, ETH_ALEN);
+	skb_reset_mac_header(skb);
+
+	dev->stats.tx_packets++;
+	dev->stats.tx_bytes += skb->len;
+	dev->trans_start = jiffies;
+
+	info = IEEE80211_SKB_CB(skb);
+	memset(info, 0, sizeof(*info));
+	info->band = chanctx_conf->def.chan->band;
+	info->control.vif = &sdata->vif;
+	info->hw_queue = sdata->vif.hw_queue[skb_get_queue_mapping(skb)];
+	info->flags = IEEE80211_TX_CTL_FIRST_FRAGMENT |
+		      IEEE80211_TX_CTL_DONTFRAG;
+	if (test_and_clear_sta_flag(sta, WLAN_STA_CLEAR_PS_FILT))
+		info->flags |= IEEE80211_TX_CTL_CLEAR_PS_FILT;
+
+	if (tid_tx) {
+		info->flags |= IEEE80211_TX_CTL_AMPDU;
+		if (tid_tx->timeout)
+			tid_tx->last_tx = jiffies;
+	}
+
+	ieee80211_set_qos_hdr(sdata, skb);
+
+	if (fast_tx->key) {
+		fast_tx->key->tx_rx_count++;
+		info->control.hw_key = &fast_tx->key->conf;
+	}
+
+	memset(&tx, 0, sizeof(tx));
+	__skb_queue_head_init(&tx.skbs);
+	tx.flags = IEEE80211_TX_UNICAST;
+	tx.local = local;
+	tx.sdata = sdata;
+	tx.sta = sta;
+	tx.key = fast_tx->key;
+
+	if (!(local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL)) {
+		tx.skb = skb;
+		r = ieee80211_tx_h_rate_ctrl(&tx);
+		tx.skb = NULL;
+		if (r != TX_CONTINUE) {
+			I802_DEBUG_INC(local->tx_handlers_drop);
+			ieee80211_free_txskb(&local->hw, skb);
+			return true;
+		}
+	}
+
+	I802_DEBUG_INC(local->tx_fast_xmit);
+	info->flags |= IEEE80211_TX_INTFL_FAST_XMIT;
+	if (ieee80211_queue_skb(local, sdata, sta, skb))
+		return true;
+
+	ieee80211_xmit_fast_finish(sdata, sta, fast_tx->key, skb);
+	__skb_queue_tail(&tx.skbs, skb);
+
+	if (!(local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
+		ieee80211_tx_h_calculate_duration(&tx);
+
+	__ieee80211_tx(local, &tx.skbs, skb->len, sta, false);
+
+	return true;
+}
+
+/*
+ * Runs the rest of the TX processing on a frame taken off an intermediate
+ * queue: frames dropped while queued must not leave holes in sequence
+ * numbers or PNs, and the frame must not be sent with a sequence number
+ * from before an aggregation session started. Returns the frame to hand
+ * to the driver, or %NULL if it was dropped.
+ */
+struct sk_buff *ieee80211_tx_finish_queued(struct ieee80211_local *local,
+					   struct ieee80211_txq *txq,
+					   struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ieee80211_key_conf *hw_key = info->control.hw_key;
+	struct tid_ampdu_tx *tid_tx;
+	struct ieee80211_tx_data tx;
+
+	memset(&tx, 0, sizeof(tx));
+	__skb_queue_head_init(&tx.skbs);
+	tx.local = local;
+	tx.skb = skb;
+	if (!is_multicast_ether_addr(hdr->addr1))
+		tx.flags |= IEEE80211_TX_UNICAST;
+
+	rcu_read_lock();
+
+	if (txq->sta) {
+		tx.sta = container_of(txq->sta, struct sta_info, sta);
+		tx.sdata = tx.sta->sdata;
+	} else {
+		tx.sdata = vif_to_sdata(info->control.vif);
+	}
+
+	/* the aggregation session may have changed while it was queued */
+	if (tx.sta && ieee80211_is_data_qos(hdr->frame_control) &&
+	    (local->hw.flags & IEEE80211_HW_AMPDU_AGGREGATION) &&
+	    !(local->hw.flags & IEEE80211_HW_TX_AMPDU_SETUP_IN_HW)) {
+		tid_tx = rcu_dereference(tx.sta->ampdu_mlme.tid_tx[txq->tid]);
+		if (tid_tx &&
+		    test_bit(HT_AGG_STATE_OPERATIONAL, &tid_tx->state)) {
+			info->flags |= IEEE80211_TX_CTL_AMPDU;
+			if (tid_tx->timeout)
+				tid_tx->last_tx = jiffies;
+		} else {
+			info->flags &= ~IEEE80211_TX_CTL_AMPDU;
+		}
+	}
+
+	/* and the key may have been removed or replaced */
+	info->control.hw_key = NULL;
+	if (ieee80211_tx_h_select_key(&tx) != TX_CONTINUE)
+		goto drop;
+
+	if (info->flags & IEEE80211_TX_INTFL_FAST_XMIT) {
+		/* the fast path built the frame for the old key */
+		if (info->control.hw_key != hw_key)
+			goto drop;
+
+		ieee80211_xmit_fast_finish(tx.sdata, tx.sta, tx.key, skb);
+		__skb_queue_tail(&tx.skbs, skb);
+		if (!(local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
+			ieee80211_tx_h_calculate_duration(&tx);
+	} else if (invoke_tx_handlers_late(&tx)) {
+		skb = NULL;
+		goto out;
+	}
+
+	skb = __skb_dequeue(&tx.skbs);
+	/* queued frames are never fragmented */
+	if (WARN_ON_ONCE(!skb_queue_empty(&tx.skbs)))
+		ieee80211_purge_tx_queue(&local->hw, &tx.skbs);
+	goto out;
+
+ drop:
+	I802_DEBUG_INC(local->tx_handlers_drop);
+	ieee80211_free_txskb(&local->hw, skb);
+	skb = NULL;
+ out:
+	rcu_read_unlock();
+	return skb;
+}
+
 /**
  * ieee80211_subif_start_xmit - netif start_xmit function for Ethernet-type
  * subinterfaces (wlan#, WDS, and VLAN interfaces)
@@ -1760,13 +2389,20 @@ netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
 	if (unlikely(skb->len < ETH_HLEN))
 		goto fail;
 
+	I802_DEBUG_INC(local->tx_data_count);
+
+	rcu_read_lock();
+
+	if (ieee80211_xmit_fast(sdata, dev, skb)) {
+		rcu_read_unlock();
+		return NETDEV_TX_OK;
+	}
+
 	/* convert Ethernet header to proper 802.11 header (based on
 	 * operation mode) */
 	ethertype = (skb->data[12] << 8) | skb->data[13];
 	fc = cpu_to_le16(IEEE80211_FTYPE_DATA | IEEE80211_STYPE_DATA);
 
-	rcu_read_lock();
-
 	switch (sdata->vif.type) {
 	case NL80211_IFTYPE_AP_VLAN:
 		sta = rcu_dereference(sdata->u.vlan.sta);
@@ -2220,49 +2856,46 @@ static bool ieee80211_tx_pending_skb(struct ieee80211_local *local,
 }
 
 /*
- * Transmit all pending packets. Called from tasklet.
+ * Transmit all pending packets of one hardware queue. Called from the
+ * queue's tasklet, so different queues are serviced independently.
  */
 void ieee80211_tx_pending(unsigned long data)
 {
-	struct ieee80211_local *local = (struct ieee80211_local *)data;
+	struct ieee80211_queue_state *qs = (struct ieee80211_queue_state *)data;
+	struct ieee80211_local *local = qs->local;
+	int q = qs->queue;
+	struct sk_buff *skb;
 	unsigned long flags;
-	int i;
 	bool txok;
 
 	rcu_read_lock();
 
 	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
-	for (i = 0; i < local->hw.queues; i++) {
-		/*
-		 * If queue is stopped by something other than due to pending
-		 * frames, or we have no pending frames, proceed to next queue.
-		 */
-		if (local->queue_stop_reasons[i] ||
-		    skb_queue_empty(&local->pending[i]))
-			continue;
-
-		while (!skb_queue_empty(&local->pending[i])) {
-			struct sk_buff *skb = __skb_dequeue(&local->pending[i]);
-			struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-
-			if (WARN_ON(!info->control.vif)) {
-				ieee80211_free_txskb(&local->hw, skb);
-				continue;
-			}
-
-			spin_unlock_irqrestore(&local->queue_stop_reason_lock,
-						flags);
+	/*
+	 * Stop as soon as the queue is stopped by something other than
+	 * due to pending frames, e.g. because the byte limit was reached
+	 * by the frames sent so far.
+	 */
+	while (!local->queue_stop_reasons[q] &&
+	       (skb = __skb_dequeue(&local->pending[q]))) {
+		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 
-			txok = ieee80211_tx_pending_skb(local, skb);
-			spin_lock_irqsave(&local->queue_stop_reason_lock,
-					  flags);
-			if (!txok)
-				break;
+		if (WARN_ON(!info->control.vif)) {
+			ieee80211_free_txskb(&local->hw, skb);
+			continue;
 		}
 
-		if (skb_queue_empty(&local->pending[i]))
-			ieee80211_propagate_queue_wake(local, i);
+		spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+
+		txok = ieee80211_tx_pending_skb(local, skb);
+		spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+		if (!txok)
+			break;
 	}
+
+	if (!local->queue_stop_reasons[q] &&
+	    skb_queue_empty(&local->pending[q]))
+		ieee80211_propagate_queue_wake(local, q);
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
 	rcu_read_unlock();
@@ -2275,15 +2908,12 @@ static void __ieee80211_beacon_add_tim(struct ieee80211_sub_if_data *sdata,
 {
 	u8 *pos, *tim;
 	int aid0 = 0;
-	int i, have_bits = 0, n1, n2;
+	int have_bits = 0, n1, n2;
 
 	/* Generate bitmap for TIM only if there are any STAs in power save
 	 * mode. */
 	if (atomic_read(&ps->num_sta_ps) > 0)
-		/* in the hope that this is faster than
-		 * checking byte-for-byte */
-		have_bits = !bitmap_empty((unsigned long*)ps->tim,
-					  IEEE80211_MAX_AID+1);
+		have_bits = ps->tim_bits;
 
 	if (ps->dtim_count == 0)
 		ps->dtim_count = sdata->vif.bss_conf.dtim_period - 1;
@@ -2304,21 +2934,10 @@ static void __ieee80211_beacon_add_tim(struct ieee80211_sub_if_data *sdata,
 	if (have_bits) {
 		/* Find largest even number N1 so that bits numbered 1 through
 		 * (N1 x 8) - 1 in the bitmap are 0 and number N2 so that bits
-		 * (N2 + 1) x 8 through 2007 are 0. */
-		n1 = 0;
-		for (i = 0; i < IEEE80211_MAX_TIM_LEN; i++) {
-			if (ps->tim[i]) {
-				n1 = i & 0xfe;
-				break;
-			}
-		}
-		n2 = n1;
-		for (i = IEEE80211_MAX_TIM_LEN - 1; i >= n1; i--) {
-			if (ps->tim[i]) {
-				n2 = i;
-				break;
-			}
-		}
+		 * (N2 + 1) x 8 through 2007 are 0. The first and last bytes
+		 * with bits set are tracked as the bits change. */
+		n1 = ps->tim_first & 0xfe;
+		n2 = ps->tim_last;
 
 		/* Bitmap control */
 		*pos++ = n1 | aid0;
@@ -2750,7 +3369,7 @@ ieee80211_get_buffered_bc(struct ieee80211_hw *hw,
 		skb = skb_dequeue(&ps->bc_buf);
 		if (!skb)
 			goto out;
-		local->total_ps_buffered--;
+		atomic_dec(&local->total_ps_buffered);
 
 		if (!skb_queue_empty(&ps->bc_buf) && skb->len >= 2) {
 			struct ieee80211_hdr *hdr =
@@ -0,0 +1,320 @@
+/*
+ * mac80211 intermediate TX queues
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Drivers implementing the wake_tx_queue() callback get their data frames
+ * from per station/TID queues (and one queue per interface for frames not
+ * sent to a station) instead of through the tx() callback. Queueing delay
+ * on each of these queues is kept in check by CoDel, applied when the
+ * driver dequeues frames, and the queues of an AC share the device with
+ * deficit round robin over the bytes they send.
+ *
+ * Frames are queued after the TX handlers that decide whether and how
+ * they are sent; sequence number, fragmentation and encryption are left
+ * for when they are dequeued, see ieee80211_tx_finish_queued().
+ *
+ * The CoDel implementation follows include/net/codel.h, which is tied to
+ * the qdisc layer and can't be used on frames carrying TX info in skb->cb.
+ */
+
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/ktime.h>
+#include <linux/reciprocal_div.h>
+#include <net/mac80211.h>
+#include "ieee80211_i.h"
+#include "sta_info.h"
+#include "wme.h"
+
+/* CoDel time is in units of 1024 ns, kept in a u32 */
+#define IEEE80211_CODEL_SHIFT		10
+#define IEEE80211_CODEL_MS(ms)		(((ms) * NSEC_PER_MSEC) >> \
+					 IEEE80211_CODEL_SHIFT)
+
+/*
+ * The target is higher than for wired links since a single aggregate can
+ * take several milliseconds of airtime.
+ */
+#define IEEE80211_CODEL_TARGET		IEEE80211_CODEL_MS(20)
+#define IEEE80211_CODEL_INTERVAL	IEEE80211_CODEL_MS(100)
+
+#define REC_INV_SQRT_BITS		(8 * sizeof(u16))
+#define REC_INV_SQRT_SHIFT		(32 - REC_INV_SQRT_BITS)
+
+#define codel_after(a, b)		((s32)(a) - (s32)(b) > 0)
+#define codel_after_eq(a, b)		((s32)(a) - (s32)(b) >= 0)
+#define codel_before(a, b)		((s32)(a) - (s32)(b) < 0)
+
+static u32 ieee80211_codel_time(void)
+{
+	return ktime_to_ns(ktime_get()) >> IEEE80211_CODEL_SHIFT;
+}
+
+/* new_invsqrt = (invsqrt / 2) * (3 - count * invsqrt^2), in Q0.32 */
+static void ieee80211_codel_newton_step(struct ieee80211_codel_vars *vars)
+{
+	u32 invsqrt = ((u32)vars->rec_inv_sqrt) << REC_INV_SQRT_SHIFT;
+	u32 invsqrt2 = ((u64)invsqrt * invsqrt) >> 32;
+	u64 val = (3LL << 32) - ((u64)vars->count * invsqrt2);
+
+	val >>= 2;
+	val = (val * invsqrt) >> (32 - 2 + 1);
+
+	vars->rec_inv_sqrt = val >> REC_INV_SQRT_SHIFT;
+}
+
+/* t + interval / sqrt(count) */
+static u32 ieee80211_codel_control_law(u32 t, u16 rec_inv_sqrt)
+{
+	return t + reciprocal_divide(IEEE80211_CODEL_INTERVAL,
+				     rec_inv_sqrt << REC_INV_SQRT_SHIFT);
+}
+
+static struct sk_buff *ieee80211_txq_pop(struct txq_info *txqi)
+{
+	struct sk_buff *skb = __skb_dequeue(&txqi->queue);
+
+	if (skb)
+		txqi->backlog -= skb->len;
+
+	return skb;
+}
+
+static bool ieee80211_codel_should_drop(struct txq_info *txqi,
+					struct sk_buff *skb, u32 now)
+{
+	struct ieee80211_codel_vars *vars = &txqi->cvars;
+	u32 sojourn;
+
+	if (!skb) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	sojourn = now - IEEE80211_SKB_CB(skb)->control.enqueue_time;
+
+	if (codel_before(sojourn, IEEE80211_CODEL_TARGET) ||
+	    txqi->backlog <= IEEE80211_TXQ_QUANTUM) {
+		/* went below - stay below for at least interval */
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	if (vars->first_above_time == 0) {
+		vars->first_above_time = now + IEEE80211_CODEL_INTERVAL;
+		return false;
+	}
+
+	return codel_after(now, vars->first_above_time);
+}
+
+void ieee80211_init_tx_queue(struct ieee80211_sub_if_data *sdata,
+			     struct sta_info *sta,
+			     struct txq_info *txqi, int tid)
+{
+	INIT_LIST_HEAD(&txqi->schedule_order);
+	__skb_queue_head_init(&txqi->queue);
+
+	txqi->txq.vif = &sdata->vif;
+
+	if (sta) {
+		txqi->txq.sta = &sta->sta;
+		txqi->txq.tid = tid;
+		txqi->txq.ac = ieee802_1d_to_ac[tid & 7];
+		sta->sta.txq[tid] = &txqi->txq;
+	} else {
+		txqi->txq.ac = IEEE80211_AC_BE;
+		sdata->vif.txq = &txqi->txq;
+	}
+}
+
+void ieee80211_txq_enqueue(struct ieee80211_local *local,
+			   struct txq_info *txqi, struct sk_buff *skb)
+{
+	spinlock_t *lock = &local->active_txq_lock[txqi->txq.ac];
+	struct sk_buff *old = NULL;
+	unsigned long flags;
+
+	IEEE80211_SKB_CB(skb)->control.enqueue_time = ieee80211_codel_time();
+
+	spin_lock_irqsave(lock, flags);
+
+	/* drop from the head, the oldest frame is the least useful one */
+	if (skb_queue_len(&txqi->queue) >= IEEE80211_TXQ_MAX_LEN)
+		old = ieee80211_txq_pop(txqi);
+
+	__skb_queue_tail(&txqi->queue, skb);
+	txqi->backlog += skb->len;
+
+	if (list_empty(&txqi->schedule_order)) {
+		txqi->deficit = IEEE80211_TXQ_QUANTUM;
+		list_add_tail(&txqi->schedule_order,
+			      &local->active_txqs[txqi->txq.ac]);
+	}
+
+	spin_unlock_irqrestore(lock, flags);
+
+	if (old) {
+		I802_DEBUG_INC(local->tx_txq_overlimit_drop);
+		ieee80211_free_txskb(&local->hw, old);
+	}
+}
+
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi)
+{
+	spinlock_t *lock = &local->active_txq_lock[txqi->txq.ac];
+	struct sk_buff_head frames;
+	unsigned long flags;
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_irqsave(lock, flags);
+	skb_queue_splice_init(&txqi->queue, &frames);
+	txqi->backlog = 0;
+	list_del_init(&txqi->schedule_order);
+	spin_unlock_irqrestore(lock, flags);
+
+	ieee80211_purge_tx_queue(&local->hw, &frames);
+}
+
+static struct sk_buff *
+ieee80211_txq_codel_dequeue(struct ieee80211_local *local,
+			    struct ieee80211_txq *txq)
+{
+	struct txq_info *txqi = to_txq_info(txq);
+	struct ieee80211_codel_vars *vars = &txqi->cvars;
+	spinlock_t *lock = &local->active_txq_lock[txq->ac];
+	struct sk_buff_head dropped;
+	struct sk_buff *skb, *old;
+	unsigned long flags;
+	bool drop;
+	u32 now;
+
+	__skb_queue_head_init(&dropped);
+
+	spin_lock_irqsave(lock, flags);
+
+	skb = ieee80211_txq_pop(txqi);
+	if (!skb) {
+		vars->dropping = false;
+		list_del_init(&txqi->schedule_order);
+		goto out;
+	}
+
+	now = ieee80211_codel_time();
+	drop = ieee80211_codel_should_drop(txqi, skb, now);
+
+	if (vars->dropping) {
+		if (!drop) {
+			/* sojourn time below target - leave dropping state */
+			vars->dropping = false;
+		} else {
+			/*
+			 * A large backlog might result in drop rates so high
+			 * that the next drop should happen now, hence the loop.
+			 */
+			while (vars->dropping &&
+			       codel_after_eq(now, vars->drop_next)) {
+				vars->count++;
+				ieee80211_codel_newton_step(vars);
+				__skb_queue_tail(&dropped, skb);
+				skb = ieee80211_txq_pop(txqi);
+				if (!ieee80211_codel_should_drop(txqi, skb, now))
+					vars->dropping = false;
+				else
+					vars->drop_next =
+						ieee80211_codel_control_law(
+							vars->drop_next,
+							vars->rec_inv_sqrt);
+			}
+		}
+	} else if (drop) {
+		__skb_queue_tail(&dropped, skb);
+		skb = ieee80211_txq_pop(txqi);
+		ieee80211_codel_should_drop(txqi, skb, now);
+
+		vars->dropping = true;
+		/*
+		 * If we were dropping recently, the drop rate that controlled
+		 * the queue then is a good starting point for now.
+		 */
+		if (codel_before(now - vars->drop_next,
+				 16 * IEEE80211_CODEL_INTERVAL)) {
+			vars->count = (vars->count - vars->lastcount) | 1;
+			ieee80211_codel_newton_step(vars);
+		} else {
+			vars->count = 1;
+			vars->rec_inv_sqrt = ~0U >> REC_INV_SQRT_SHIFT;
+		}
+		vars->lastcount = vars->count;
+		vars->drop_next = ieee80211_codel_control_law(now,
+							vars->rec_inv_sqrt);
+	}
+
+	if (skb)
+		txqi->deficit -= skb->len;
+
+	if (skb_queue_empty(&txqi->queue))
+		list_del_init(&txqi->schedule_order);
+
+ out:
+	spin_unlock_irqrestore(lock, flags);
+
+	while ((old = __skb_dequeue(&dropped))) {
+		I802_DEBUG_INC(local->tx_txq_codel_drop);
+		ieee80211_free_txskb(&local->hw, old);
+	}
+
+	return skb;
+}
+
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+				     struct ieee80211_txq *txq)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct sk_buff *skb;
+
+	/*
+	 * Frames only get their sequence number and PN here, after CoDel,
+	 * so that drops on the queue don't leave holes in them.
+	 */
+	do {
+		skb = ieee80211_txq_codel_dequeue(local, txq);
+		if (!skb)
+			return NULL;
+		skb = ieee80211_tx_finish_queued(local, txq, skb);
+	} while (!skb);
+
+	return skb;
+}
+EXPORT_SYMBOL(ieee80211_tx_dequeue);
+
+struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct list_head *active = &local->active_txqs[ac];
+	struct ieee80211_txq *txq = NULL;
+	struct txq_info *txqi;
+	unsigned long flags;
+
+	spin_lock_irqsave(&local->active_txq_lock[ac], flags);
+	while (!list_empty(active)) {
+		txqi = list_first_entry(active, struct txq_info,
+					schedule_order);
+		if (txqi->deficit > 0) {
+			txq = &txqi->txq;
+			break;
+		}
+
+		txqi->deficit += IEEE80211_TXQ_QUANTUM;
+		list_move_tail(&txqi->schedule_order, active);
+	}
+	spin_unlock_irqrestore(&local->active_txq_lock[ac], flags);
+
+	return txq;
+}
+EXPORT_SYMBOL(ieee80211_next_txq);
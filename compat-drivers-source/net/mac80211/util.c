@@ -322,7 +322,7 @@ static void __ieee80211_wake_queue(struct ieee80211_hw *hw, int queue,
 		ieee80211_propagate_queue_wake(local, queue);
 		rcu_read_unlock();
 	} else
-		tasklet_schedule(&local->tx_pending_tasklet);
+		tasklet_schedule(&local->queue_state[queue].pending_tasklet);
 }
 
 void ieee80211_wake_queue_by_reason(struct ieee80211_hw *hw, int queue,
@@ -397,6 +397,119 @@ void ieee80211_stop_queue(struct ieee80211_hw *hw, int queue)
 }
 EXPORT_SYMBOL(ieee80211_stop_queue);
 
+/*
+ * Byte queue limits
+ *
+ * For drivers that report TX status for every frame, mac80211 keeps track
+ * of the bytes each hardware queue holds in the driver and stops the queue
+ * once they exceed a limit, so that frames wait in the qdisc (where they
+ * can be managed) rather than in the device ring.
+ *
+ * The limit is adapted on completions. It grows whenever the queue ran
+ * empty after it had been stopped by the limit and more frames were
+ * queued since, as the device was starved then rather than out of
+ * traffic. At the end of each IEEE80211_TX_LIMIT_INTERVAL it shrinks
+ * by the lowest amount of data that was queued at any completion during
+ * the interval, as that much was never needed to keep the device busy.
+ */
+void __ieee80211_tx_limit_queued(struct ieee80211_local *local,
+				 struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_queue_state *qs = &local->queue_state[info->hw_queue];
+
+	lockdep_assert_held(&local->queue_stop_reason_lock);
+
+	info->flags |= IEEE80211_TX_INTFL_LIMIT_QUEUED;
+	qs->inflight += skb->len;
+
+	if (qs->ovlimit)
+		qs->ovlimit_queued = true;
+
+	if (qs->inflight >= qs->limit) {
+		__ieee80211_stop_queue(&local->hw, qs->queue,
+				       IEEE80211_QUEUE_STOP_REASON_TX_LIMIT);
+		qs->ovlimit = true;
+	}
+}
+
+void ieee80211_tx_limit_completed(struct ieee80211_local *local,
+				  struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_queue_state *qs;
+	unsigned long flags;
+	int q = info->hw_queue;
+
+	if (!(info->flags & IEEE80211_TX_INTFL_LIMIT_QUEUED))
+		return;
+
+	info->flags &= ~IEEE80211_TX_INTFL_LIMIT_QUEUED;
+
+	if (WARN_ON_ONCE(q >= local->hw.queues))
+		return;
+
+	qs = &local->queue_state[q];
+
+	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+
+	qs->inflight -= min_t(unsigned int, skb->len, qs->inflight);
+
+	/*
+	 * The queue is usually woken long before it runs empty, so
+	 * whether it was held back by the limit is remembered until then.
+	 */
+	if (!qs->inflight) {
+		if (qs->ovlimit && qs->ovlimit_queued)
+			qs->limit = min_t(unsigned int,
+					  qs->limit + qs->limit / 2,
+					  IEEE80211_TX_LIMIT_MAX);
+		qs->ovlimit = false;
+		qs->ovlimit_queued = false;
+	}
+
+	qs->slack = min(qs->slack, qs->inflight);
+
+	if (time_after(jiffies, qs->slack_start + IEEE80211_TX_LIMIT_INTERVAL)) {
+		if (qs->limit - IEEE80211_TX_LIMIT_MIN > qs->slack)
+			qs->limit -= qs->slack;
+		else
+			qs->limit = IEEE80211_TX_LIMIT_MIN;
+		qs->slack = qs->inflight;
+		qs->slack_start = jiffies;
+	}
+
+	if (qs->inflight < qs->limit)
+		__ieee80211_wake_queue(&local->hw, q,
+				       IEEE80211_QUEUE_STOP_REASON_TX_LIMIT);
+
+	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+}
+
+/*
+ * Forget about frames that a stopped device will never report, they
+ * would otherwise keep the queues stopped forever.
+ */
+void ieee80211_tx_limit_reset(struct ieee80211_local *local)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+	for (i = 0; i < local->hw.queues; i++) {
+		struct ieee80211_queue_state *qs = &local->queue_state[i];
+
+		qs->inflight = 0;
+		qs->slack = UINT_MAX;
+		qs->slack_start = jiffies;
+		qs->ovlimit = false;
+		qs->ovlimit_queued = false;
+		__ieee80211_wake_queue(&local->hw, i,
+				       IEEE80211_QUEUE_STOP_REASON_TX_LIMIT);
+	}
+	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+}
+
 void ieee80211_add_pending_skb(struct ieee80211_local *local,
 			       struct sk_buff *skb)
 {
@@ -1349,6 +1462,8 @@ void ieee80211_stop_device(struct ieee80211_local *local)
 
 	flush_workqueue(local->workqueue);
 	drv_stop(local);
+
+	ieee80211_tx_limit_reset(local);
 }
 
 int ieee80211_reconfig(struct ieee80211_local *local)
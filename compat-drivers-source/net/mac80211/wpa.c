@@ -10,6 +10,7 @@
 #include <linux/netdevice.h>
 #include <linux/types.h>
 #include <linux/skbuff.h>
+#include <linux/scatterlist.h>
 #include <linux/compiler.h>
 #include <linux/ieee80211.h>
 #include <linux/gfp.h>
@@ -81,10 +82,9 @@ ieee80211_tx_h_michael_mic_add(struct ieee80211_tx_data *tx)
 ieee80211_rx_result
 ieee80211_rx_h_michael_mic_verify(struct ieee80211_rx_data *rx)
 {
-	u8 *data, *key = NULL;
-	size_t data_len;
-	unsigned int hdrlen;
-	u8 mic[MICHAEL_MIC_LEN];
+	u8 *key = NULL;
+	unsigned int hdrlen, data_len;
+	u8 mic[MICHAEL_MIC_LEN], rx_mic[MICHAEL_MIC_LEN];
 	struct sk_buff *skb = rx->skb;
 	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
@@ -139,19 +139,20 @@ ieee80211_rx_h_michael_mic_verify(struct ieee80211_rx_data *rx)
 	if (skb->len < hdrlen + MICHAEL_MIC_LEN)
 		return RX_DROP_UNUSABLE;
 
-	if (skb_linearize(rx->skb))
-		return RX_DROP_UNUSABLE;
-	hdr = (void *)skb->data;
-
-	data = skb->data + hdrlen;
+	/*
+	 * The MSDU may still be in fragments if it was reassembled,
+	 * compute the MIC over them rather than linearizing.
+	 */
 	data_len = skb->len - hdrlen - MICHAEL_MIC_LEN;
 	key = &rx->key->conf.key[NL80211_TKIP_DATA_OFFSET_RX_MIC_KEY];
-	michael_mic(key, hdr, data, data_len, mic);
-	if (memcmp(mic, data + data_len, MICHAEL_MIC_LEN) != 0)
+	michael_mic_skb(key, hdr, skb, hdrlen, data_len, mic);
+	if (skb_copy_bits(skb, hdrlen + data_len, rx_mic, MICHAEL_MIC_LEN) ||
+	    memcmp(mic, rx_mic, MICHAEL_MIC_LEN) != 0)
 		goto mic_fail;
 
 	/* remove Michael MIC from payload */
-	skb_trim(skb, skb->len - MICHAEL_MIC_LEN);
+	if (pskb_trim(skb, skb->len - MICHAEL_MIC_LEN))
+		return RX_DROP_UNUSABLE;
 
 update_iv:
 	/* update IV in key information to be able to detect replays */
@@ -176,12 +177,26 @@ mic_fail_no_key:
 }
 
 
+static u8 *tkip_next_iv(struct ieee80211_key *key, u8 *pos)
+{
+	unsigned long flags;
+
+	/* Increase IV for the frame */
+	spin_lock_irqsave(&key->u.tkip.txlock, flags);
+	key->u.tkip.tx.iv16++;
+	if (key->u.tkip.tx.iv16 == 0)
+		key->u.tkip.tx.iv32++;
+	pos = ieee80211_tkip_add_iv(pos, key);
+	spin_unlock_irqrestore(&key->u.tkip.txlock, flags);
+
+	return pos;
+}
+
 static int tkip_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 	struct ieee80211_key *key = tx->key;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
-	unsigned long flags;
 	unsigned int hdrlen;
 	int len, tail;
 	u8 *pos;
@@ -215,13 +230,7 @@ static int tkip_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	    (info->control.hw_key->flags & IEEE80211_KEY_FLAG_PUT_IV_SPACE))
 		return 0;
 
-	/* Increase IV for the frame */
-	spin_lock_irqsave(&key->u.tkip.txlock, flags);
-	key->u.tkip.tx.iv16++;
-	if (key->u.tkip.tx.iv16 == 0)
-		key->u.tkip.tx.iv32++;
-	pos = ieee80211_tkip_add_iv(pos, key);
-	spin_unlock_irqrestore(&key->u.tkip.txlock, flags);
+	pos = tkip_next_iv(key, pos);
 
 	/* hwaccel - with software IV */
 	if (info->control.hw_key)
@@ -301,22 +310,16 @@ ieee80211_crypto_tkip_decrypt(struct ieee80211_rx_data *rx)
 }
 
 
-static void ccmp_special_blocks(struct sk_buff *skb, u8 *pn, u8 *scratch,
+static void ccmp_special_blocks(struct sk_buff *skb, u8 *pn, u8 *b_0, u8 *aad,
 				int encrypted)
 {
 	__le16 mask_fc;
 	int a4_included, mgmt;
 	u8 qos_tid;
-	u8 *b_0, *aad;
 	u16 data_len, len_a;
 	unsigned int hdrlen;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
 
-	memset(scratch, 0, 6 * AES_BLOCK_SIZE);
-
-	b_0 = scratch + 3 * AES_BLOCK_SIZE;
-	aad = scratch + 4 * AES_BLOCK_SIZE;
-
 	/*
 	 * Mask FC: zero subtype b4 b5 b6 (if not mgmt)
 	 * Retry, PwrMgt, MoreData; set Protected
@@ -398,6 +401,19 @@ static inline void ccmp_hdr2pn(u8 *pn, u8 *hdr)
 }
 
 
+static void ccmp_next_pn(struct ieee80211_key *key, u8 *pn)
+{
+	u64 pn64 = atomic64_inc_return(&key->u.ccmp.tx_pn);
+
+	pn[5] = pn64;
+	pn[4] = pn64 >> 8;
+	pn[3] = pn64 >> 16;
+	pn[2] = pn64 >> 24;
+	pn[1] = pn64 >> 32;
+	pn[0] = pn64 >> 40;
+}
+
+
 static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
@@ -406,8 +422,7 @@ static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	int hdrlen, len, tail;
 	u8 *pos;
 	u8 pn[6];
-	u64 pn64;
-	u8 scratch[6 * AES_BLOCK_SIZE];
+	u8 b_0[AES_BLOCK_SIZE], aad[2 * AES_BLOCK_SIZE];
 
 	if (info->control.hw_key &&
 	    !(info->control.hw_key->flags & IEEE80211_KEY_FLAG_GENERATE_IV) &&
@@ -443,15 +458,7 @@ static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 	hdr = (struct ieee80211_hdr *) pos;
 	pos += hdrlen;
 
-	pn64 = atomic64_inc_return(&key->u.ccmp.tx_pn);
-
-	pn[5] = pn64;
-	pn[4] = pn64 >> 8;
-	pn[3] = pn64 >> 16;
-	pn[2] = pn64 >> 24;
-	pn[1] = pn64 >> 32;
-	pn[0] = pn64 >> 40;
-
+	ccmp_next_pn(key, pn);
 	ccmp_pn2hdr(pos, pn, key->conf.keyidx);
 
 	/* hwaccel - with software CCMP header */
@@ -459,9 +466,9 @@ static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 		return 0;
 
 	pos += CCMP_HDR_LEN;
-	ccmp_special_blocks(skb, pn, scratch, 0);
-	ieee80211_aes_ccm_encrypt(key->u.ccmp.tfm, scratch, pos, len,
-				  pos, skb_put(skb, CCMP_MIC_LEN));
+	ccmp_special_blocks(skb, pn, b_0, aad, 0);
+	ieee80211_aes_ccm_encrypt(&key->u.ccmp.tfm, b_0, aad, pos, len,
+				  skb_put(skb, CCMP_MIC_LEN));
 
 	return 0;
 }
@@ -483,6 +490,29 @@ ieee80211_crypto_ccmp_encrypt(struct ieee80211_tx_data *tx)
 }
 
 
+/*
+ * Writes the next CCMP header or TKIP IV of @key at @pos, for frames that
+ * the TX fast path built with room for it already.
+ */
+void ieee80211_crypto_add_iv(struct ieee80211_key *key, u8 *pos)
+{
+	u8 pn[6];
+
+	switch (key->conf.cipher) {
+	case WLAN_CIPHER_SUITE_CCMP:
+		ccmp_next_pn(key, pn);
+		ccmp_pn2hdr(pos, pn, key->conf.keyidx);
+		break;
+	case WLAN_CIPHER_SUITE_TKIP:
+		tkip_next_iv(key, pos);
+		break;
+	}
+}
+
+
+/* head plus page fragments of a frame decrypted without linearizing it */
+#define CCMP_RX_MAX_SG	4
+
 ieee80211_rx_result
 ieee80211_crypto_ccmp_decrypt(struct ieee80211_rx_data *rx)
 {
@@ -505,13 +535,21 @@ ieee80211_crypto_ccmp_decrypt(struct ieee80211_rx_data *rx)
 	if (!rx->sta || data_len < 0)
 		return RX_DROP_UNUSABLE;
 
-	if (status->flag & RX_FLAG_DECRYPTED) {
-		if (!pskb_may_pull(rx->skb, hdrlen + CCMP_HDR_LEN))
-			return RX_DROP_UNUSABLE;
-	} else {
-		if (skb_linearize(rx->skb))
-			return RX_DROP_UNUSABLE;
-	}
+	if (!pskb_may_pull(rx->skb, hdrlen + CCMP_HDR_LEN))
+		return RX_DROP_UNUSABLE;
+
+	/*
+	 * The AEAD transform decrypts paged frames in place, anything
+	 * else, or pages shared with other receivers, need to be made
+	 * linear (and private) first.
+	 */
+	if (!(status->flag & RX_FLAG_DECRYPTED) && skb_is_nonlinear(skb) &&
+	    (!key->u.ccmp.tfm.aead || skb_cloned(skb) ||
+	     (status->rx_flags & IEEE80211_RX_SHARED_FRAGS) ||
+	     skb_has_frag_list(skb) ||
+	     skb_shinfo(skb)->nr_frags >= CCMP_RX_MAX_SG) &&
+	    skb_linearize(skb))
+		return RX_DROP_UNUSABLE;
 
 	ccmp_hdr2pn(pn, skb->data + hdrlen);
 
@@ -523,15 +561,28 @@ ieee80211_crypto_ccmp_decrypt(struct ieee80211_rx_data *rx)
 	}
 
 	if (!(status->flag & RX_FLAG_DECRYPTED)) {
-		u8 scratch[6 * AES_BLOCK_SIZE];
-		/* hardware didn't decrypt/verify MIC */
-		ccmp_special_blocks(skb, pn, scratch, 1);
+		u8 b_0[AES_BLOCK_SIZE], aad[2 * AES_BLOCK_SIZE];
+		int err;
 
-		if (ieee80211_aes_ccm_decrypt(
-			    key->u.ccmp.tfm, scratch,
-			    skb->data + hdrlen + CCMP_HDR_LEN, data_len,
-			    skb->data + skb->len - CCMP_MIC_LEN,
-			    skb->data + hdrlen + CCMP_HDR_LEN))
+		/* hardware didn't decrypt/verify MIC */
+		ccmp_special_blocks(skb, pn, b_0, aad, 1);
+
+		if (skb_is_nonlinear(skb)) {
+			struct scatterlist sg[CCMP_RX_MAX_SG];
+
+			sg_init_table(sg, skb_shinfo(skb)->nr_frags + 1);
+			skb_to_sgvec(skb, sg, hdrlen + CCMP_HDR_LEN,
+				     data_len + CCMP_MIC_LEN);
+			err = ieee80211_aes_ccm_decrypt_sg(&key->u.ccmp.tfm,
+							   b_0, aad, sg,
+							   data_len);
+		} else {
+			err = ieee80211_aes_ccm_decrypt(
+				&key->u.ccmp.tfm, b_0, aad,
+				skb->data + hdrlen + CCMP_HDR_LEN, data_len,
+				skb->data + skb->len - CCMP_MIC_LEN);
+		}
+		if (err)
 			return RX_DROP_UNUSABLE;
 	}
 